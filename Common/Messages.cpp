@@ -16,6 +16,28 @@ UINT Get_WM_SET_CONNECTION_HWND()
     return s_setConnectionMessage;
 }
 
+EngineHandle InternEngineId(_In_reads_(length) LPCWSTR id, _In_ size_t length)
+{
+    // There are only ever a handful of engines, so a small vector searched under a lock is enough
+    static CComAutoCriticalSection s_csEngineIds;
+    static vector<CString> s_engineIds(1, CString(L"debugger"));
+
+    CString engineId(id, static_cast<int>(length));
+    engineId.MakeLower();
+
+    CComCritSecLock<CComAutoCriticalSection> lock(s_csEngineIds);
+    for (size_t i = 0; i < s_engineIds.size(); i++)
+    {
+        if (s_engineIds[i] == engineId)
+        {
+            return static_cast<EngineHandle>(i);
+        }
+    }
+
+    s_engineIds.push_back(engineId);
+    return static_cast<EngineHandle>(s_engineIds.size() - 1);
+}
+
 PCOPYDATASTRUCT MakeCopyDataStructCopy(_In_ const PCOPYDATASTRUCT pCopyDataStruct)
 {
     PCOPYDATASTRUCT const pCopyDataStructCopy = new COPYDATASTRUCT;
@@ -33,3 +55,110 @@ void FreeCopyDataStructCopy(_In_ PCOPYDATASTRUCT pCopyDataStructCopy)
     delete[](BYTE*) pCopyDataStructCopy->lpData;
     delete pCopyDataStructCopy;
 }
+
+HRESULT MakeCopyDataPayload(_In_ const vector<CString>& messages, _Out_ vector<BYTE>& buffer, _Out_ COPYDATASTRUCT& copyData)
+{
+    ATLENSURE_RETURN_HR(!messages.empty(), E_INVALIDARG);
+
+    const bool isBatched = (messages.size() > 1);
+    const size_t ucbParamsSize = (isBatched ?
+        offsetof(CopyDataPayload_BatchedStringMessage_Data, entries) + (messages.size() * sizeof(CopyDataPayload_BatchedStringMessage_Entry)) :
+        sizeof(CopyDataPayload_StringMessage_Data));
+
+    size_t ucbBufferSize = ucbParamsSize;
+    for (const auto& message : messages)
+    {
+        ucbBufferSize += sizeof(WCHAR) * (message.GetLength() + 1);
+    }
+    ATLENSURE_RETURN_HR(ucbBufferSize <= MAXDWORD, E_INVALIDARG);
+
+    try
+    {
+        buffer.assign(ucbBufferSize, 0);
+    }
+    catch (std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    copyData.dwData = (isBatched ? CopyDataPayload_ProcSignature::BatchedStringMessage_Signature : CopyDataPayload_ProcSignature::StringMessage_Signature);
+    copyData.cbData = static_cast<DWORD>(ucbBufferSize);
+    copyData.lpData = buffer.data();
+
+    CopyDataPayload_BatchedStringMessage_Data* pBatchedData = reinterpret_cast<CopyDataPayload_BatchedStringMessage_Data*>(buffer.data());
+    if (isBatched)
+    {
+        pBatchedData->uMessageCount = static_cast<UINT>(messages.size());
+    }
+
+    // Each string is null terminated by the zero filled buffer, so it can also be read as an LPCWSTR
+    size_t offset = ucbParamsSize;
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+        const size_t length = messages[i].GetLength();
+        ::CopyMemory(buffer.data() + offset, messages[i].GetString(), sizeof(WCHAR) * length);
+
+        if (isBatched)
+        {
+            pBatchedData->entries[i].uMessageOffset = static_cast<UINT>(offset);
+            pBatchedData->entries[i].uMessageLength = static_cast<UINT>(length);
+        }
+        else
+        {
+            CopyDataPayload_StringMessage_Data* pData = reinterpret_cast<CopyDataPayload_StringMessage_Data*>(buffer.data());
+            pData->uMessageOffset = static_cast<UINT>(offset);
+        }
+
+        offset += sizeof(WCHAR) * (length + 1);
+    }
+
+    return S_OK;
+}
+
+HRESULT ForEachCopyDataMessage(_In_ const PCOPYDATASTRUCT pCopyDataStruct, _In_ const function<HRESULT(LPCWSTR, size_t)>& callbackFunc)
+{
+    ATLENSURE_RETURN_HR(pCopyDataStruct != nullptr && pCopyDataStruct->lpData != nullptr, E_INVALIDARG);
+
+    const BYTE* pData = reinterpret_cast<const BYTE*>(pCopyDataStruct->lpData);
+    const size_t ucbDataSize = pCopyDataStruct->cbData;
+
+    HRESULT hr = S_OK;
+
+    if (pCopyDataStruct->dwData == CopyDataPayload_ProcSignature::BatchedStringMessage_Signature)
+    {
+        const size_t ucbHeaderSize = offsetof(CopyDataPayload_BatchedStringMessage_Data, entries);
+        ATLENSURE_RETURN_HR(ucbDataSize >= ucbHeaderSize, E_INVALIDARG);
+
+        const CopyDataPayload_BatchedStringMessage_Data* pMessages = reinterpret_cast<const CopyDataPayload_BatchedStringMessage_Data*>(pData);
+
+        // Check the count against the space left for entries before multiplying, so that the size cannot overflow
+        ATLENSURE_RETURN_HR(pMessages->uMessageCount <= (ucbDataSize - ucbHeaderSize) / sizeof(CopyDataPayload_BatchedStringMessage_Entry), E_INVALIDARG);
+
+        const size_t ucbParamsSize = ucbHeaderSize + (static_cast<size_t>(pMessages->uMessageCount) * sizeof(CopyDataPayload_BatchedStringMessage_Entry));
+        ATLENSURE_RETURN_HR(ucbParamsSize <= ucbDataSize, E_INVALIDARG);
+
+        for (UINT i = 0; i < pMessages->uMessageCount; i++)
+        {
+            const CopyDataPayload_BatchedStringMessage_Entry& entry = pMessages->entries[i];
+            ATLENSURE_RETURN_HR(entry.uMessageOffset >= ucbParamsSize && entry.uMessageOffset <= ucbDataSize, E_INVALIDARG);
+            ATLENSURE_RETURN_HR(entry.uMessageLength <= (ucbDataSize - entry.uMessageOffset) / sizeof(WCHAR), E_INVALIDARG);
+
+            hr = callbackFunc(reinterpret_cast<LPCWSTR>(pData + entry.uMessageOffset), entry.uMessageLength);
+            FAIL_IF_NOT_S_OK(hr);
+        }
+    }
+    else
+    {
+        ATLENSURE_RETURN_HR(pCopyDataStruct->dwData == CopyDataPayload_ProcSignature::StringMessage_Signature, E_INVALIDARG);
+        ATLENSURE_RETURN_HR(ucbDataSize >= sizeof(CopyDataPayload_StringMessage_Data), E_INVALIDARG);
+
+        const CopyDataPayload_StringMessage_Data* pMessage = reinterpret_cast<const CopyDataPayload_StringMessage_Data*>(pData);
+        ATLENSURE_RETURN_HR(pMessage->uMessageOffset >= sizeof(CopyDataPayload_StringMessage_Data) && pMessage->uMessageOffset <= ucbDataSize, E_INVALIDARG);
+
+        LPCWSTR lpString = reinterpret_cast<LPCWSTR>(pData + pMessage->uMessageOffset);
+        hr = callbackFunc(lpString, ::wcsnlen(lpString, (ucbDataSize - pMessage->uMessageOffset) / sizeof(WCHAR)));
+        FAIL_IF_NOT_S_OK(hr);
+    }
+
+    return hr;
+}
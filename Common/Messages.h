@@ -5,14 +5,14 @@
 #pragma once
 
 // Messages used internally in the same process, but across threads
-#define WM_PROCESSCOPYDATA          WM_USER + 1
-#define WM_SET_MESSAGE_HWND         WM_USER + 2 // WPARAM is BSTR (id), LPARAM is HWND
+#define WM_PROCESSCOPYDATA          WM_USER + 1 // WPARAM is MessagePacket in the proxy, LPARAM is COPYDATASTRUCT copy in the adapter
+#define WM_SET_MESSAGE_HWND         WM_USER + 2 // WPARAM is EngineHandle, LPARAM is HWND
 
 #define WM_MESSAGE_RECEIVE          WM_USER + 3 // WPARAM is BSTR (MessagePacket), LPARAM is NULL
 #define WM_MESSAGE_SEND             WM_USER + 4 // WPARAM is BSTR (data), LPARAM is NULL
 #define WM_MESSAGE_IN_QUEUE         WM_USER + 5
 
-#define WM_CREATE_ENGINE            WM_USER + 6 // WPARAM is BSTR (id), LPARAM is NULL
+#define WM_CREATE_ENGINE            WM_USER + 6 // WPARAM is EngineHandle, LPARAM is NULL
 #define WM_BREAK_OCCURRED           WM_USER + 7
 #define WM_TEST_TIMEOUT             WM_USER + 8
 #define WM_TEST_START               WM_USER + 9
@@ -27,10 +27,17 @@ enum class MessageType
     ExecuteAtBreak
 };
 
+// Engine ids are interned once into small handles, so that routing a packet is an array index
+typedef UINT EngineHandle;
+static const EngineHandle DEBUGGER_ENGINEHANDLE = 0; // "debugger" is always the first interned id
+static const EngineHandle INVALID_ENGINEHANDLE = UINT_MAX;
+
+EngineHandle InternEngineId(_In_reads_(length) LPCWSTR id, _In_ size_t length);
+
 struct MessagePacket
 {
     MessageType m_messageType;
-    CComBSTR m_engineId;
+    EngineHandle m_engineHandle;
     CComBSTR m_scriptName;
     CComBSTR m_message;
 };
@@ -38,7 +45,8 @@ struct MessagePacket
 // Used to send a string across processes
 enum CopyDataPayload_ProcSignature : ULONG_PTR
 {
-    StringMessage_Signature
+    StringMessage_Signature,
+    BatchedStringMessage_Signature
 };
 
 #pragma pack(push, 1)
@@ -46,7 +54,26 @@ struct CopyDataPayload_StringMessage_Data
 {
     UINT uMessageOffset;
 };
+
+// Used to send several strings across processes in a single transfer
+struct CopyDataPayload_BatchedStringMessage_Entry
+{
+    UINT uMessageOffset;
+    UINT uMessageLength; // In characters, not including the null terminator
+};
+
+struct CopyDataPayload_BatchedStringMessage_Data
+{
+    UINT uMessageCount;
+    CopyDataPayload_BatchedStringMessage_Entry entries[1]; // Followed by the remaining entries and then the string data
+};
 #pragma pack(pop)
 
 PCOPYDATASTRUCT MakeCopyDataStructCopy(_In_ const PCOPYDATASTRUCT pCopyDataStruct);
 void FreeCopyDataStructCopy(_In_ PCOPYDATASTRUCT pCopyDataStructCopy);
+
+// Packs the messages into a single buffer, using the batched format when there is more than one
+HRESULT MakeCopyDataPayload(_In_ const vector<CString>& messages, _Out_ vector<BYTE>& buffer, _Out_ COPYDATASTRUCT& copyData);
+
+// Calls the callback with a view of each message in the payload, in the order they were packed
+HRESULT ForEachCopyDataMessage(_In_ const PCOPYDATASTRUCT pCopyDataStruct, _In_ const function<HRESULT(LPCWSTR, size_t)>& callbackFunc);
@@ -5,14 +5,38 @@
 #include "stdafx.h"
 #include "DebuggerDispatch.h"
 #include "ScriptHelpers.h"
+#include "SelfTests.h"
+
+// Property names of the records that are created in bulk, used as shapes for the script object cache
+static const LPCWSTR s_locationShape[] = { L"docId", L"start", L"length" };
+static const LPCWSTR s_frameShape[] = { L"callFrameId", L"functionName", L"isInTryBlock", L"isInternal", L"location" };
+static const LPCWSTR s_propertyInfoShape[] = { L"propertyId", L"name", L"type", L"value", L"fullName", L"expandable", L"readOnly", L"fake", L"invalid", L"returnValue" };
+
+// Tracepoint messages are sent to the front end once this many are waiting, or on the next timer tick, whichever comes first
+static const size_t s_tracepointFlushThreshold = 100;
+
+// New documents are sent to the front end once this many are waiting, or on the next timer tick, whichever comes first
+static const size_t s_documentBatchThreshold = 200;
+
+// The interval in milliseconds of the dispatch timer, which also bounds how late an eval timeout is noticed
+static const UINT s_timerInterval = 100;
 
 CDebuggerDispatch::CDebuggerDispatch() : 
     m_dispatchThreadId(::GetCurrentThreadId()), // We are always created on the dispatch thread
     m_eventHelper(this->GetUnknown()),
-    m_hasHitBreak(false)
+    m_hasHitBreak(false),
+    m_maxDynamicDocuments(0),
+    m_suppressedSinceFlush(0),
+    m_isTimerScheduled(false)
 {
 }
 
+CDebuggerDispatch::~CDebuggerDispatch()
+{
+    // The timer id is our this pointer, so it must never fire after we are gone
+    this->CancelTimer();
+}
+
 // IF12DebuggerExtension
 STDMETHODIMP CDebuggerDispatch::Initialize(_In_ HWND hwndDebugPipeHandler, _In_ IDispatchEx* pScriptDispatchEx, _In_ HANDLE hBreakNotificationComplete, _In_ BOOL isDocked, _In_ IUnknown* pDebugApplication)
 {
@@ -25,9 +49,12 @@ STDMETHODIMP CDebuggerDispatch::Initialize(_In_ HWND hwndDebugPipeHandler, _In_
     m_hwndDebugPipeHandler = hwndDebugPipeHandler;
     m_spScriptDispatch = pScriptDispatchEx;
 
+    HRESULT hr = m_scriptObjectCache.Initialize(m_spScriptDispatch);
+    BPT_FAIL_IF_NOT_S_OK(hr);
+
     // Create the message queue used for getting the PDM events
     CComObject<PDMEventMessageQueue>* pMessageQueue;
-    HRESULT hr = CComObject<PDMEventMessageQueue>::CreateInstance(&pMessageQueue);
+    hr = CComObject<PDMEventMessageQueue>::CreateInstance(&pMessageQueue);
     BPT_FAIL_IF_NOT_S_OK(hr);
 
     hr = pMessageQueue->Initialize(m_hwndDebugPipeHandler);
@@ -65,6 +92,11 @@ STDMETHODIMP CDebuggerDispatch::Deinitialize()
 {
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
 
+    // The timer holds a raw pointer to us, so it cannot outlive the session
+    this->CancelTimer();
+
+    m_tracepointLog.clear();
+    m_scriptObjectCache.Reset();
     m_spScriptDispatch.Release();
     m_spThreadController.Release();
     m_spSourceController.Release();
@@ -256,96 +288,121 @@ HRESULT CDebuggerDispatch::FireQueuedEvents()
                     HRESULT hr = m_spSourceController->RefreshSources(added, updated, removed, rebound);
                     BPT_FAIL_IF_NOT_S_OK(hr);
 
-                    // Added
+                    // Each batch is serialized into a single json payload, so creating the script objects costs
+                    // one call into the engine per event rather than one call per property of every record.
+
+                    // Added, these are held back and sent together with the documents from other updates
                     if (!added.empty())
                     {
-                        vector<CComVariant> addedDocuments;
-                        for (const auto& node : added)
-                        {
-                            map<CString, CComVariant> properties;
-                            properties[L"docId"] = node->docId;
-                            properties[L"parentDocId"] =  node->parentId;
-                            properties[L"url"] = node->url;
-                            properties[L"mimeType"] = node->mimeType;
-                            properties[L"length"] = node->textLength;
-                            properties[L"isDynamicCode"] =  node->isDynamicCode;
-                            properties[L"sourceMapUrlFromHeader"] = node->sourceMapUrlFromHeader;
-                            properties[L"longDocumentId"] = node->longDocumentId;
-
-                            CComVariant object;
-                            hr = ScriptHelpers::CreateJScriptObject(m_spScriptDispatch, properties, object);
-                            ATLASSERT(hr == S_OK); // Assert in chk bits so we can tell if this fails. In ret bits, just continue with the next member instead
-
-                            if (hr == S_OK)
-                            {
-                                addedDocuments.push_back(object);
-                            }
-                        }
-
-                        this->FireDocumentEvent(L"onAddDocuments", addedDocuments);
+                        this->QueueAddedDocuments(added);
                     }
 
-                    // Updated
+                    // Updated, a document that has not been sent yet just goes out with its newer info
                     if (!updated.empty())
                     {
-                        vector<CComVariant> updatedDocuments;
+                        CString json(L"[");
                         for (const auto& node : updated)
                         {
-                            map<CString, CComVariant> properties;
-                            properties[L"docId"] = node->docId;
-                            properties[L"url"] = node->url;
-                            properties[L"mimeType"] = node->mimeType;
-                            properties[L"length"] = node->textLength;
+                            auto pSuppressed = m_suppressedDocuments.find(node->docId);
+                            if (pSuppressed != nullptr)
+                            {
+                                *pSuppressed = node;
+                                continue;
+                            }
 
-                            CComVariant object;
-                            hr = ScriptHelpers::CreateJScriptObject(m_spScriptDispatch, properties, object);
-                            ATLASSERT(hr == S_OK); // Assert in chk bits so we can tell if this fails. In ret bits, just continue with the next member instead
+                            if (m_pendingDocumentIds.contains(node->docId))
+                            {
+                                auto it = std::find_if(m_pendingDocuments.begin(), m_pendingDocuments.end(), [&node](const shared_ptr<DocumentInfo>& spPending) {
+                                    return spPending->docId == node->docId;
+                                });
+                                if (it != m_pendingDocuments.end())
+                                {
+                                    *it = node;
+                                }
+
+                                continue;
+                            }
 
-                            if (hr == S_OK)
+                            if (json.GetLength() > 1)
                             {
-                                updatedDocuments.push_back(object);
+                                json.AppendChar(L',');
                             }
+
+                            json.AppendFormat(L"{\"docId\":%u,\"length\":%u,\"url\":", node->docId, node->textLength);
+                            ScriptHelpers::AppendJSONString(json, node->url);
+                            json.Append(L",\"mimeType\":");
+                            ScriptHelpers::AppendJSONString(json, node->mimeType);
+                            json.AppendChar(L'}');
                         }
+                        json.AppendChar(L']');
 
-                        this->FireDocumentEvent(L"onUpdateDocuments", updatedDocuments);
+                        if (json.GetLength() > 2)
+                        {
+                            this->FireDocumentEvent(L"onUpdateDocuments", json);
+                        }
                     }
 
-                    // Removed
+                    // Removed, a document that the front end never saw is just forgotten
                     if (!removed.empty())
                     {
-                        vector<CComVariant> removedDocuments;
+                        // Conditions are prepared again on the next hit, so the cache does not keep growing with every dynamic document's breakpoints
+                        m_spThreadController->ClearBreakpointConditions();
+
+                        CString json(L"[");
                         for (const auto& docId : removed)
                         {
-                            removedDocuments.push_back(CComVariant(docId));
+                            m_reportedDynamicDocuments.erase(docId);
+
+                            if (m_suppressedDocuments.find(docId) != nullptr)
+                            {
+                                m_suppressedDocuments.erase(docId);
+                                continue;
+                            }
+
+                            if (m_pendingDocumentIds.contains(docId))
+                            {
+                                m_pendingDocumentIds.erase(docId);
+                                m_pendingDocuments.erase(std::remove_if(m_pendingDocuments.begin(), m_pendingDocuments.end(), [docId](const shared_ptr<DocumentInfo>& spPending) {
+                                    return spPending->docId == docId;
+                                }),
+                                    m_pendingDocuments.end());
+                                continue;
+                            }
+
+                            json.AppendFormat((json.GetLength() > 1) ? L",%u" : L"%u", docId);
                         }
+                        json.AppendChar(L']');
 
-                        this->FireDocumentEvent(L"onRemoveDocuments", removedDocuments);
+                        if (json.GetLength() > 2)
+                        {
+                            this->FireDocumentEvent(L"onRemoveDocuments", json);
+                        }
                     }
 
                     // Rebound breakpoints
                     if (!rebound.empty())
                     {
-                        vector<CComVariant> reboundBreakpoints;
+                        // The breakpoints may have moved into documents that are still waiting to be sent, or that were held back
                         for (const auto& node : rebound)
                         {
-                            map<CString, CComVariant> properties;
-                            properties[L"breakpointId"] = node->breakpointId;
-                            properties[L"newDocId"] = node->newDocId;
-                            properties[L"start"] = node->start;
-                            properties[L"length"] = node->length;
-                            properties[L"isBound"] = node->isBound;
+                            this->RevealDocument(node->newDocId);
+                        }
 
-                            CComVariant object;
-                            hr = ScriptHelpers::CreateJScriptObject(m_spScriptDispatch, properties, object);
-                            ATLASSERT(hr == S_OK); // Assert in chk bits so we can tell if this fails. In ret bits, just continue with the next member instead
+                        this->FlushAddedDocuments();
 
-                            if (hr == S_OK)
+                        CString json(L"[");
+                        for (const auto& node : rebound)
+                        {
+                            if (json.GetLength() > 1)
                             {
-                                reboundBreakpoints.push_back(object);
+                                json.AppendChar(L',');
                             }
+
+                            json.AppendFormat(L"{\"breakpointId\":%u,\"newDocId\":%u,\"start\":%u,\"length\":%u,\"isBound\":%s}", node->breakpointId, node->newDocId, node->start, node->length, node->isBound ? L"true" : L"false");
                         }
+                        json.AppendChar(L']');
 
-                        this->FireDocumentEvent(L"onResolveBreakpoints", reboundBreakpoints);
+                        this->FireDocumentEvent(L"onResolveBreakpoints", json);
                     }
                 }
                 break;
@@ -353,7 +410,6 @@ HRESULT CDebuggerDispatch::FireQueuedEvents()
             case PDMEventType::BreakpointHit:
                 {
                     // A breakpoint was hit, so inform the JavaScript
-                    // The JavaScript should also perform evaluation of any conditional so that we know to break or not
                     shared_ptr<BreakEventInfo> spBreakInfo;
                     HRESULT hr = m_spThreadController->GetBreakEventInfo(spBreakInfo);
                     ATLENSURE_RETURN_HR(hr == S_OK || hr == E_NOT_VALID_STATE, hr);
@@ -364,8 +420,31 @@ HRESULT CDebuggerDispatch::FireQueuedEvents()
                         break;
                     }
 
+                    // Conditions and tracepoints are evaluated here before anything is created for the JavaScript,
+                    // so a false condition or a tracepoint resumes straight away without the front end or IE ever seeing the break.
+                    bool shouldBreak = true;
+                    vector<TracepointMessage> tracepointMessages;
+                    hr = m_spThreadController->EvaluateBreakConditions(spBreakInfo, shouldBreak, tracepointMessages);
+                    if (!tracepointMessages.empty())
+                    {
+                        this->LogTracepointMessages(tracepointMessages);
+                    }
+
+                    if (hr == S_OK && !shouldBreak)
+                    {
+                        hr = m_spThreadController->ResumeInternalBreak();
+                        if (hr == S_OK)
+                        {
+                            break;
+                        }
+                    }
+
                     m_hasHitBreak = true;
 
+                    // Make sure everything logged or loaded before this break reaches the front end ahead of the pause
+                    this->FlushAddedDocuments();
+                    this->FlushTracepointMessages();
+
                     CComVariant breakpointsArray;
                     if (spBreakInfo->breakReason == BREAKREASON_BREAKPOINT)
                     {
@@ -390,7 +469,7 @@ HRESULT CDebuggerDispatch::FireQueuedEvents()
                             }
                         }
 
-                        hr = ScriptHelpers::CreateJScriptArray(m_spScriptDispatch, allBreakpoints, breakpointsArray);
+                        hr = m_scriptObjectCache.CreateArray(allBreakpoints, breakpointsArray);
                         BPT_FAIL_IF_NOT_S_OK(hr);
                     }
                     else
@@ -411,7 +490,7 @@ HRESULT CDebuggerDispatch::FireQueuedEvents()
                     properties[L"breakEventType"] = spBreakInfo->breakEventType;
 
                     CComVariant object;
-                    hr = ScriptHelpers::CreateJScriptObject(m_spScriptDispatch, properties, object);
+                    hr = m_scriptObjectCache.CreateObject(properties, object);
                     BPT_FAIL_IF_NOT_S_OK(hr);
 
                     const UINT argLength = 1;
@@ -437,10 +516,38 @@ HRESULT CDebuggerDispatch::FireQueuedEvents()
                 }
                 break;
 
+            case PDMEventType::ExceptionFiltered:
+                {
+                    // A first chance exception that the filter rules skip, so resume without telling the JavaScript
+                    HRESULT hr = m_spThreadController->ResumeInternalBreak();
+                    ATLASSERT(hr == S_OK || hr == E_NOT_VALID_STATE); // We may have already resumed through another path
+                }
+                break;
+
+            case PDMEventType::BlackboxedStep:
+                {
+                    // A step that stopped in a blackboxed script, so keep stepping without telling the JavaScript
+                    HRESULT hr = m_spThreadController->ContinueBlackboxedStep();
+                    ATLASSERT(hr == S_OK || hr == E_NOT_VALID_STATE); // We may have already resumed through another path
+                }
+                break;
+
+            case PDMEventType::EvalCompleted:
+                {
+                    // One or more batched evals have finished, so send their results to the JavaScript
+                    HRESULT hr = this->FireEvalBatchResults();
+                    BPT_FAIL_IF_NOT_S_OK(hr);
+                }
+                break;
+
             case PDMEventType::PDMClosed: 
                 {
-                    // Disconnect
+                    // Send anything still waiting to be logged before we disconnect
+                    this->FlushTracepointMessages();
+
+                    // Disconnect, the documents that have not been sent yet are gone along with the rest
                     HRESULT hr = m_spThreadController->Disconnect();
+                    this->ClearPendingDocuments();
                     BPT_FAIL_IF_NOT_S_OK(hr);
 
                     ::SendMessageW(m_hwndDebugPipeHandler, WM_FORCEDISABLEDYNAMICDEBUGGING, NULL, NULL);
@@ -614,6 +721,7 @@ STDMETHODIMP CDebuggerDispatch::disconnect(_Out_ VARIANT_BOOL* pSuccess)
         ATLENSURE_RETURN_HR(pSuccess != nullptr, E_INVALIDARG);
 
         HRESULT hr = m_spThreadController->Disconnect();
+        this->ClearPendingDocuments();
 
         (*pSuccess) = (hr == S_OK ? VARIANT_TRUE : VARIANT_FALSE);
     }
@@ -642,6 +750,9 @@ STDMETHODIMP CDebuggerDispatch::shutdown(_Out_ VARIANT_BOOL* pSuccess)
 
     this->removeAllEventListeners();
 
+    // Nothing is left for the timer to do once the controllers are released
+    this->CancelTimer();
+
     m_spThreadController.Release();
     m_spSourceController.Release();
     m_spMessageQueue.Release();
@@ -848,7 +959,7 @@ STDMETHODIMP CDebuggerDispatch::addPendingBreakpoint(_In_ BSTR url, _In_ ULONG s
         CComBSTR newUrl(url);
         CComBSTR newCondition(condition);
         ULONG bpId = 0;
-        hr = m_spSourceController->AddPendingBreakpoint(newUrl, start, newCondition, !!isEnabled, !!isTracepoint, bpId);
+        hr = m_spSourceController->AddPendingBreakpoint(newUrl, /*isUrlRegex=*/ false, start, newCondition, !!isEnabled, !!isTracepoint, bpId);
 
         (*pBreakpointId) = (hr == S_OK) ? bpId : 0;
     }
@@ -871,6 +982,11 @@ STDMETHODIMP CDebuggerDispatch::removeBreakpoint(_In_ ULONG breakpointId, _Out_
     ATLENSURE_RETURN_HR(pSuccess != nullptr, E_INVALIDARG);
 
     HRESULT hr = m_spSourceController->RemoveBreakpoint(breakpointId);
+    if (hr == S_OK)
+    {
+        m_spThreadController->RemoveBreakpointCondition(breakpointId);
+    }
+
     (*pSuccess) = (hr == S_OK ? VARIANT_TRUE : VARIANT_FALSE);
 
     return S_OK;
@@ -974,7 +1090,7 @@ STDMETHODIMP CDebuggerDispatch::getThreads(_Out_ VARIANT* pvThreadDescriptions)
 
         // Create the VARIANT that represents the array in JavaScript
         CComVariant descriptionsArray;
-        hr = ScriptHelpers::CreateJScriptArray(m_spScriptDispatch, descriptions, descriptionsArray);
+        hr = m_scriptObjectCache.CreateArray(descriptions, descriptionsArray);
         BPT_FAIL_IF_NOT_S_OK(hr);
 
         // Set it to the out param
@@ -994,7 +1110,7 @@ STDMETHODIMP CDebuggerDispatch::getThreads(_Out_ VARIANT* pvThreadDescriptions)
     return S_OK;
 }
 
-STDMETHODIMP CDebuggerDispatch::getFrames(_In_ LONG /* framesNeeded */, _Out_ VARIANT* pvFramesArray)
+STDMETHODIMP CDebuggerDispatch::getFrames(_In_ LONG framesNeeded, _Out_ VARIANT* pvFramesArray)
 {
     try
     {
@@ -1005,31 +1121,40 @@ STDMETHODIMP CDebuggerDispatch::getFrames(_In_ LONG /* framesNeeded */, _Out_ VA
         vector<CComVariant> currentFrames;
 
         vector<shared_ptr<CallFrameInfo>> spFrames;
-        HRESULT hr = m_spThreadController->GetCallFrames(spFrames);
+        // Only the frames that are asked for are created, anything less than 1 means the whole callstack
+        HRESULT hr = m_spThreadController->GetCallFrames(framesNeeded > 0 ? (ULONG)framesNeeded : 0, spFrames);
         if (hr == S_OK)
         {
+            // The front end has to know about every document on the callstack before it sees the frames
+            for (const auto& frame : spFrames)
+            {
+                this->RevealDocument(frame->sourceLocation.docId);
+            }
+
+            this->FlushAddedDocuments();
+
             for (const auto& frame : spFrames)
             {
                 // Create the script location
-                map<CString, CComVariant> locationMap;
-                locationMap[L"docId"] = frame->sourceLocation.docId;
-                locationMap[L"start"] = frame->sourceLocation.charPosition;
-                locationMap[L"length"] = frame->sourceLocation.contextCount;
+                CComVariant locationValues[_countof(s_locationShape)];
+                locationValues[0] = frame->sourceLocation.docId;
+                locationValues[1] = frame->sourceLocation.charPosition;
+                locationValues[2] = frame->sourceLocation.contextCount;
 
                 CComVariant locationObject;
-                hr = ScriptHelpers::CreateJScriptObject(m_spScriptDispatch, locationMap, locationObject);
+                hr = m_scriptObjectCache.CreateRecord(s_locationShape, _countof(s_locationShape), locationValues, locationObject);
                 BPT_FAIL_IF_NOT_S_OK(hr);
 
                 // Create the frame object and add the location
-                map<CString, CComVariant> frameMap;
-                frameMap[L"callFrameId"] = frame->id;
-                frameMap[L"functionName"] = frame->functionName;
-                frameMap[L"isInTryBlock"] = frame->isInTryBlock;
-                frameMap[L"isInternal"] = frame->isInternal;
-                frameMap[L"location"] = locationObject;
+                CComVariant frameValues[_countof(s_frameShape)];
+                frameValues[0] = frame->id;
+                frameValues[1] = frame->functionName;
+                frameValues[2] = frame->isInTryBlock;
+                frameValues[3] = frame->isInternal;
+                frameValues[4] = locationObject;
 
                 CComVariant frameObject;
-                hr = ScriptHelpers::CreateJScriptObject(m_spScriptDispatch, frameMap, frameObject);
+                hr = m_scriptObjectCache.CreateRecord(s_frameShape, _countof(s_frameShape), frameValues, frameObject);
                 if (hr == S_OK)
                 {
                     currentFrames.push_back(frameObject);
@@ -1044,7 +1169,7 @@ STDMETHODIMP CDebuggerDispatch::getFrames(_In_ LONG /* framesNeeded */, _Out_ VA
 
         // Create the VARIANT that represents the array in JavaScript
         CComVariant framesArray;
-        hr = ScriptHelpers::CreateJScriptArray(m_spScriptDispatch, currentFrames, framesArray);
+        hr = m_scriptObjectCache.CreateArray(currentFrames, framesArray);
         BPT_FAIL_IF_NOT_S_OK(hr);
 
         // Set it to the out param
@@ -1084,7 +1209,7 @@ STDMETHODIMP CDebuggerDispatch::getSourceText(_In_ ULONG docId, _Out_ VARIANT* p
 
         // Create the VARIANT that represents that object in JavaScript
         CComVariant propertiesObject;
-        hr = ScriptHelpers::CreateJScriptObject(m_spScriptDispatch, propertiesMap, propertiesObject);
+        hr = m_scriptObjectCache.CreateObject(propertiesMap, propertiesObject);
         BPT_FAIL_IF_NOT_S_OK(hr);
 
         // Set it to the out param
@@ -1104,7 +1229,7 @@ STDMETHODIMP CDebuggerDispatch::getSourceText(_In_ ULONG docId, _Out_ VARIANT* p
     return S_OK;
 }
 
-STDMETHODIMP CDebuggerDispatch::getLocals(_In_ ULONG frameId, _Out_ ULONG* pPropertyId)
+STDMETHODIMP CDebuggerDispatch::getLocals(_In_ ULONG frameId, _Out_ double* pPropertyId)
 {
     try
     {
@@ -1112,12 +1237,12 @@ STDMETHODIMP CDebuggerDispatch::getLocals(_In_ ULONG frameId, _Out_ ULONG* pProp
         ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
         ATLENSURE_RETURN_HR(pPropertyId != nullptr, E_INVALIDARG);
 
-        ULONG propertyId;
+        PropertyHandle propertyId;
         HRESULT hr = m_spThreadController->GetLocals(frameId, propertyId);
         if (hr == S_OK)
         {
             // Set the valid property id to the out parameter
-            (*pPropertyId) = propertyId;
+            (*pPropertyId) = static_cast<double>(propertyId);
         }
         else
         {
@@ -1137,7 +1262,7 @@ STDMETHODIMP CDebuggerDispatch::getLocals(_In_ ULONG frameId, _Out_ ULONG* pProp
     return S_OK;
 }
 
-STDMETHODIMP CDebuggerDispatch::eval(_In_ ULONG frameId, _In_ BSTR evalString, _Out_ VARIANT* pvPropertyInfo)
+STDMETHODIMP CDebuggerDispatch::eval(_In_ ULONG frameId, _In_ BSTR evalString, _In_ BSTR objectGroup, _Out_ VARIANT* pvPropertyInfo)
 {
     try
     {
@@ -1150,7 +1275,7 @@ STDMETHODIMP CDebuggerDispatch::eval(_In_ ULONG frameId, _In_ BSTR evalString, _
         ::VariantInit(pvPropertyInfo);
 
         shared_ptr<PropertyInfo> spPropertyInfo;
-        HRESULT hr = m_spThreadController->Eval(frameId, CComBSTR(evalString), EVAL_RADIX, spPropertyInfo);
+        HRESULT hr = m_spThreadController->Eval(frameId, CComBSTR(evalString), EVAL_RADIX, CString(objectGroup), spPropertyInfo);
         if (hr == S_OK)
         {
             CComVariant propertyInfoObject;
@@ -1182,7 +1307,7 @@ STDMETHODIMP CDebuggerDispatch::eval(_In_ ULONG frameId, _In_ BSTR evalString, _
     return S_OK;
 }
 
-STDMETHODIMP CDebuggerDispatch::getChildProperties(_In_ ULONG propertyId, _In_ ULONG start, _In_ ULONG length, _Out_ VARIANT* pvPropertyInfosObject)
+STDMETHODIMP CDebuggerDispatch::getChildProperties(_In_ double propertyId, _In_ ULONG start, _In_ ULONG length, _Out_ VARIANT* pvPropertyInfosObject)
 {
     try
     {
@@ -1193,30 +1318,23 @@ STDMETHODIMP CDebuggerDispatch::getChildProperties(_In_ ULONG propertyId, _In_ U
         vector<CComVariant> properties;
         bool hasAdditionalChildren = false;
 
+        // Only the requested window of children is enumerated and materialized
         vector<shared_ptr<PropertyInfo>> spPropertyInfos;
-        HRESULT hr = m_spThreadController->EnumeratePropertyMembers(propertyId, EVAL_RADIX, spPropertyInfos);
+        ULONG total = 0;
+        HRESULT hr = m_spThreadController->EnumeratePropertyMembers(CDebuggerDispatch::GetPropertyHandle(propertyId), EVAL_RADIX, start, length, spPropertyInfos, total);
 
-        if (hr == S_OK && spPropertyInfos.size() < ULONG_MAX && start < (ULONG)spPropertyInfos.size())
+        if (hr == S_OK && start < total)
         {
-            ULONG total = (ULONG)spPropertyInfos.size();
-
-            if (length == 0)
-            {
-                // Length 0 means to return all of the properties
-                length = total;
-            }
-
-            ULONG end = start + length;
-            if (end < total)
+            if (length != 0 && length < total - start)
             {
                 hasAdditionalChildren = true;
             }
 
             // Populate the list of properties
-            for (ULONG i = start; i < total && i < end; i++)
+            for (const auto& spPropertyInfo : spPropertyInfos)
             {
                 CComVariant propertyInfoObject;
-                hr = this->GetPropertyObjectFromPropertyInfo(spPropertyInfos[i], propertyInfoObject);
+                hr = this->GetPropertyObjectFromPropertyInfo(spPropertyInfo, propertyInfoObject);
                 BPT_FAIL_IF_NOT_S_OK(hr);
 
                 properties.push_back(propertyInfoObject);
@@ -1230,7 +1348,7 @@ STDMETHODIMP CDebuggerDispatch::getChildProperties(_In_ ULONG propertyId, _In_ U
 
         // Create the VARIANT that represents the array in JavaScript
         CComVariant propertiesArray;
-        hr = ScriptHelpers::CreateJScriptArray(m_spScriptDispatch, properties, propertiesArray);
+        hr = m_scriptObjectCache.CreateArray(properties, propertiesArray);
         BPT_FAIL_IF_NOT_S_OK(hr);
 
         // Map that array onto an object with additional members
@@ -1240,7 +1358,7 @@ STDMETHODIMP CDebuggerDispatch::getChildProperties(_In_ ULONG propertyId, _In_ U
 
         // Create the VARIANT that represents that object in JavaScript
         CComVariant propertiesObject;
-        hr = ScriptHelpers::CreateJScriptObject(m_spScriptDispatch, propertiesMap, propertiesObject);
+        hr = m_scriptObjectCache.CreateObject(propertiesMap, propertiesObject);
         BPT_FAIL_IF_NOT_S_OK(hr);
 
         // Set it to the out param
@@ -1260,14 +1378,14 @@ STDMETHODIMP CDebuggerDispatch::getChildProperties(_In_ ULONG propertyId, _In_ U
     return S_OK;
 }
 
-STDMETHODIMP CDebuggerDispatch::setPropertyValueAsString(_In_ ULONG propertyId, _In_ BSTR* pValue, _Out_ VARIANT_BOOL* pSuccess)
+STDMETHODIMP CDebuggerDispatch::setPropertyValueAsString(_In_ double propertyId, _In_ BSTR* pValue, _Out_ VARIANT_BOOL* pSuccess)
 {
     // Sets the value of a IDebugProperty given by propertyId
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
     ATLENSURE_RETURN_HR(pValue != nullptr, E_INVALIDARG);
     ATLENSURE_RETURN_HR(pSuccess != nullptr, E_INVALIDARG);
 
-    HRESULT hr = m_spThreadController->SetPropertyValueAsString(propertyId, pValue, EVAL_RADIX);
+    HRESULT hr = m_spThreadController->SetPropertyValueAsString(CDebuggerDispatch::GetPropertyHandle(propertyId), pValue, EVAL_RADIX);
     (*pSuccess) = (hr == S_OK ? VARIANT_TRUE : VARIANT_FALSE);
 
     return S_OK;
@@ -1317,71 +1435,901 @@ STDMETHODIMP CDebuggerDispatch::setBreakOnFirstChanceExceptions(_In_ BOOL fValue
     return S_OK;
 }
 
-// Helper functions
-HRESULT CDebuggerDispatch::OnEventListenerUpdated(_In_ bool const isListening)
+STDMETHODIMP CDebuggerDispatch::getLineColumnFromOffset(_In_ ULONG docId, _In_ ULONG offset, _Out_ VARIANT* pvLineColumn)
+{
+    try
+    {
+        // Returns the zero based line and column of a character offset in the given document.
+        // A document whose text cannot be loaded maps every offset to line 0, column 0.
+        ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+        ATLENSURE_RETURN_HR(pvLineColumn != nullptr, E_INVALIDARG);
+
+        ULONG lineNumber = 0;
+        ULONG columnNumber = 0;
+        m_spSourceController->GetLineColumnFromOffset(docId, offset, lineNumber, columnNumber);
+
+        map<CString, CComVariant> propertiesMap;
+        propertiesMap[L"lineNumber"] = lineNumber;
+        propertiesMap[L"columnNumber"] = columnNumber;
+
+        // Create the VARIANT that represents that object in JavaScript
+        CComVariant propertiesObject;
+        HRESULT hr = m_scriptObjectCache.CreateObject(propertiesMap, propertiesObject);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        // Set it to the out param
+        ::VariantInit(pvLineColumn);
+        hr = propertiesObject.Detach(pvLineColumn);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+    }
+    catch (const bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+    catch (const CAtlException& err)
+    {
+        return err.m_hr;
+    }
+
+    return S_OK;
+}
+
+STDMETHODIMP CDebuggerDispatch::getOffsetFromLineColumn(_In_ ULONG docId, _In_ ULONG lineNumber, _In_ ULONG columnNumber, _Out_ LONG* pOffset)
 {
+    // Returns the character offset of a zero based line and column in the given document,
+    // It will return -1 if the document or line cannot be found.
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
-    ATLENSURE_RETURN_HR(m_spSourceController.p != nullptr, E_NOT_VALID_STATE);
+    ATLENSURE_RETURN_HR(pOffset != nullptr, E_INVALIDARG);
 
-    HRESULT hr = S_OK;
+    ULONG offset = 0;
+    HRESULT hr = m_spSourceController->GetOffsetFromLineColumn(docId, lineNumber, columnNumber, offset);
+    (*pOffset) = (hr == S_OK ? static_cast<LONG>(offset) : -1);
 
-    if (isListening)
+    return S_OK;
+}
+
+STDMETHODIMP CDebuggerDispatch::searchInContent(_In_ ULONG docId, _In_ BSTR query, _In_ BOOL caseSensitive, _In_ BOOL isRegex, _Out_ VARIANT* pvMatchesArray)
+{
+    try
     {
-        m_spSourceController->RebindAllEventBreakpoints(/*isEventListenerRegistered=*/ true);
+        // Returns an array of { lineNumber, lineContent } for each line of the document that matches the query.
+        // An invalid regex or a document whose text cannot be loaded gives an empty array.
+        ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+        ATLENSURE_RETURN_HR(pvMatchesArray != nullptr, E_INVALIDARG);
+
+        vector<SearchMatch> matches;
+        m_spSourceController->SearchInContent(docId, CComBSTR(query), !!caseSensitive, !!isRegex, matches);
+
+        vector<CComVariant> matchObjects;
+        matchObjects.reserve(matches.size());
+        for (const auto& match : matches)
+        {
+            map<CString, CComVariant> matchMap;
+            matchMap[L"lineNumber"] = match.lineNumber;
+            matchMap[L"lineContent"] = match.lineContent;
+
+            CComVariant matchObject;
+            HRESULT hr = m_scriptObjectCache.CreateObject(matchMap, matchObject);
+            BPT_FAIL_IF_NOT_S_OK(hr);
+
+            matchObjects.push_back(matchObject);
+        }
+
+        // Create the VARIANT that represents the array in JavaScript
+        CComVariant matchesArray;
+        HRESULT hr = m_scriptObjectCache.CreateArray(matchObjects, matchesArray);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        // Set it to the out param
+        ::VariantInit(pvMatchesArray);
+        hr = matchesArray.Detach(pvMatchesArray);
+        BPT_FAIL_IF_NOT_S_OK(hr);
     }
-    else
+    catch (const bad_alloc&)
     {
-        // Now that the listeners have been removed in the BHO, unbind all the event breakpoints
-        m_spSourceController->UnbindAllEventBreakpoints(/*removeListeners=*/ false);
+        return E_OUTOFMEMORY;
+    }
+    catch (const CAtlException& err)
+    {
+        return err.m_hr;
     }
 
-    return hr;
+    return S_OK;
 }
 
-HRESULT CDebuggerDispatch::FireDocumentEvent(_In_ const CString& eventName, _In_ vector<CComVariant>& objects)
+STDMETHODIMP CDebuggerDispatch::releaseObjectGroup(_In_ BSTR objectGroup, _Out_ VARIANT_BOOL* pSuccess)
 {
+    // Frees the property handles that were created for an object group, so that their PDM objects can be released
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+    ATLENSURE_RETURN_HR(pSuccess != nullptr, E_INVALIDARG);
 
-    HRESULT hr = S_OK;
+    HRESULT hr = m_spThreadController->ReleaseObjectGroup(CString(objectGroup));
+    (*pSuccess) = (hr == S_OK ? VARIANT_TRUE : VARIANT_FALSE);
 
-    if (objects.empty())
+    return S_OK;
+}
+
+STDMETHODIMP CDebuggerDispatch::getPropertyHandleInfo(_Out_ VARIANT* pvHandleInfo)
+{
+    try
+    {
+        // Report how much the property handle table is holding on to
+        ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+        ATLENSURE_RETURN_HR(pvHandleInfo != nullptr, E_INVALIDARG);
+
+        PropertyHandleTableInfo info;
+        HRESULT hr = m_spThreadController->GetPropertyHandleInfo(info);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        map<CString, CComVariant> infoMap;
+        infoMap[L"liveHandles"] = info.liveHandles;
+        infoMap[L"slotCapacity"] = info.slotCapacity;
+        infoMap[L"freeSlots"] = info.freeSlots;
+        infoMap[L"objectGroups"] = info.objectGroups;
+        infoMap[L"bytesReserved"] = static_cast<double>(info.bytesReserved);
+
+        CComVariant infoObject;
+        hr = m_scriptObjectCache.CreateObject(infoMap, infoObject);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        // Set it to the out param
+        ::VariantInit(pvHandleInfo);
+        hr = infoObject.Detach(pvHandleInfo);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+    }
+    catch (const bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+    catch (const CAtlException& err)
     {
-        return hr;
+        return err.m_hr;
     }
 
-    CComVariant object;
+    return S_OK;
+}
 
-    hr = ScriptHelpers::CreateJScriptArray(m_spScriptDispatch, objects, object);
-    objects.clear();
-    BPT_FAIL_IF_NOT_S_OK(hr);
+STDMETHODIMP CDebuggerDispatch::getPauseSnapshot(_In_ LONG maxFrames, _Out_ VARIANT* pvSnapshot)
+{
+    try
+    {
+        // Build the whole Debugger.paused payload for the current break in a single call
+        ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+        ATLENSURE_RETURN_HR(pvSnapshot != nullptr, E_INVALIDARG);
 
-    const UINT argLength = 1;
-    CComVariant params[argLength] = { object };
+        vector<shared_ptr<CallFrameInfo>> spFrames;
+        HRESULT hr = m_spThreadController->GetCallFrames(maxFrames > 0 ? (ULONG)maxFrames : 0, spFrames);
+        if (hr != S_OK)
+        {
+            // Return an empty callstack to the JavaScript
+            spFrames.clear();
+        }
 
-    m_eventHelper.Fire_Event(eventName, params, argLength);
+        // The front end has to know about every document on the callstack before it sees the frames
+        for (const auto& frame : spFrames)
+        {
+            this->RevealDocument(frame->sourceLocation.docId);
+        }
 
-    return hr;
+        this->FlushAddedDocuments();
+
+        // The payload is serialized as json so that creating all of its script objects costs one call into the engine
+        CString json(L"{\"callFrames\":[");
+        for (size_t i = 0; i < spFrames.size(); i++)
+        {
+            const auto& frame = spFrames[i];
+
+            ULONG lineNumber = 0;
+            ULONG columnNumber = 0;
+            hr = m_spSourceController->GetLineColumnFromOffset(frame->sourceLocation.docId, frame->sourceLocation.charPosition, lineNumber, columnNumber);
+            if (hr != S_OK)
+            {
+                lineNumber = 0;
+                columnNumber = 0;
+            }
+
+            json.AppendFormat(L"%s{\"callFrameId\":\"%u\",\"functionName\":", (i > 0 ? L"," : L""), frame->id);
+            ScriptHelpers::AppendJSONString(json, frame->functionName);
+            json.AppendFormat(L",\"location\":{\"scriptId\":\"%u\",\"lineNumber\":%u,\"columnNumber\":%u},\"scopeChain\":[", frame->sourceLocation.docId, lineNumber, columnNumber);
+
+            // Frames without locals have an empty scope chain
+            ScopeChainInfo scopeChain;
+            hr = m_spThreadController->GetScopeChain(frame->id, scopeChain);
+            if (hr == S_OK && scopeChain.localsId != 0)
+            {
+                LPCWSTR scopeFormat = L"%s{\"object\":{\"className\":\"Object\",\"description\":\"Object\",\"objectId\":\"%I64u\",\"type\":\"object\"},\"type\":\"%s\"}";
+                json.AppendFormat(scopeFormat, L"", scopeChain.localsId, L"local");
+                for (const auto& closureId : scopeChain.closureIds)
+                {
+                    json.AppendFormat(scopeFormat, L",", closureId, L"closure");
+                }
+            }
+
+            json.Append(L"],\"this\":null}");
+        }
+
+        json.Append(L"],\"reason\":\"other\",\"data\":null}");
+
+        CComVariant snapshotObject;
+        hr = ScriptHelpers::JSONParse(m_spScriptDispatch, json, snapshotObject);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        // Set it to the out param
+        ::VariantInit(pvSnapshot);
+        hr = snapshotObject.Detach(pvSnapshot);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+    }
+    catch (const bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+    catch (const CAtlException& err)
+    {
+        return err.m_hr;
+    }
+
+    return S_OK;
 }
 
-HRESULT CDebuggerDispatch::GetPropertyObjectFromPropertyInfo(_In_ const shared_ptr<PropertyInfo>& spPropertyInfo, _Out_ CComVariant& propertyInfoObject)
+STDMETHODIMP CDebuggerDispatch::evalBatch(_In_ ULONG frameId, _In_ VARIANT* pvExpressions, _In_ BSTR objectGroup, _In_ ULONG timeout, _Out_ ULONG* pBatchId)
+{
+    try
+    {
+        // Starts evaluating a set of expressions in the given frame without waiting for them,
+        // the results come back together in an onEvalBatchComplete event with the returned batch id.
+        ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+        ATLENSURE_RETURN_HR(pvExpressions != nullptr && pvExpressions->vt == VT_DISPATCH && pvExpressions->pdispVal != nullptr, E_INVALIDARG);
+        ATLENSURE_RETURN_HR(pBatchId != nullptr, E_INVALIDARG);
+
+        *pBatchId = 0;
+
+        vector<CComVariant> variantExpressions;
+        HRESULT hr = ScriptHelpers::GetVectorFromScriptArray(*pvExpressions, variantExpressions);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        vector<CComBSTR> expressions;
+        for (const auto& item : variantExpressions)
+        {
+            ATLENSURE_RETURN_HR(item.vt == VT_BSTR, E_INVALIDARG);
+            expressions.push_back(CComBSTR(item.bstrVal));
+        }
+
+        // A batch id of 0 tells the JavaScript that nothing was started
+        ULONG batchId = 0;
+        hr = m_spThreadController->BeginEvalBatch(frameId, expressions, EVAL_RADIX, CString(objectGroup), timeout, batchId);
+        if (hr == S_OK)
+        {
+            *pBatchId = batchId;
+
+            // Make sure the timeout gets checked even if none of the expressions ever complete
+            this->ScheduleTimer();
+        }
+    }
+    catch (const bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+    catch (const CAtlException& err)
+    {
+        return err.m_hr;
+    }
+
+    return S_OK;
+}
+
+STDMETHODIMP CDebuggerDispatch::cancelEvalBatch(_In_ ULONG batchId, _Out_ VARIANT_BOOL* pSuccess)
 {
+    // Aborts whatever is still running in the batch, the batch is then completed with those results marked as cancelled
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+    ATLENSURE_RETURN_HR(pSuccess != nullptr, E_INVALIDARG);
 
-    // Copy the strings into the map object
-    map<CString, CComVariant> mapNameValuePairs;
-    mapNameValuePairs[L"propertyId"] = spPropertyInfo->propertyId;
-    mapNameValuePairs[L"name"] = spPropertyInfo->name;
-    mapNameValuePairs[L"type"] =spPropertyInfo->type;
-    mapNameValuePairs[L"value"] = spPropertyInfo->value;
-    mapNameValuePairs[L"fullName"] = spPropertyInfo->fullName;
-    mapNameValuePairs[L"expandable"] = spPropertyInfo->isExpandable;
-    mapNameValuePairs[L"readOnly"] = spPropertyInfo->isReadOnly;
-    mapNameValuePairs[L"fake"] = spPropertyInfo->isFake;
-    mapNameValuePairs[L"invalid"] = spPropertyInfo->isInvalid;
-    mapNameValuePairs[L"returnValue"] = spPropertyInfo->isReturnValue;
+    HRESULT hr = m_spThreadController->CancelEvalBatch(batchId);
+    (*pSuccess) = (hr == S_OK ? VARIANT_TRUE : VARIANT_FALSE);
+
+    return S_OK;
+}
+
+STDMETHODIMP CDebuggerDispatch::setExceptionFilter(_In_ VARIANT* pvIgnoredUrlPatterns, _In_ ULONG sampleRate, _In_ ULONG maxBreaksPerSite, _In_ ULONG rateLimitInterval, _Out_ VARIANT_BOOL* pSuccess)
+{
+    try
+    {
+        // Sets the rules used to skip first chance exceptions natively, a null pattern list removes the url rules
+        ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+        ATLENSURE_RETURN_HR(pvIgnoredUrlPatterns != nullptr && (pvIgnoredUrlPatterns->vt == VT_NULL || (pvIgnoredUrlPatterns->vt == VT_DISPATCH && pvIgnoredUrlPatterns->pdispVal != nullptr)), E_INVALIDARG);
+        ATLENSURE_RETURN_HR(pSuccess != nullptr, E_INVALIDARG);
+
+        vector<CString> patterns;
+        if (pvIgnoredUrlPatterns->vt == VT_DISPATCH)
+        {
+            vector<CComVariant> variantPatterns;
+            HRESULT hr = ScriptHelpers::GetVectorFromScriptArray(*pvIgnoredUrlPatterns, variantPatterns);
+            BPT_FAIL_IF_NOT_S_OK(hr);
+
+            for (const auto& item : variantPatterns)
+            {
+                ATLENSURE_RETURN_HR(item.vt == VT_BSTR, E_INVALIDARG);
+                patterns.push_back(CString(item.bstrVal));
+            }
+        }
+
+        HRESULT hr = m_spThreadController->SetExceptionFilter(patterns, sampleRate, maxBreaksPerSite, rateLimitInterval);
+        (*pSuccess) = (hr == S_OK ? VARIANT_TRUE : VARIANT_FALSE);
+    }
+    catch (const bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+    catch (const CAtlException& err)
+    {
+        return err.m_hr;
+    }
+
+    return S_OK;
+}
+
+STDMETHODIMP CDebuggerDispatch::getExceptionFilterInfo(_Out_ VARIANT* pvFilterInfo)
+{
+    try
+    {
+        // Report how many first chance exceptions the filter has skipped, and why
+        ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+        ATLENSURE_RETURN_HR(pvFilterInfo != nullptr, E_INVALIDARG);
+
+        ExceptionFilterInfo info;
+        HRESULT hr = m_spThreadController->GetExceptionFilterInfo(info);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        map<CString, CComVariant> infoMap;
+        infoMap[L"exceptionsSeen"] = info.exceptionsSeen;
+        infoMap[L"filteredByUrl"] = info.filteredByUrl;
+        infoMap[L"filteredBySampling"] = info.filteredBySampling;
+        infoMap[L"filteredByRateLimit"] = info.filteredByRateLimit;
+        infoMap[L"throwSites"] = info.throwSites;
+
+        CComVariant infoObject;
+        hr = m_scriptObjectCache.CreateObject(infoMap, infoObject);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        ::VariantInit(pvFilterInfo);
+        hr = infoObject.Detach(pvFilterInfo);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+    }
+    catch (const bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+    catch (const CAtlException& err)
+    {
+        return err.m_hr;
+    }
+
+    return S_OK;
+}
+
+STDMETHODIMP CDebuggerDispatch::setBlackboxPattern(_In_ BSTR pattern, _Out_ VARIANT_BOOL* pSuccess)
+{
+    // Sets the regex for the urls of scripts that stepping should not stop in, an empty pattern removes it
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+    ATLENSURE_RETURN_HR(pSuccess != nullptr, E_INVALIDARG);
+
+    HRESULT hr = m_spThreadController->SetBlackboxPattern(CString(pattern));
+    (*pSuccess) = (hr == S_OK ? VARIANT_TRUE : VARIANT_FALSE);
+
+    return S_OK;
+}
+
+STDMETHODIMP CDebuggerDispatch::addPendingBreakpointByUrlRegex(_In_ BSTR urlRegex, _In_ ULONG start, _In_ BSTR condition, _In_ BOOL isEnabled, _In_ BOOL isTracepoint, _Out_ ULONG* pBreakpointId)
+{
+    HRESULT hr;
+
+    try
+    {
+        // Adds a pending breakpoint that is bound to every document whose url matches the regex, rather than to a single url.
+        // Returns id of the new breakpoint added, or E_INVALIDARG if the regex does not compile.
+        ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+        ATLENSURE_RETURN_HR(pBreakpointId != nullptr, E_INVALIDARG);
+        ATLENSURE_RETURN_HR(::SysStringLen(urlRegex) > 0, E_INVALIDARG);
+
+        CComBSTR newUrlRegex(urlRegex);
+        CComBSTR newCondition(condition);
+        ULONG bpId = 0;
+        hr = m_spSourceController->AddPendingBreakpoint(newUrlRegex, /*isUrlRegex=*/ true, start, newCondition, !!isEnabled, !!isTracepoint, bpId);
+
+        (*pBreakpointId) = (hr == S_OK) ? bpId : 0;
+    }
+    catch (const bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+    catch (const CAtlException& err)
+    {
+        return err.m_hr;
+    }
+
+    return hr;
+}
+
+STDMETHODIMP CDebuggerDispatch::setDynamicDocumentLimit(_In_ ULONG maxDynamicDocuments, _Out_ VARIANT_BOOL* pSuccess)
+{
+    // Sets how many dynamic code documents are reported before the rest are only counted, 0 reports all of them
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+    ATLENSURE_RETURN_HR(pSuccess != nullptr, E_INVALIDARG);
+
+    m_maxDynamicDocuments = maxDynamicDocuments;
+
+    // Held back documents that fit under the new limit are sent now, in the order they were added.
+    // Lowering the limit only holds back later documents, since the front end already knows about the reported ones.
+    if (!m_suppressedDocuments.empty())
+    {
+        vector<ULONG> revealed;
+        m_suppressedDocuments.ForEach([this, &revealed](ULONG docId, const shared_ptr<DocumentInfo>& /* spDocInfo */)
+        {
+            if (m_maxDynamicDocuments == 0 || m_reportedDynamicDocuments.size() + revealed.size() < m_maxDynamicDocuments)
+            {
+                revealed.push_back(docId);
+            }
+        });
+
+        for (const auto& docId : revealed)
+        {
+            this->RevealDocument(docId);
+        }
+
+        if (!revealed.empty())
+        {
+            this->FlushAddedDocuments();
+        }
+    }
+
+    (*pSuccess) = VARIANT_TRUE;
+
+    return S_OK;
+}
+
+STDMETHODIMP CDebuggerDispatch::setDynamicDocumentCacheBudget(_In_ ULONG budgetBytes, _Out_ VARIANT_BOOL* pSuccess)
+{
+    // Sets how many bytes of dynamic code text are kept cached before the least recently used are dropped, 0 keeps all of it
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+    ATLENSURE_RETURN_HR(pSuccess != nullptr, E_INVALIDARG);
+
+    HRESULT hr = m_spSourceController->SetDynamicTextBudget(budgetBytes);
+    (*pSuccess) = (hr == S_OK ? VARIANT_TRUE : VARIANT_FALSE);
+
+    return S_OK;
+}
+
+STDMETHODIMP CDebuggerDispatch::getDynamicDocumentInfo(_Out_ VARIANT* pvDocumentInfo)
+{
+    try
+    {
+        // Report how much dynamic code text is cached, and how much has been shared or evicted
+        ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+        ATLENSURE_RETURN_HR(pvDocumentInfo != nullptr, E_INVALIDARG);
+
+        DynamicDocumentInfo info;
+        HRESULT hr = m_spSourceController->GetDynamicDocumentInfo(info);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        map<CString, CComVariant> infoMap;
+        infoMap[L"dynamicDocuments"] = info.dynamicDocuments;
+        infoMap[L"cachedDocuments"] = info.cachedDocuments;
+        infoMap[L"sharedDocuments"] = info.sharedDocuments;
+        infoMap[L"evictedDocuments"] = info.evictedDocuments;
+        infoMap[L"cachedBytes"] = static_cast<double>(info.cachedBytes);
+        infoMap[L"sharedBytes"] = static_cast<double>(info.sharedBytes);
+        infoMap[L"budgetBytes"] = static_cast<double>(info.budgetBytes);
+
+        CComVariant infoObject;
+        hr = m_scriptObjectCache.CreateObject(infoMap, infoObject);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        ::VariantInit(pvDocumentInfo);
+        hr = infoObject.Detach(pvDocumentInfo);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+    }
+    catch (const bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+    catch (const CAtlException& err)
+    {
+        return err.m_hr;
+    }
+
+    return S_OK;
+}
+
+STDMETHODIMP CDebuggerDispatch::runSelfTests(_Out_ VARIANT* pvFailuresArray)
+{
+    try
+    {
+        // Runs the checks of the debugger's pure logic, and returns the description of each check that failed
+        ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+        ATLENSURE_RETURN_HR(pvFailuresArray != nullptr, E_INVALIDARG);
+
+        vector<CString> failures;
+        SelfTests::RunAll(failures);
+
+        vector<CComVariant> failureValues;
+        failureValues.reserve(failures.size());
+        for (const auto& failure : failures)
+        {
+            failureValues.push_back(CComVariant(failure));
+        }
+
+        // Create the VARIANT that represents the array in JavaScript
+        CComVariant failuresArray;
+        HRESULT hr = m_scriptObjectCache.CreateArray(failureValues, failuresArray);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        // Set it to the out param
+        ::VariantInit(pvFailuresArray);
+        hr = failuresArray.Detach(pvFailuresArray);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+    }
+    catch (const bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+    catch (const CAtlException& err)
+    {
+        return err.m_hr;
+    }
+
+    return S_OK;
+}
+
+// Helper functions
+PropertyHandle CDebuggerDispatch::GetPropertyHandle(_In_ double propertyId)
+{
+    // Anything that is not a valid handle maps to 0, which the handle table never hands out
+    if (propertyId < 1 || propertyId >= 9007199254740992.0 /* 2^53 */)
+    {
+        return 0;
+    }
+
+    return static_cast<PropertyHandle>(propertyId);
+}
+
+HRESULT CDebuggerDispatch::OnEventListenerUpdated(_In_ bool const isListening)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+    ATLENSURE_RETURN_HR(m_spSourceController.p != nullptr, E_NOT_VALID_STATE);
+
+    HRESULT hr = S_OK;
+
+    if (isListening)
+    {
+        m_spSourceController->RebindAllEventBreakpoints(/*isEventListenerRegistered=*/ true);
+    }
+    else
+    {
+        // Now that the listeners have been removed in the BHO, unbind all the event breakpoints
+        m_spSourceController->UnbindAllEventBreakpoints(/*removeListeners=*/ false);
+    }
+
+    return hr;
+}
+
+HRESULT CDebuggerDispatch::FireDocumentEvent(_In_ const CString& eventName, _In_ const CString& jsonArray)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    // Create the whole array of records from the json in one call
+    CComVariant object;
+    HRESULT hr = ScriptHelpers::JSONParse(m_spScriptDispatch, jsonArray, object);
+    ATLASSERT(hr == S_OK); // Assert in chk bits so we can tell if the payload is malformed
+    BPT_FAIL_IF_NOT_S_OK(hr);
+
+    const UINT argLength = 1;
+    CComVariant params[argLength] = { object };
+
+    m_eventHelper.Fire_Event(eventName, params, argLength);
+
+    return hr;
+}
+
+HRESULT CDebuggerDispatch::LogTracepointMessages(_In_ const vector<TracepointMessage>& messages)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    m_tracepointLog.insert(m_tracepointLog.end(), messages.begin(), messages.end());
+
+    if (m_tracepointLog.size() >= s_tracepointFlushThreshold)
+    {
+        return this->FlushTracepointMessages();
+    }
+
+    // Batch up the messages from a hot loop rather than sending one notification per hit
+    HRESULT hr = this->ScheduleTimer();
+    if (hr != S_OK)
+    {
+        // Without a timer there is nothing to flush the log later, so send it now
+        return this->FlushTracepointMessages();
+    }
+
+    return S_OK;
+}
+
+HRESULT CDebuggerDispatch::FlushTracepointMessages()
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    if (m_tracepointLog.empty())
+    {
+        return S_OK;
+    }
+
+    // The messages carry their document, so send any that were held back ahead of them
+    for (const auto& message : m_tracepointLog)
+    {
+        this->RevealDocument(message.docId);
+    }
+
+    this->FlushAddedDocuments();
+
+    CString json(L"[");
+    for (const auto& message : m_tracepointLog)
+    {
+        if (json.GetLength() > 1)
+        {
+            json.AppendChar(L',');
+        }
+
+        json.AppendFormat(L"{\"breakpointId\":%u,\"docId\":%u,\"lineNumber\":%u,\"columnNumber\":%u,\"timestamp\":%.3f,\"isError\":%s,\"url\":", message.breakpointId, message.docId, message.lineNumber, message.columnNumber, message.timestamp, message.isError ? L"true" : L"false");
+        ScriptHelpers::AppendJSONString(json, message.url);
+        json.Append(L",\"text\":");
+        ScriptHelpers::AppendJSONString(json, message.text);
+        json.AppendChar(L'}');
+    }
+    json.AppendChar(L']');
+
+    // Clear the log first so that a failure to notify does not resend the same messages forever
+    m_tracepointLog.clear();
+
+    return this->FireDocumentEvent(L"onTracepointMessages", json);
+}
+
+HRESULT CDebuggerDispatch::QueueAddedDocuments(_In_ const vector<shared_ptr<DocumentInfo>>& added)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    for (const auto& node : added)
+    {
+        if (node->isDynamicCode)
+        {
+            if (m_maxDynamicDocuments != 0 && m_reportedDynamicDocuments.size() >= m_maxDynamicDocuments)
+            {
+                m_suppressedDocuments[node->docId] = node;
+                m_suppressedSinceFlush++;
+                continue;
+            }
+
+            m_reportedDynamicDocuments.insert(node->docId);
+        }
+
+        m_pendingDocuments.push_back(node);
+        m_pendingDocumentIds.insert(node->docId);
+    }
+
+    if (m_pendingDocuments.size() >= s_documentBatchThreshold)
+    {
+        return this->FlushAddedDocuments();
+    }
+
+    // Pages that inject scripts in a loop would otherwise send one event per update
+    HRESULT hr = this->ScheduleTimer();
+    if (hr != S_OK)
+    {
+        // Without a timer there is nothing to send the documents later, so send them now
+        return this->FlushAddedDocuments();
+    }
+
+    return S_OK;
+}
+
+HRESULT CDebuggerDispatch::FlushAddedDocuments()
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    HRESULT hr = S_OK;
+
+    if (!m_pendingDocuments.empty())
+    {
+        CString json(L"[");
+        for (const auto& node : m_pendingDocuments)
+        {
+            if (json.GetLength() > 1)
+            {
+                json.AppendChar(L',');
+            }
+
+            json.AppendFormat(L"{\"docId\":%u,\"parentDocId\":%u,\"length\":%u,\"isDynamicCode\":%s,\"url\":", node->docId, node->parentId, node->textLength, node->isDynamicCode ? L"true" : L"false");
+            ScriptHelpers::AppendJSONString(json, node->url);
+            json.Append(L",\"mimeType\":");
+            ScriptHelpers::AppendJSONString(json, node->mimeType);
+            json.Append(L",\"sourceMapUrlFromHeader\":");
+            ScriptHelpers::AppendJSONString(json, node->sourceMapUrlFromHeader);
+            json.Append(L",\"longDocumentId\":");
+            ScriptHelpers::AppendJSONString(json, node->longDocumentId);
+            json.AppendChar(L'}');
+        }
+        json.AppendChar(L']');
+
+        // Clear the batch first so that a failure to notify does not resend the same documents forever
+        m_pendingDocuments.clear();
+        m_pendingDocumentIds.clear();
+
+        hr = this->FireDocumentEvent(L"onAddDocuments", json);
+    }
+
+    // Summarize the dynamic code documents that were held back instead of listing them
+    if (m_suppressedSinceFlush > 0)
+    {
+        CString json;
+        json.Format(L"{\"count\":%u,\"totalSuppressed\":%u,\"maxDynamicDocuments\":%u}", m_suppressedSinceFlush, static_cast<ULONG>(m_suppressedDocuments.size()), m_maxDynamicDocuments);
+        m_suppressedSinceFlush = 0;
+
+        HRESULT hrSuppressed = this->FireDocumentEvent(L"onDocumentsSuppressed", json);
+        if (hr == S_OK)
+        {
+            hr = hrSuppressed;
+        }
+    }
+
+    return hr;
+}
+
+void CDebuggerDispatch::RevealDocument(_In_ ULONG docId)
+{
+    // A held back document is queued after all once something sent to the front end refers to it
+    auto pSuppressed = m_suppressedDocuments.find(docId);
+    if (pSuppressed != nullptr)
+    {
+        m_pendingDocuments.push_back(*pSuppressed);
+        m_pendingDocumentIds.insert(docId);
+        m_reportedDynamicDocuments.insert(docId);
+        m_suppressedDocuments.erase(docId);
+    }
+}
+
+void CDebuggerDispatch::ClearPendingDocuments()
+{
+    // The source controller has dropped its documents, so there is nothing left to send or filter
+    m_pendingDocuments.clear();
+    m_pendingDocumentIds.clear();
+    m_reportedDynamicDocuments.clear();
+    m_suppressedDocuments.clear();
+    m_suppressedSinceFlush = 0;
+}
+
+HRESULT CDebuggerDispatch::FireEvalBatchResults()
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+    ATLENSURE_RETURN_HR(m_spThreadController.p != nullptr, E_NOT_VALID_STATE);
+
+    vector<shared_ptr<EvalBatchInfo>> batches;
+    bool hasPendingBatches = false;
+    HRESULT hr = m_spThreadController->GetFinishedEvalBatches(batches, hasPendingBatches);
+    BPT_FAIL_IF_NOT_S_OK(hr);
+
+    // Keep checking the running batches so that their timeouts are noticed even if the PDM never calls back
+    if (hasPendingBatches)
+    {
+        this->ScheduleTimer();
+    }
+
+    for (const auto& spBatch : batches)
+    {
+        vector<CComVariant> results;
+        for (const auto& result : spBatch->results)
+        {
+            CComVariant propertyInfoObject;
+            if (result.spPropertyInfo.get() != nullptr)
+            {
+                hr = this->GetPropertyObjectFromPropertyInfo(result.spPropertyInfo, propertyInfoObject);
+                BPT_FAIL_IF_NOT_S_OK(hr);
+            }
+            else
+            {
+                propertyInfoObject.ChangeType(VT_NULL, nullptr);
+            }
+
+            map<CString, CComVariant> resultMap;
+            resultMap[L"status"] = static_cast<ULONG>(result.status);
+            resultMap[L"propertyInfo"] = propertyInfoObject;
+
+            CComVariant resultObject;
+            hr = m_scriptObjectCache.CreateObject(resultMap, resultObject);
+            BPT_FAIL_IF_NOT_S_OK(hr);
+
+            results.push_back(resultObject);
+        }
+
+        CComVariant resultsArray;
+        hr = m_scriptObjectCache.CreateArray(results, resultsArray);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        map<CString, CComVariant> batchMap;
+        batchMap[L"batchId"] = spBatch->batchId;
+        batchMap[L"results"] = resultsArray;
+
+        CComVariant batchObject;
+        hr = m_scriptObjectCache.CreateObject(batchMap, batchObject);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        const UINT argLength = 1;
+        CComVariant params[argLength] = { batchObject };
+
+        m_eventHelper.Fire_Event(L"onEvalBatchComplete", params, argLength);
+    }
+
+    return S_OK;
+}
+
+HRESULT CDebuggerDispatch::ScheduleTimer()
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    if (!m_isTimerScheduled)
+    {
+        // The timer id is this dispatch, so that the static callback can get back to it
+        UINT_PTR timerId = ::SetTimer(m_hwndDebugPipeHandler, reinterpret_cast<UINT_PTR>(this), s_timerInterval, &CDebuggerDispatch::OnTimer);
+        ATLENSURE_RETURN_HR(timerId != 0, ::AtlHresultFromLastError());
+
+        m_isTimerScheduled = true;
+    }
+
+    return S_OK;
+}
+
+void CDebuggerDispatch::CancelTimer()
+{
+    if (m_isTimerScheduled)
+    {
+        ::KillTimer(m_hwndDebugPipeHandler, reinterpret_cast<UINT_PTR>(this));
+        m_isTimerScheduled = false;
+    }
+}
+
+VOID CALLBACK CDebuggerDispatch::OnTimer(_In_ HWND hwnd, _In_ UINT /* message */, _In_ UINT_PTR idEvent, _In_ DWORD /* time */)
+{
+    // The timer only fires once, anything that still needs it schedules it again
+    ::KillTimer(hwnd, idEvent);
+
+    CDebuggerDispatch* pDispatch = reinterpret_cast<CDebuggerDispatch*>(idEvent);
+    pDispatch->m_isTimerScheduled = false;
+
+    // A timer message that was already queued can still arrive after shutdown released the controllers
+    if (pDispatch->m_spThreadController.p == nullptr || pDispatch->m_spSourceController.p == nullptr)
+    {
+        return;
+    }
+
+    pDispatch->FlushAddedDocuments();
+    pDispatch->FlushTracepointMessages();
+    pDispatch->FireEvalBatchResults();
+}
+
+HRESULT CDebuggerDispatch::GetPropertyObjectFromPropertyInfo(_In_ const shared_ptr<PropertyInfo>& spPropertyInfo, _Out_ CComVariant& propertyInfoObject)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    // Copy the strings into the record values, in the same order as the shape
+    CComVariant values[_countof(s_propertyInfoShape)];
+    values[0] = static_cast<double>(spPropertyInfo->propertyId);
+    values[1] = spPropertyInfo->name;
+    values[2] = spPropertyInfo->type;
+    values[3] = spPropertyInfo->value;
+    values[4] = spPropertyInfo->fullName;
+    values[5] = spPropertyInfo->isExpandable;
+    values[6] = spPropertyInfo->isReadOnly;
+    values[7] = spPropertyInfo->isFake;
+    values[8] = spPropertyInfo->isInvalid;
+    values[9] = spPropertyInfo->isReturnValue;
 
     // Create the JavaScript object
-    HRESULT hr = ScriptHelpers::CreateJScriptObject(m_spScriptDispatch, mapNameValuePairs, propertyInfoObject);
+    HRESULT hr = m_scriptObjectCache.CreateRecord(s_propertyInfoShape, _countof(s_propertyInfoShape), values, propertyInfoObject);
     BPT_FAIL_IF_NOT_S_OK(hr);
 
     return S_OK;
@@ -1404,7 +2352,7 @@ HRESULT CDebuggerDispatch::CreateScriptBreakpointInfo(_In_ const BreakpointInfo&
         sourceLocationMap[L"start"] = sourceLocation->charPosition;
         sourceLocationMap[L"length"] = sourceLocation->contextCount;
         CComVariant sourceLocationObject;
-        hr = ScriptHelpers::CreateJScriptObject(m_spScriptDispatch, sourceLocationMap, sourceLocationObject);
+        hr = m_scriptObjectCache.CreateObject(sourceLocationMap, sourceLocationObject);
         BPT_FAIL_IF_NOT_S_OK(hr);
 
         bpMap[L"location"] = sourceLocationObject;
@@ -1422,7 +2370,7 @@ HRESULT CDebuggerDispatch::CreateScriptBreakpointInfo(_In_ const BreakpointInfo&
             variantEventTypes.push_back(CComVariant(newItem));
         }
 
-        hr = ScriptHelpers::CreateJScriptArray(m_spScriptDispatch, variantEventTypes, scriptEventTypes);
+        hr = m_scriptObjectCache.CreateArray(variantEventTypes, scriptEventTypes);
         BPT_FAIL_IF_NOT_S_OK(hr);
         bpMap[L"eventTypes"] = scriptEventTypes;
     }
@@ -1432,7 +2380,7 @@ HRESULT CDebuggerDispatch::CreateScriptBreakpointInfo(_In_ const BreakpointInfo&
     bpMap[L"isEnabled"] = breakpoint.isEnabled;
     bpMap[L"isBound"] = breakpoint.isBound;
 
-    hr = ScriptHelpers::CreateJScriptObject(m_spScriptDispatch, bpMap, breakpointObject);
+    hr = m_scriptObjectCache.CreateObject(bpMap, breakpointObject);
     BPT_FAIL_IF_NOT_S_OK(hr);
 
     return hr;
@@ -1449,7 +2397,7 @@ HRESULT CDebuggerDispatch::CreateSetMutationBreakpointResult(_In_ bool success,
     resultMap[L"objectName"] = objectName;
 
     // Create the JavaScript object
-    HRESULT hr = ScriptHelpers::CreateJScriptObject(m_spScriptDispatch, resultMap, resultObject);
+    HRESULT hr = m_scriptObjectCache.CreateObject(resultMap, resultObject);
     BPT_FAIL_IF_NOT_S_OK(hr);
 
     return S_OK;
@@ -10,6 +10,7 @@
 #include "SourceController.h"
 #include "ThreadController.h"
 #include "ComTypeInfoHolderLib.h"
+#include "ScriptHelpers.h"
 
 using namespace ATL;
 using namespace std;
@@ -33,6 +34,7 @@ public:
     END_COM_MAP()
 
     CDebuggerDispatch();
+    ~CDebuggerDispatch();
 
     // IF12DebuggerExtension
     STDMETHOD(Initialize)(_In_ HWND hwndDebugPipeHandler, _In_ IDispatchEx* pScriptDispatchEx, _In_ HANDLE hBreakNotificationComplete, _In_ BOOL isDocked, _In_ IUnknown* pDebugApplication);
@@ -70,15 +72,37 @@ public:
     STDMETHOD(getThreads)(_Out_ VARIANT* pvThreadDescriptions);
     STDMETHOD(getFrames)(_In_ LONG framesNeeded, _Out_ VARIANT* pvFramesArray);
     STDMETHOD(getSourceText)(_In_ ULONG docId, _Out_ VARIANT* pvSourceTextResult);
-    STDMETHOD(getLocals)(_In_ ULONG frameId, _Out_ ULONG* pPropertyId);
-    STDMETHOD(eval)(_In_ ULONG frameId, _In_ BSTR evalString, _Out_ VARIANT* pvPropertyInfo);
-    STDMETHOD(getChildProperties)(_In_ ULONG propertyId, _In_ ULONG start, _In_ ULONG length, _Out_ VARIANT* pvPropertyInfosObject);
-    STDMETHOD(setPropertyValueAsString)(_In_ ULONG propertyId, _In_ BSTR* pValue, _Out_ VARIANT_BOOL* pSuccess);
+    STDMETHOD(getLocals)(_In_ ULONG frameId, _Out_ double* pPropertyId);
+    STDMETHOD(eval)(_In_ ULONG frameId, _In_ BSTR evalString, _In_ BSTR objectGroup, _Out_ VARIANT* pvPropertyInfo);
+    STDMETHOD(getChildProperties)(_In_ double propertyId, _In_ ULONG start, _In_ ULONG length, _Out_ VARIANT* pvPropertyInfosObject);
+    STDMETHOD(setPropertyValueAsString)(_In_ double propertyId, _In_ BSTR* pValue, _Out_ VARIANT_BOOL* pSuccess);
 
     STDMETHOD(canSetNextStatement)(_In_ ULONG docId, _In_ ULONG position, _Out_ VARIANT_BOOL* pSuccess);
     STDMETHOD(setNextStatement)(_In_ ULONG docId, _In_ ULONG position, _Out_ VARIANT_BOOL* pSuccess);
     STDMETHOD(setBreakOnFirstChanceExceptions)(_In_ BOOL fValue, _Out_ VARIANT_BOOL* pSuccess);
 
+    STDMETHOD(getLineColumnFromOffset)(_In_ ULONG docId, _In_ ULONG offset, _Out_ VARIANT* pvLineColumn);
+    STDMETHOD(getOffsetFromLineColumn)(_In_ ULONG docId, _In_ ULONG lineNumber, _In_ ULONG columnNumber, _Out_ LONG* pOffset);
+    STDMETHOD(searchInContent)(_In_ ULONG docId, _In_ BSTR query, _In_ BOOL caseSensitive, _In_ BOOL isRegex, _Out_ VARIANT* pvMatchesArray);
+
+    STDMETHOD(releaseObjectGroup)(_In_ BSTR objectGroup, _Out_ VARIANT_BOOL* pSuccess);
+    STDMETHOD(getPropertyHandleInfo)(_Out_ VARIANT* pvHandleInfo);
+
+    STDMETHOD(getPauseSnapshot)(_In_ LONG maxFrames, _Out_ VARIANT* pvSnapshot);
+
+    STDMETHOD(evalBatch)(_In_ ULONG frameId, _In_ VARIANT* pvExpressions, _In_ BSTR objectGroup, _In_ ULONG timeout, _Out_ ULONG* pBatchId);
+    STDMETHOD(cancelEvalBatch)(_In_ ULONG batchId, _Out_ VARIANT_BOOL* pSuccess);
+
+    STDMETHOD(setExceptionFilter)(_In_ VARIANT* pvIgnoredUrlPatterns, _In_ ULONG sampleRate, _In_ ULONG maxBreaksPerSite, _In_ ULONG rateLimitInterval, _Out_ VARIANT_BOOL* pSuccess);
+    STDMETHOD(getExceptionFilterInfo)(_Out_ VARIANT* pvFilterInfo);
+    STDMETHOD(setBlackboxPattern)(_In_ BSTR pattern, _Out_ VARIANT_BOOL* pSuccess);
+    STDMETHOD(addPendingBreakpointByUrlRegex)(_In_ BSTR urlRegex, _In_ ULONG start, _In_ BSTR condition, _In_ BOOL isEnabled, _In_ BOOL isTracepoint, _Out_ ULONG* pBreakpointId);
+    STDMETHOD(setDynamicDocumentLimit)(_In_ ULONG maxDynamicDocuments, _Out_ VARIANT_BOOL* pSuccess);
+    STDMETHOD(setDynamicDocumentCacheBudget)(_In_ ULONG budgetBytes, _Out_ VARIANT_BOOL* pSuccess);
+    STDMETHOD(getDynamicDocumentInfo)(_Out_ VARIANT* pvDocumentInfo);
+
+    STDMETHOD(runSelfTests)(_Out_ VARIANT* pvFailuresArray);
+
 private:
     HRESULT SetRemoteDebugApplication(_In_ IUnknown* pDebugApplication);
     HRESULT DockedStateChanged(_In_ BOOL isDocked);
@@ -86,7 +110,18 @@ private:
     HRESULT FireQueuedEvents();
     HRESULT OnEventBreakpoint(_In_ const bool isStarting, _In_ const CString& eventType);
     HRESULT OnEventListenerUpdated(_In_ bool const isListening);
-    HRESULT FireDocumentEvent(_In_ const CString& eventName, _In_ vector<CComVariant>& objects);
+    HRESULT FireDocumentEvent(_In_ const CString& eventName, _In_ const CString& jsonArray);
+    HRESULT LogTracepointMessages(_In_ const vector<TracepointMessage>& messages);
+    HRESULT FlushTracepointMessages();
+    HRESULT QueueAddedDocuments(_In_ const vector<shared_ptr<DocumentInfo>>& added);
+    HRESULT FlushAddedDocuments();
+    void RevealDocument(_In_ ULONG docId);
+    void ClearPendingDocuments();
+    HRESULT FireEvalBatchResults();
+    HRESULT ScheduleTimer();
+    void CancelTimer();
+    static VOID CALLBACK OnTimer(_In_ HWND hwnd, _In_ UINT message, _In_ UINT_PTR idEvent, _In_ DWORD time);
+    static PropertyHandle GetPropertyHandle(_In_ double propertyId);
     HRESULT GetPropertyObjectFromPropertyInfo(_In_ const shared_ptr<PropertyInfo>& spPropertyInfo, _Out_ CComVariant& propertyInfoObject);
     HRESULT CreateScriptBreakpointInfo(_In_ const BreakpointInfo& breakpoint, _Out_ CComVariant& breakpointObject);
     HRESULT CreateSetMutationBreakpointResult(_In_ bool success, _In_ ULONG breakpointId, _In_ CComBSTR& objectName, _Out_ CComVariant& breakpointObject);
@@ -99,6 +134,25 @@ private:
 
     HWND m_hwndDebugPipeHandler;
     CComPtr<IDispatchEx> m_spScriptDispatch;
+    ScriptHelpers::ScriptObjectCache m_scriptObjectCache;
+
+    // Messages from tracepoint hits that have not been sent to the front end yet
+    vector<TracepointMessage> m_tracepointLog;
+
+    // New documents that have not been sent to the front end yet, in the order they were added
+    vector<shared_ptr<DocumentInfo>> m_pendingDocuments;
+    IdBitSet m_pendingDocumentIds;
+
+    // Dynamic code documents that have been reported, and those held back once there were more than the limit (0 for no limit).
+    // Suppressed documents are left out of the later document events, until a callstack, breakpoint or tracepoint refers to one
+    // or the limit is raised, and then it is sent like a newly added document.
+    ULONG m_maxDynamicDocuments;
+    IdBitSet m_reportedDynamicDocuments;
+    IdSlotMap<shared_ptr<DocumentInfo>> m_suppressedDocuments;
+    ULONG m_suppressedSinceFlush;
+
+    // Timer for the work that is done later on the dispatch thread, flushing tracepoint messages and documents, and timing out evals
+    bool m_isTimerScheduled;
 
     CComObjPtr<PDMEventMessageQueue> m_spMessageQueue;
     CComObjPtr<ThreadController> m_spThreadController;
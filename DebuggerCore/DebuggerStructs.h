@@ -30,7 +30,25 @@ enum class PDMThreadCallbackMethod
     Pause,
     Resume,
     CompleteEvals,
-    WaitForBreak
+    WaitForBreak,
+    PopulateCallStack
+};
+
+enum class SourceTextChange
+{
+    Insert,
+    Remove,
+    Replace
+};
+
+// EvalStatus values must match the EvalStatus enum in debugger.ts
+enum class EvalStatus
+{
+    Pending = 0,
+    Completed = 1,
+    Failed = 2,
+    TimedOut = 3,
+    Cancelled = 4
 };
 
 // Document
@@ -54,6 +72,48 @@ struct DocumentInfo
     }
 };
 
+// Source Text
+// Snapshots are immutable once cached, a change to the document produces a new snapshot with a new version
+struct SourceText
+{
+    ULONG docId;
+    ULONG version;
+    CString text;
+
+    SourceText() :
+        docId(0),
+        version(0)
+    {
+    }
+};
+
+// Line Index
+// The offset at which each line of a given source text version starts, line terminators are \r\n, \n or \r
+struct LineIndex
+{
+    ULONG version;
+    ULONG textLength;
+    vector<ULONG> lineStarts;
+
+    LineIndex() :
+        version(0),
+        textLength(0)
+    {
+    }
+};
+
+// Search Match
+struct SearchMatch
+{
+    ULONG lineNumber;
+    CComBSTR lineContent;
+
+    SearchMatch() :
+        lineNumber(0)
+    {
+    }
+};
+
 // Source Location
 struct SourceLocationInfo
 {
@@ -90,6 +150,18 @@ struct CallFrameInfo
     }
 };
 
+// The scope chain of a call frame, the locals followed by any closure scopes
+struct ScopeChainInfo
+{
+    ULONGLONG localsId;
+    vector<ULONGLONG> closureIds;
+
+    ScopeChainInfo() :
+        localsId(0)
+    {
+    }
+};
+
 // Breakpoint
 struct BreakpointInfo
 {
@@ -101,6 +173,7 @@ struct BreakpointInfo
     bool isTracepoint;
     bool isBound;
     bool isEnabled;
+    bool isUrlRegex; // The url is a regex to match against document urls rather than a url
 
     BreakpointInfo() :
         id(0),
@@ -108,7 +181,8 @@ struct BreakpointInfo
         spEventTypes(nullptr),
         isTracepoint(false),
         isBound(false),
-        isEnabled(false)
+        isEnabled(false),
+        isUrlRegex(false)
     {
     }
 };
@@ -132,6 +206,29 @@ struct ReboundBreakpointInfo
     }
 };
 
+// Message logged by a tracepoint hit
+struct TracepointMessage
+{
+    ULONG breakpointId;
+    ULONG docId;
+    ULONG lineNumber;
+    ULONG columnNumber;
+    CComBSTR url;
+    CComBSTR text;
+    double timestamp; // Seconds since the epoch
+    bool isError;
+
+    TracepointMessage() :
+        breakpointId(0),
+        docId(0),
+        lineNumber(0),
+        columnNumber(0),
+        timestamp(0),
+        isError(false)
+    {
+    }
+};
+
 // Break Event
 struct BreakEventInfo
 {
@@ -161,7 +258,7 @@ struct BreakEventInfo
 // Property
 struct PropertyInfo
 {
-    ULONG propertyId;
+    ULONGLONG propertyId;
     CComBSTR name;
     CComBSTR type;
     CComBSTR value;
@@ -183,6 +280,92 @@ struct PropertyInfo
     }
 };
 
+// Result of one expression in an eval batch
+struct EvalResultInfo
+{
+    EvalStatus status;
+    shared_ptr<PropertyInfo> spPropertyInfo; // Only set when the status is completed
+
+    EvalResultInfo() :
+        status(EvalStatus::Pending),
+        spPropertyInfo(nullptr)
+    {
+    }
+};
+
+// Eval batch, the results are in the same order as the expressions that were submitted
+struct EvalBatchInfo
+{
+    ULONG batchId;
+    std::vector<EvalResultInfo> results;
+
+    EvalBatchInfo() :
+        batchId(0)
+    {
+    }
+};
+
+// Property handle table memory use
+struct PropertyHandleTableInfo
+{
+    ULONG liveHandles;
+    ULONG slotCapacity;
+    ULONG freeSlots;
+    ULONG objectGroups;
+    ULONGLONG bytesReserved;
+
+    PropertyHandleTableInfo() :
+        liveHandles(0),
+        slotCapacity(0),
+        freeSlots(0),
+        objectGroups(0),
+        bytesReserved(0)
+    {
+    }
+};
+
+// First chance exception filter counters
+struct ExceptionFilterInfo
+{
+    ULONG exceptionsSeen;
+    ULONG filteredByUrl;
+    ULONG filteredBySampling;
+    ULONG filteredByRateLimit;
+    ULONG throwSites;
+
+    ExceptionFilterInfo() :
+        exceptionsSeen(0),
+        filteredByUrl(0),
+        filteredBySampling(0),
+        filteredByRateLimit(0),
+        throwSites(0)
+    {
+    }
+};
+
+// Dynamic code document text cache memory use
+struct DynamicDocumentInfo
+{
+    ULONG dynamicDocuments;
+    ULONG cachedDocuments;
+    ULONG sharedDocuments;  // Documents whose text was identical to another one and so shares its storage
+    ULONG evictedDocuments;
+    ULONGLONG cachedBytes;
+    ULONGLONG sharedBytes;  // Bytes that did not need to be stored because the text was shared
+    ULONGLONG budgetBytes;
+
+    DynamicDocumentInfo() :
+        dynamicDocuments(0),
+        cachedDocuments(0),
+        sharedDocuments(0),
+        evictedDocuments(0),
+        cachedBytes(0),
+        sharedBytes(0),
+        budgetBytes(0)
+    {
+    }
+};
+
 // Resume Event
 struct ResumeFromBreakpointInfo
 {
@@ -5,6 +5,7 @@
 #pragma once
 #include "comdef.h"
 #include "Helpers.h"
+#include "PDMEventMessageQueue.h"
 
 class ATL_NO_VTABLE EvalCallback :
     public CComObjectRootEx<CComMultiThreadModelNoCS>,
@@ -69,3 +70,49 @@ private:
     CHandle m_hCompletionEvent;
     bool m_isCompleted;
 };
+
+// Callback for evals that are started without waiting on them, completion is signalled to the
+// dispatch thread through the message queue and picked up when it next processes its events.
+class ATL_NO_VTABLE AsyncEvalCallback :
+    public CComObjectRootEx<CComMultiThreadModelNoCS>,
+    public IDebugExpressionCallBack
+{
+public:
+    BEGIN_COM_MAP(AsyncEvalCallback)
+        COM_INTERFACE_ENTRY(IDebugExpressionCallBack)
+        COM_INTERFACE_ENTRY2(IUnknown, IDebugExpressionCallBack)
+    END_COM_MAP()
+
+    AsyncEvalCallback() :
+        m_isCompleted(0)
+    {
+    }
+
+    HRESULT Initialize(_In_ PDMEventMessageQueue* pMessageQueue)
+    {
+        ATLENSURE_RETURN_HR(pMessageQueue != nullptr, E_INVALIDARG);
+        m_spMessageQueue = pMessageQueue;
+
+        return S_OK;
+    }
+
+    // IDebugExpressionCallBack
+    STDMETHOD(onComplete)(void)
+    {
+        ATLENSURE_RETURN_HR(m_spMessageQueue.p != nullptr, E_NOT_VALID_STATE);
+        ::InterlockedExchange(&m_isCompleted, 1);
+
+        m_spMessageQueue->Push(PDMEventType::EvalCompleted);
+        return S_OK;
+    }
+
+    // Eval Operations
+    bool IsCompleted() const
+    {
+        return (m_isCompleted != 0);
+    }
+
+private:
+    CComObjPtr<PDMEventMessageQueue> m_spMessageQueue;
+    volatile LONG m_isCompleted;
+};
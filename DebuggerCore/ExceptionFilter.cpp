@@ -0,0 +1,165 @@
+//
+// Copyright (C) Microsoft. All rights reserved.
+//
+
+#include "stdafx.h"
+#include "ExceptionFilter.h"
+
+// The number of throw sites remembered before they are all forgotten, so that a page generating
+// exceptions from eval'd code cannot grow the table without bound
+const size_t ExceptionFilter::s_maxThrowSites = 4096;
+
+ExceptionFilter::ExceptionFilter() :
+    m_sampleRate(1),
+    m_maxBreaks(0),
+    m_rateLimitInterval(0)
+{
+}
+
+void ExceptionFilter::SetIgnoredUrlPatterns(_In_ const vector<CString>& patterns)
+{
+    m_ignoredUrlPatterns.clear();
+    for (const auto& pattern : patterns)
+    {
+        if (!pattern.IsEmpty())
+        {
+            m_ignoredUrlPatterns.push_back(pattern);
+        }
+    }
+}
+
+void ExceptionFilter::SetSampleRate(_In_ ULONG sampleRate)
+{
+    m_sampleRate = (sampleRate == 0 ? 1 : sampleRate);
+}
+
+void ExceptionFilter::SetRateLimit(_In_ ULONG maxBreaks, _In_ ULONG interval)
+{
+    m_maxBreaks = maxBreaks;
+    m_rateLimitInterval = interval;
+
+    // The counts in the current intervals no longer mean anything under the new limit
+    for (auto& sitePair : m_throwSites)
+    {
+        sitePair.second.breaksInInterval = 0;
+        sitePair.second.intervalStart = 0;
+    }
+}
+
+bool ExceptionFilter::HasUrlPatterns() const
+{
+    return !m_ignoredUrlPatterns.empty();
+}
+
+bool ExceptionFilter::IsEmpty() const
+{
+    return (m_ignoredUrlPatterns.empty() && m_sampleRate <= 1 && m_maxBreaks == 0);
+}
+
+bool ExceptionFilter::ShouldBreak(_In_ DWORD_PTR sourceContext, _In_ ULONG lineNumber, _In_ LONG column, _In_opt_ const BSTR url, _In_ ULONGLONG now)
+{
+    m_info.exceptionsSeen++;
+
+    // The url rules are the cheapest, and do not need the throw site to be tracked at all
+    if (url != nullptr && ::SysStringLen(url) > 0)
+    {
+        for (const auto& pattern : m_ignoredUrlPatterns)
+        {
+            if (ExceptionFilter::MatchesPattern(url, pattern))
+            {
+                m_info.filteredByUrl++;
+                return false;
+            }
+        }
+    }
+
+    if (m_sampleRate <= 1 && m_maxBreaks == 0)
+    {
+        return true;
+    }
+
+    if (m_throwSites.size() >= ExceptionFilter::s_maxThrowSites)
+    {
+        m_throwSites.clear();
+    }
+
+    ThrowSiteKey key = { sourceContext, lineNumber, column };
+    ThrowSite& site = m_throwSites[key];
+
+    // The first throw from a site always gets through the sampling, then every Nth one after that
+    ULONG throwIndex = site.throwCount++;
+    if (m_sampleRate > 1 && (throwIndex % m_sampleRate) != 0)
+    {
+        m_info.filteredBySampling++;
+        return false;
+    }
+
+    if (m_maxBreaks != 0)
+    {
+        // An interval of 0 means the whole session, so the count is never reset
+        if (site.intervalStart == 0 || (m_rateLimitInterval != 0 && now - site.intervalStart >= m_rateLimitInterval))
+        {
+            site.intervalStart = now;
+            site.breaksInInterval = 0;
+        }
+
+        if (site.breaksInInterval >= m_maxBreaks)
+        {
+            m_info.filteredByRateLimit++;
+            return false;
+        }
+
+        site.breaksInInterval++;
+    }
+
+    return true;
+}
+
+void ExceptionFilter::Reset()
+{
+    m_throwSites.clear();
+    m_info = ExceptionFilterInfo();
+}
+
+void ExceptionFilter::GetInfo(_Out_ ExceptionFilterInfo& info) const
+{
+    info = m_info;
+    info.throwSites = static_cast<ULONG>(m_throwSites.size());
+}
+
+bool ExceptionFilter::MatchesPattern(_In_ LPCWSTR pUrl, _In_ LPCWSTR pPattern)
+{
+    // Iterative wildcard match, backtracking only to the most recent '*'
+    LPCWSTR pStar = nullptr;
+    LPCWSTR pStarUrl = nullptr;
+
+    while (*pUrl != L'\0')
+    {
+        if (*pPattern == L'*')
+        {
+            pStar = pPattern++;
+            pStarUrl = pUrl;
+        }
+        else if (::towlower(*pPattern) == ::towlower(*pUrl))
+        {
+            pPattern++;
+            pUrl++;
+        }
+        else if (pStar != nullptr)
+        {
+            pPattern = pStar + 1;
+            pUrl = ++pStarUrl;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (*pPattern == L'*')
+    {
+        pPattern++;
+    }
+
+    return (*pPattern == L'\0');
+}
@@ -0,0 +1,102 @@
+//
+// Copyright (C) Microsoft. All rights reserved.
+//
+
+#pragma once
+#include "DebuggerStructs.h"
+#include <unordered_map>
+
+using namespace ATL;
+using namespace std;
+
+//+----------------------------------------------------------------------------
+//
+//  Class:      ExceptionFilter
+//
+//  Synopsis:   Decides whether a first chance exception should stop in the
+//              debugger, so that exceptions the user is not interested in can
+//              be resumed before any call stack or script object is created.
+//              Exceptions are filtered by the url of the script that threw
+//              them, by sampling every Nth throw from the same site, and by
+//              limiting how many times a site can stop within an interval.
+//              A throw site is the source context and position that the
+//              script engine reports for the error.
+//              This class is not thread safe, the caller must lock around it.
+//
+class ExceptionFilter
+{
+public:
+    ExceptionFilter();
+
+    // Exceptions thrown from a script whose url matches one of these patterns are ignored,
+    // a '*' in a pattern matches any run of characters and the match is case insensitive
+    void SetIgnoredUrlPatterns(_In_ const vector<CString>& patterns);
+
+    // Only every sampleRate'th exception from the same site stops, 0 or 1 stops on all of them
+    void SetSampleRate(_In_ ULONG sampleRate);
+
+    // Each site stops at most maxBreaks times in each interval (in milliseconds), a maxBreaks of 0 turns the limit off
+    // and an interval of 0 applies the limit to the whole session
+    void SetRateLimit(_In_ ULONG maxBreaks, _In_ ULONG interval);
+
+    // True if any url patterns are set, so the caller only needs to resolve the url when it is going to be used
+    bool HasUrlPatterns() const;
+
+    // True if the rules are not going to filter anything, so the caller can skip building the throw site
+    bool IsEmpty() const;
+
+    bool ShouldBreak(_In_ DWORD_PTR sourceContext, _In_ ULONG lineNumber, _In_ LONG column, _In_opt_ const BSTR url, _In_ ULONGLONG now);
+
+    // Forgets the throw sites and counters, the rules themselves are kept
+    void Reset();
+
+    void GetInfo(_Out_ ExceptionFilterInfo& info) const;
+
+private:
+    struct ThrowSiteKey
+    {
+        DWORD_PTR sourceContext;
+        ULONG lineNumber;
+        LONG column;
+
+        bool operator==(_In_ const ThrowSiteKey& other) const
+        {
+            return (sourceContext == other.sourceContext && lineNumber == other.lineNumber && column == other.column);
+        }
+    };
+
+    struct ThrowSiteKeyHash
+    {
+        size_t operator()(_In_ const ThrowSiteKey& key) const
+        {
+            return std::hash<DWORD_PTR>()(key.sourceContext) ^ (std::hash<ULONG>()(key.lineNumber) << 1) ^ (std::hash<LONG>()(key.column) << 2);
+        }
+    };
+
+    struct ThrowSite
+    {
+        ULONG throwCount;
+        ULONG breaksInInterval;
+        ULONGLONG intervalStart;
+
+        ThrowSite() :
+            throwCount(0),
+            breaksInInterval(0),
+            intervalStart(0)
+        {
+        }
+    };
+
+    static bool MatchesPattern(_In_ LPCWSTR pUrl, _In_ LPCWSTR pPattern);
+
+    static const size_t s_maxThrowSites;
+
+private:
+    vector<CString> m_ignoredUrlPatterns;
+    ULONG m_sampleRate;
+    ULONG m_maxBreaks;
+    ULONG m_rateLimitInterval;
+
+    unordered_map<ThrowSiteKey, ThrowSite, ThrowSiteKeyHash> m_throwSites;
+    ExceptionFilterInfo m_info;
+};
@@ -0,0 +1,352 @@
+//
+// Copyright (C) Microsoft. All rights reserved.
+//
+
+#pragma once
+
+#include <vector>
+#include <sal.h>
+
+//+----------------------------------------------------------------------------
+//
+//  Class:      IdSlotMap
+//
+//  Synopsis:   A map from the dense, monotonically increasing ids handed out
+//              by the debugger (doc ids, breakpoint ids) to values, stored as
+//              a flat vector of slots indexed by (id - base id).
+//              The base id is taken from the first id that is inserted, and
+//              is lowered if a smaller id is ever inserted, so ids that are
+//              unique across debugging sessions do not leave a large unused
+//              prefix in the vector after a Clear.
+//              Empty slots left at either end by erase are trimmed, with the
+//              front compacted once it makes up half of the vector, so the
+//              storage tracks the live id range rather than every id ever
+//              inserted.
+//              Iteration with ForEach always visits ids in ascending order,
+//              which matches the ordering of the std::map it replaces.
+//
+template <class T>
+class IdSlotMap
+{
+public:
+    IdSlotMap() :
+        m_baseId(0),
+        m_headIndex(0),
+        m_count(0)
+    {
+    }
+
+    size_t size() const
+    {
+        return m_count;
+    }
+
+    bool empty() const
+    {
+        return (m_count == 0);
+    }
+
+    // The number of slots held, the live id range plus any empty slots at the front that have not been compacted yet
+    size_t slotCount() const
+    {
+        return m_slots.size();
+    }
+
+    void clear()
+    {
+        m_slots.clear();
+        m_isOccupied.clear();
+        m_baseId = 0;
+        m_headIndex = 0;
+        m_count = 0;
+    }
+
+    // Returns the value stored for this id, or nullptr if there is none
+    T* find(_In_ ULONG id)
+    {
+        if (!this->IsInRange(id) || !m_isOccupied[id - m_baseId])
+        {
+            return nullptr;
+        }
+
+        return &m_slots[id - m_baseId];
+    }
+
+    const T* find(_In_ ULONG id) const
+    {
+        return const_cast<IdSlotMap<T>*>(this)->find(id);
+    }
+
+    // Returns the value stored for this id, default constructing it if there is none
+    T& operator[](_In_ ULONG id)
+    {
+        this->EnsureSlot(id);
+
+        size_t index = id - m_baseId;
+        if (!m_isOccupied[index])
+        {
+            m_isOccupied[index] = true;
+            m_count++;
+
+            if (index < m_headIndex)
+            {
+                m_headIndex = index;
+            }
+        }
+
+        return m_slots[index];
+    }
+
+    void erase(_In_ ULONG id)
+    {
+        if (this->IsInRange(id) && m_isOccupied[id - m_baseId])
+        {
+            size_t index = id - m_baseId;
+            m_slots[index] = T();
+            m_isOccupied[index] = false;
+            m_count--;
+
+            if (m_count == 0)
+            {
+                this->clear();
+                return;
+            }
+
+            // Trim empty slots at the end so the vector tracks the live id range
+            while (!m_isOccupied.back())
+            {
+                m_slots.pop_back();
+                m_isOccupied.pop_back();
+            }
+
+            // Skip empty slots at the front, and drop them once they are a large part of the vector
+            if (index == m_headIndex)
+            {
+                while (!m_isOccupied[m_headIndex])
+                {
+                    m_headIndex++;
+                }
+
+                if (m_headIndex >= s_minCompactSlots && m_headIndex * 2 >= m_slots.size())
+                {
+                    m_slots.erase(m_slots.begin(), m_slots.begin() + m_headIndex);
+                    m_isOccupied.erase(m_isOccupied.begin(), m_isOccupied.begin() + m_headIndex);
+                    m_baseId += static_cast<ULONG>(m_headIndex);
+                    m_headIndex = 0;
+                }
+            }
+        }
+    }
+
+    // Calls func(id, value) for each stored id in ascending order
+    template <class Func>
+    void ForEach(_In_ Func func)
+    {
+        for (size_t i = m_headIndex; i < m_slots.size(); i++)
+        {
+            if (m_isOccupied[i])
+            {
+                func(static_cast<ULONG>(m_baseId + i), m_slots[i]);
+            }
+        }
+    }
+
+private:
+    bool IsInRange(_In_ ULONG id) const
+    {
+        return (id >= m_baseId && (id - m_baseId) < m_slots.size());
+    }
+
+    void EnsureSlot(_In_ ULONG id)
+    {
+        if (m_slots.empty())
+        {
+            m_baseId = id;
+        }
+        else if (id < m_baseId)
+        {
+            // Rebase so that the new id fits at the front
+            size_t shift = m_baseId - id;
+            m_slots.insert(m_slots.begin(), shift, T());
+            m_isOccupied.insert(m_isOccupied.begin(), shift, false);
+            m_baseId = id;
+            m_headIndex += shift;
+        }
+
+        size_t index = id - m_baseId;
+        if (index >= m_slots.size())
+        {
+            m_slots.resize(index + 1);
+            m_isOccupied.resize(index + 1, false);
+        }
+    }
+
+private:
+    // The number of empty slots at the front below which they are skipped rather than erased
+    static const size_t s_minCompactSlots = 64;
+
+    std::vector<T> m_slots;
+    std::vector<bool> m_isOccupied;
+    ULONG m_baseId;
+    size_t m_headIndex; // Index of the first occupied slot
+    size_t m_count;
+};
+
+//+----------------------------------------------------------------------------
+//
+//  Class:      IdBitSet
+//
+//  Synopsis:   A set of the same dense ids, stored as a bitset indexed by
+//              (id - base id). Used for the dirty and current document sets
+//              that were previously a map<ULONG, bool>. Empty bits are
+//              trimmed from both ends in the same way as IdSlotMap.
+//
+class IdBitSet
+{
+public:
+    IdBitSet() :
+        m_baseId(0),
+        m_headIndex(0),
+        m_count(0)
+    {
+    }
+
+    size_t size() const
+    {
+        return m_count;
+    }
+
+    bool empty() const
+    {
+        return (m_count == 0);
+    }
+
+    // The number of bits held, in the same way as IdSlotMap::slotCount
+    size_t slotCount() const
+    {
+        return m_bits.size();
+    }
+
+    void clear()
+    {
+        m_bits.clear();
+        m_baseId = 0;
+        m_headIndex = 0;
+        m_count = 0;
+    }
+
+    bool contains(_In_ ULONG id) const
+    {
+        return (id >= m_baseId && (id - m_baseId) < m_bits.size() && m_bits[id - m_baseId]);
+    }
+
+    void insert(_In_ ULONG id)
+    {
+        if (m_bits.empty())
+        {
+            m_baseId = id;
+        }
+        else if (id < m_baseId)
+        {
+            m_headIndex += m_baseId - id;
+            m_bits.insert(m_bits.begin(), m_baseId - id, false);
+            m_baseId = id;
+        }
+
+        size_t index = id - m_baseId;
+        if (index >= m_bits.size())
+        {
+            m_bits.resize(index + 1, false);
+        }
+
+        if (!m_bits[index])
+        {
+            m_bits[index] = true;
+            m_count++;
+
+            if (index < m_headIndex)
+            {
+                m_headIndex = index;
+            }
+        }
+    }
+
+    void erase(_In_ ULONG id)
+    {
+        if (this->contains(id))
+        {
+            size_t index = id - m_baseId;
+            m_bits[index] = false;
+            m_count--;
+
+            if (m_count == 0)
+            {
+                this->clear();
+                return;
+            }
+
+            while (!m_bits.back())
+            {
+                m_bits.pop_back();
+            }
+
+            if (index == m_headIndex)
+            {
+                while (!m_bits[m_headIndex])
+                {
+                    m_headIndex++;
+                }
+
+                if (m_headIndex >= s_minCompactBits && m_headIndex * 2 >= m_bits.size())
+                {
+                    m_bits.erase(m_bits.begin(), m_bits.begin() + m_headIndex);
+                    m_baseId += static_cast<ULONG>(m_headIndex);
+                    m_headIndex = 0;
+                }
+            }
+        }
+    }
+
+    // Finds the lowest id in the set that is greater than or equal to fromId
+    bool FindNext(_In_ ULONG fromId, _Out_ ULONG& id) const
+    {
+        size_t index = (fromId > m_baseId ? fromId - m_baseId : 0);
+        if (index < m_headIndex)
+        {
+            index = m_headIndex;
+        }
+
+        for (; index < m_bits.size(); index++)
+        {
+            if (m_bits[index])
+            {
+                id = static_cast<ULONG>(m_baseId + index);
+                return true;
+            }
+        }
+
+        id = 0;
+        return false;
+    }
+
+    // Calls func(id) for each id in the set in ascending order
+    template <class Func>
+    void ForEach(_In_ Func func) const
+    {
+        for (size_t i = m_headIndex; i < m_bits.size(); i++)
+        {
+            if (m_bits[i])
+            {
+                func(static_cast<ULONG>(m_baseId + i));
+            }
+        }
+    }
+
+private:
+    static const size_t s_minCompactBits = 256;
+
+    std::vector<bool> m_bits;
+    ULONG m_baseId;
+    size_t m_headIndex; // Index of the first set bit
+    size_t m_count;
+};
@@ -11,6 +11,9 @@ enum class PDMEventType
 {
     SourceUpdated,
     BreakpointHit,
+    ExceptionFiltered,
+    BlackboxedStep,
+    EvalCompleted,
     PDMClosed
 };
 
@@ -66,6 +66,13 @@ public:
             }
             break;
 
+        case PDMThreadCallbackMethod::PopulateCallStack:
+            {
+                ThreadController* pThreadController = (ThreadController*)param_pIn;
+                hr = pThreadController->OnPopulateCallStackCallback((ULONG)param_pvArg);
+            }
+            break;
+
         default:
             hr = E_FAIL;
             break;
@@ -0,0 +1,191 @@
+//
+// Copyright (C) Microsoft. All rights reserved.
+//
+
+#include "stdafx.h"
+#include "PropertyHandleTable.h"
+
+// The number of slots allocated at a time, slots never move once allocated so the slabs are not resized
+const ULONG PropertyHandleTable::s_slabSize = 256;
+
+// Generations are limited to 21 bits so that handles stay exactly representable as JavaScript numbers
+const ULONG PropertyHandleTable::s_maxGeneration = (1 << 21) - 1;
+
+PropertyHandleTable::PropertyHandleTable() :
+    m_usedSlots(0),
+    m_liveHandles(0)
+{
+    // The unnamed group always exists as id 0
+    m_objectGroupNames.push_back(CString());
+    m_objectGroupSlots.push_back(vector<ULONG>());
+}
+
+ULONG PropertyHandleTable::GetObjectGroupId(_In_ const CString& objectGroup)
+{
+    for (size_t i = 0; i < m_objectGroupNames.size(); i++)
+    {
+        if (m_objectGroupNames[i] == objectGroup)
+        {
+            return static_cast<ULONG>(i);
+        }
+    }
+
+    // The front end only ever uses a handful of group names, so a linear search is cheaper than a map here
+    m_objectGroupNames.push_back(objectGroup);
+    m_objectGroupSlots.push_back(vector<ULONG>());
+
+    return static_cast<ULONG>(m_objectGroupNames.size() - 1);
+}
+
+HRESULT PropertyHandleTable::Add(_In_ IDebugProperty* pDebugProperty, _In_ ULONG groupId, _Out_ PropertyHandle& handle)
+{
+    handle = 0;
+    ATLENSURE_RETURN_HR(pDebugProperty != nullptr, E_INVALIDARG);
+    ATLENSURE_RETURN_HR(groupId < m_objectGroupSlots.size(), E_INVALIDARG);
+
+    ULONG index;
+    if (!m_freeSlots.empty())
+    {
+        index = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    }
+    else
+    {
+        ATLENSURE_RETURN_HR(m_usedSlots < ULONG_MAX - 1, E_OUTOFMEMORY);
+
+        if (m_usedSlots == m_slabs.size() * s_slabSize)
+        {
+            m_slabs.push_back(unique_ptr<Slot[]>(new Slot[s_slabSize]));
+        }
+
+        index = m_usedSlots++;
+    }
+
+    Slot* pSlot = this->GetSlot(index);
+    pSlot->spDebugProperty = pDebugProperty;
+    pSlot->groupId = groupId;
+    m_objectGroupSlots[groupId].push_back(index);
+    m_liveHandles++;
+
+    handle = (static_cast<PropertyHandle>(pSlot->generation) << 32) | (static_cast<PropertyHandle>(index) + 1);
+
+    return S_OK;
+}
+
+HRESULT PropertyHandleTable::Get(_In_ PropertyHandle handle, _Out_ CComPtr<IDebugProperty>& spDebugProperty, _Out_opt_ ULONG* pGroupId) const
+{
+    Slot* pSlot = this->FindSlot(handle);
+    if (pSlot == nullptr)
+    {
+        return E_NOT_FOUND;
+    }
+
+    spDebugProperty = pSlot->spDebugProperty;
+    if (pGroupId != nullptr)
+    {
+        *pGroupId = pSlot->groupId;
+    }
+
+    return S_OK;
+}
+
+HRESULT PropertyHandleTable::ReleaseObjectGroup(_In_ const CString& objectGroup)
+{
+    for (size_t i = 0; i < m_objectGroupNames.size(); i++)
+    {
+        if (m_objectGroupNames[i] == objectGroup)
+        {
+            for (ULONG index : m_objectGroupSlots[i])
+            {
+                this->FreeSlot(index);
+            }
+
+            // Release the memory held by the list rather than just emptying it
+            vector<ULONG>().swap(m_objectGroupSlots[i]);
+
+            return S_OK;
+        }
+    }
+
+    return S_FALSE;
+}
+
+void PropertyHandleTable::Clear()
+{
+    for (auto& groupSlots : m_objectGroupSlots)
+    {
+        for (ULONG index : groupSlots)
+        {
+            this->FreeSlot(index);
+        }
+
+        vector<ULONG>().swap(groupSlots);
+    }
+
+    // Keep the unnamed group, the named ones are recreated on demand
+    m_objectGroupNames.resize(1);
+    m_objectGroupSlots.resize(1);
+}
+
+void PropertyHandleTable::GetMemoryInfo(_Out_ PropertyHandleTableInfo& info) const
+{
+    info.liveHandles = m_liveHandles;
+    info.slotCapacity = static_cast<ULONG>(m_slabs.size() * s_slabSize);
+    info.freeSlots = static_cast<ULONG>(m_freeSlots.size()) + (info.slotCapacity - m_usedSlots);
+    info.objectGroups = static_cast<ULONG>(m_objectGroupNames.size());
+
+    // This does not include the PDM side of each live property, only what the table itself holds on to
+    size_t bytes = m_slabs.capacity() * sizeof(unique_ptr<Slot[]>);
+    bytes += m_slabs.size() * s_slabSize * sizeof(Slot);
+    bytes += m_freeSlots.capacity() * sizeof(ULONG);
+    for (const auto& groupSlots : m_objectGroupSlots)
+    {
+        bytes += sizeof(vector<ULONG>) + groupSlots.capacity() * sizeof(ULONG);
+    }
+
+    info.bytesReserved = static_cast<ULONGLONG>(bytes);
+}
+
+PropertyHandleTable::Slot* PropertyHandleTable::GetSlot(_In_ ULONG index) const
+{
+    return &m_slabs[index / s_slabSize][index % s_slabSize];
+}
+
+PropertyHandleTable::Slot* PropertyHandleTable::FindSlot(_In_ PropertyHandle handle) const
+{
+    ULONG indexPlusOne = static_cast<ULONG>(handle & 0xFFFFFFFF);
+    ULONG generation = static_cast<ULONG>(handle >> 32);
+    if (indexPlusOne == 0 || indexPlusOne > m_usedSlots)
+    {
+        return nullptr;
+    }
+
+    Slot* pSlot = this->GetSlot(indexPlusOne - 1);
+    if (pSlot->generation != generation || pSlot->spDebugProperty.p == nullptr)
+    {
+        return nullptr;
+    }
+
+    return pSlot;
+}
+
+void PropertyHandleTable::FreeSlot(_In_ ULONG index)
+{
+    Slot* pSlot = this->GetSlot(index);
+    if (pSlot->spDebugProperty.p == nullptr)
+    {
+        return;
+    }
+
+    // Release the PDM object and invalidate any handles that are still out there
+    pSlot->spDebugProperty.Release();
+    pSlot->groupId = 0;
+    pSlot->generation++;
+    m_liveHandles--;
+
+    // A slot whose generation has run out is retired instead of risking a handle being reused
+    if (pSlot->generation <= s_maxGeneration)
+    {
+        m_freeSlots.push_back(index);
+    }
+}
@@ -0,0 +1,81 @@
+//
+// Copyright (C) Microsoft. All rights reserved.
+//
+
+#pragma once
+#include "DebuggerStructs.h"
+
+using namespace ATL;
+using namespace std;
+
+// A handle to an IDebugProperty held by the PropertyHandleTable.
+// The low 32 bits are the slot index plus one (so that 0 is never a valid handle) and the bits above that are the
+// generation of the slot when the handle was created. The generation is kept within 21 bits so that every handle
+// fits exactly into the 53 bit mantissa of a JavaScript number.
+typedef ULONGLONG PropertyHandle;
+
+//+----------------------------------------------------------------------------
+//
+//  Class:      PropertyHandleTable
+//
+//  Synopsis:   Holds the IDebugProperty objects that have been handed out to
+//              the front end while at a break. Slots are allocated in fixed
+//              size slabs that never move, and freed slots are reused through
+//              a free list. Each slot carries a generation that is bumped when
+//              it is freed, so a stale handle is rejected rather than
+//              resolving to whatever property now occupies the slot.
+//              Every handle belongs to an object group, which can be released
+//              as a whole once the front end no longer needs its objects.
+//              This class is not thread safe, the caller must lock around it.
+//
+class PropertyHandleTable
+{
+public:
+    PropertyHandleTable();
+
+    // Returns the id for the named object group, creating the group if it does not exist yet.
+    // The unnamed group (id 0) always exists and is used for handles that nobody asked to group.
+    ULONG GetObjectGroupId(_In_ const CString& objectGroup);
+
+    HRESULT Add(_In_ IDebugProperty* pDebugProperty, _In_ ULONG groupId, _Out_ PropertyHandle& handle);
+    HRESULT Get(_In_ PropertyHandle handle, _Out_ CComPtr<IDebugProperty>& spDebugProperty, _Out_opt_ ULONG* pGroupId = nullptr) const;
+
+    // Frees every handle in the named object group, returns S_FALSE if there is no such group
+    HRESULT ReleaseObjectGroup(_In_ const CString& objectGroup);
+
+    // Frees every handle, the slabs are kept so that the next break can reuse them
+    void Clear();
+
+    void GetMemoryInfo(_Out_ PropertyHandleTableInfo& info) const;
+
+private:
+    struct Slot
+    {
+        CComPtr<IDebugProperty> spDebugProperty;
+        ULONG generation;
+        ULONG groupId;
+
+        Slot() :
+            generation(1),
+            groupId(0)
+        {
+        }
+    };
+
+    Slot* GetSlot(_In_ ULONG index) const;
+    Slot* FindSlot(_In_ PropertyHandle handle) const;
+    void FreeSlot(_In_ ULONG index);
+
+    static const ULONG s_slabSize;
+    static const ULONG s_maxGeneration;
+
+private:
+    vector<unique_ptr<Slot[]>> m_slabs;
+    vector<ULONG> m_freeSlots;
+    ULONG m_usedSlots;
+    ULONG m_liveHandles;
+
+    // Object groups, the index into the vector is the group id
+    vector<CString> m_objectGroupNames;
+    vector<vector<ULONG>> m_objectGroupSlots;
+};
@@ -317,4 +317,267 @@ namespace ScriptHelpers
 
         return hr;
     }
+
+    HRESULT JSONParse(_In_ IDispatchEx* pDispExScript, _In_ const CString& jsonString, _Out_ CComVariant& parsedObject)
+    {
+        ATLENSURE_RETURN_HR(pDispExScript != nullptr, E_INVALIDARG);
+
+        parsedObject.Clear();
+
+        // Find the javascript JSON object id using the IDispatchEx of the script engine
+        CComBSTR name(L"JSON");
+        DISPID jsonId;
+        HRESULT hr = pDispExScript->GetDispID(name, 0, &jsonId);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        // Get the actual JSON object using the id
+        DISPPARAMS dispParamsNoArgs = {NULL, NULL, 0, 0};
+        CComVariant varJSONObject;
+        hr = pDispExScript->InvokeEx(jsonId, LOCALE_USER_DEFAULT, DISPATCH_PROPERTYGET, &dispParamsNoArgs, &varJSONObject, NULL, NULL);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        CComQIPtr<IDispatchEx> spJSON(varJSONObject.pdispVal);
+        ATLENSURE_RETURN_HR(spJSON.p != nullptr, E_NOINTERFACE);
+
+        // Find the parse method's id from the JSON object
+        CComBSTR parseName(L"parse");
+        DISPID parseId;
+        hr = spJSON->GetDispID(parseName, 0, &parseId);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        // Create the parameter from the string passed in
+        CComVariant varJSONString(jsonString);
+        DISPPARAMS dispParamsParse = {NULL, NULL, 0, 0};
+        dispParamsParse.rgvarg = &varJSONString;
+        dispParamsParse.cArgs = 1;
+
+        // Call the parse function
+        hr = spJSON->InvokeEx(parseId, LOCALE_USER_DEFAULT, DISPATCH_METHOD, &dispParamsParse, &parsedObject, NULL, NULL);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        return hr;
+    }
+
+    void AppendJSONString(_Inout_ CString& json, _In_opt_ const BSTR value)
+    {
+        json.AppendChar(L'\"');
+
+        UINT length = ::SysStringLen(value);
+        for (UINT i = 0; i < length; i++)
+        {
+            WCHAR c = value[i];
+            switch (c)
+            {
+            case L'\\': json.Append(L"\\\\"); break;
+            case L'\"': json.Append(L"\\\""); break;
+            case L'\b': json.Append(L"\\b"); break;
+            case L'\f': json.Append(L"\\f"); break;
+            case L'\n': json.Append(L"\\n"); break;
+            case L'\r': json.Append(L"\\r"); break;
+            case L'\t': json.Append(L"\\t"); break;
+            default:
+                if (c < 0x20)
+                {
+                    // The json is passed to the engine as a wide string, so only control characters need a literal
+                    json.AppendFormat(L"\\u%04x", c);
+                }
+                else
+                {
+                    json.AppendChar(c);
+                }
+                break;
+            }
+        }
+
+        json.AppendChar(L'\"');
+    }
+
+    HRESULT InvokePropertyPut(_In_ IDispatchEx* pObject, _In_ DISPID dispId, _In_ const VARIANT& value)
+    {
+        DISPID putId = DISPID_PROPERTYPUT;
+        VARIANTARG params[1];
+        params[0] = value;
+
+        DISPPARAMS dispParams = {
+            params, // parameter
+            &putId, // DISPID of the action (In our case PropertyPut)
+            1,      // no. of parameters
+            1 };    // no. of actions
+
+        return pObject->InvokeEx(dispId, LOCALE_USER_DEFAULT, DISPATCH_PROPERTYPUTREF, &dispParams, NULL, NULL, NULL);
+    }
+
+    ScriptObjectCache::ScriptObjectCache() :
+        m_objectConstructorId(DISPID_UNKNOWN),
+        m_arrayConstructorId(DISPID_UNKNOWN)
+    {
+    }
+
+    HRESULT ScriptObjectCache::Initialize(_In_ IDispatchEx* pDispExScript)
+    {
+        ATLENSURE_RETURN_HR(pDispExScript != nullptr, E_INVALIDARG);
+
+        // DISPIDs from a previous engine are meaningless for the new one
+        this->Reset();
+        m_spScriptDispatch = pDispExScript;
+
+        return S_OK;
+    }
+
+    void ScriptObjectCache::Reset()
+    {
+        m_spScriptDispatch.Release();
+        m_objectConstructorId = DISPID_UNKNOWN;
+        m_arrayConstructorId = DISPID_UNKNOWN;
+        m_nameIds.clear();
+        m_indexIds.clear();
+        m_shapeIds.clear();
+    }
+
+    HRESULT ScriptObjectCache::CreateArray(_In_ const vector<CComVariant>& vValues, _Out_ CComVariant& newArray)
+    {
+        ATLENSURE_RETURN_HR(m_spScriptDispatch.p != nullptr, E_NOT_VALID_STATE);
+
+        CComPtr<IDispatchEx> spArray;
+        HRESULT hr = this->Construct(L"Array", m_arrayConstructorId, spArray);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        if (m_indexIds.size() < vValues.size())
+        {
+            m_indexIds.resize(vValues.size(), DISPID_UNKNOWN);
+        }
+
+        for (size_t i = 0; i < vValues.size(); i++)
+        {
+            // The name in an array is just the index starting at 0
+            CString index;
+            index.Format(L"%Iu", i);
+
+            hr = this->PutProperty(spArray, index, m_indexIds[i], vValues[i]);
+            BPT_FAIL_IF_NOT_S_OK(hr);
+        }
+
+        newArray = spArray.p;
+
+        return S_OK;
+    }
+
+    HRESULT ScriptObjectCache::CreateObject(_In_ const map<CString, CComVariant>& mapNameValuePairs, _Out_ CComVariant& newObject)
+    {
+        ATLENSURE_RETURN_HR(m_spScriptDispatch.p != nullptr, E_NOT_VALID_STATE);
+
+        CComPtr<IDispatchEx> spObject;
+        HRESULT hr = this->Construct(L"Object", m_objectConstructorId, spObject);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        for (const auto& nameValuePair : mapNameValuePairs)
+        {
+            // New names are added as DISPID_UNKNOWN and filled in by the first put
+            auto it = m_nameIds.find(nameValuePair.first);
+            if (it == m_nameIds.end())
+            {
+                it = m_nameIds.insert(make_pair(nameValuePair.first, DISPID_UNKNOWN)).first;
+            }
+
+            hr = this->PutProperty(spObject, nameValuePair.first, it->second, nameValuePair.second);
+            BPT_FAIL_IF_NOT_S_OK(hr);
+        }
+
+        newObject = spObject.p;
+
+        return S_OK;
+    }
+
+    HRESULT ScriptObjectCache::CreateRecord(_In_reads_(count) const LPCWSTR* pShape, _In_ size_t count, _In_reads_(count) const CComVariant* pValues, _Out_ CComVariant& newObject)
+    {
+        ATLENSURE_RETURN_HR(m_spScriptDispatch.p != nullptr, E_NOT_VALID_STATE);
+        ATLENSURE_RETURN_HR(pShape != nullptr && pValues != nullptr, E_INVALIDARG);
+
+        vector<DISPID>& shapeIds = m_shapeIds[pShape];
+        if (shapeIds.empty())
+        {
+            shapeIds.resize(count, DISPID_UNKNOWN);
+        }
+
+        ATLENSURE_RETURN_HR(shapeIds.size() == count, E_INVALIDARG);
+
+        CComPtr<IDispatchEx> spObject;
+        HRESULT hr = this->Construct(L"Object", m_objectConstructorId, spObject);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            hr = this->PutProperty(spObject, pShape[i], shapeIds[i], pValues[i]);
+            BPT_FAIL_IF_NOT_S_OK(hr);
+        }
+
+        newObject = spObject.p;
+
+        return S_OK;
+    }
+
+    HRESULT ScriptObjectCache::Construct(_In_ LPCWSTR type, _Inout_ DISPID& constructorId, _Out_ CComPtr<IDispatchEx>& spObject)
+    {
+        HRESULT hr = S_OK;
+
+        // Find the javascript constructor using the IDispatchEx of the script engine
+        if (constructorId == DISPID_UNKNOWN)
+        {
+            CComBSTR name(type);
+            hr = m_spScriptDispatch->GetDispID(name, 0, &constructorId);
+            BPT_FAIL_IF_NOT_S_OK(hr);
+        }
+
+        // Create the jscript object by calling its constructor
+        DISPPARAMS dispParamsNoArgs = {NULL, NULL, 0, 0};
+        CComVariant varCreatedObject;
+        hr = m_spScriptDispatch->InvokeEx(constructorId, LOCALE_USER_DEFAULT, DISPATCH_CONSTRUCT, &dispParamsNoArgs, &varCreatedObject, NULL, NULL);
+        if (hr != S_OK)
+        {
+            // Look the constructor up again on the next call in case the cached id has gone stale
+            constructorId = DISPID_UNKNOWN;
+        }
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        ATLENSURE_RETURN_HR(varCreatedObject.vt == VT_DISPATCH, E_UNEXPECTED);
+
+        // Query the IDispatchEx interface from the newly created object so we can add properties to it
+        hr = varCreatedObject.pdispVal->QueryInterface(IID_PPV_ARGS(&spObject));
+        ATLENSURE_RETURN_HR(hr == S_OK && spObject.p != nullptr, E_UNEXPECTED);
+
+        return S_OK;
+    }
+
+    HRESULT ScriptObjectCache::PutProperty(_In_ IDispatchEx* pObject, _In_ LPCWSTR name, _Inout_ DISPID& dispId, _In_ const VARIANT& value)
+    {
+        HRESULT hr = S_OK;
+        bool wasCached = (dispId != DISPID_UNKNOWN);
+        if (!wasCached)
+        {
+            // Create the property by using the special fdexNameEnsure flag
+            CComBSTR propertyName(name);
+            hr = pObject->GetDispID(propertyName, fdexNameEnsure, &dispId);
+            BPT_FAIL_IF_NOT_S_OK(hr);
+        }
+
+        hr = InvokePropertyPut(pObject, dispId, value);
+        if (hr != S_OK && wasCached)
+        {
+            // The cached id was not accepted by this object, so resolve the name on it and update the cache
+            CComBSTR propertyName(name);
+            hr = pObject->GetDispID(propertyName, fdexNameEnsure, &dispId);
+            if (hr == S_OK)
+            {
+                hr = InvokePropertyPut(pObject, dispId, value);
+            }
+        }
+
+        if (hr != S_OK)
+        {
+            dispId = DISPID_UNKNOWN;
+        }
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        return S_OK;
+    }
 }
\ No newline at end of file
@@ -32,4 +32,42 @@ namespace ScriptHelpers
 
     // Turns a CComVariant into a json string
     HRESULT JSONStringify(_In_ IDispatchEx* pDispExScript, _In_ ATL::CComVariant& objectToStringify, _Out_ ATL::CComBSTR& jsonString);
+
+    // Turns a json string into script objects with a single call into the engine, used for creating large batches of records at once
+    HRESULT JSONParse(_In_ IDispatchEx* pDispExScript, _In_ const ATL::CString& jsonString, _Out_ ATL::CComVariant& parsedObject);
+
+    // Appends the value to the json as a quoted string, escaping any characters that JSON requires
+    void AppendJSONString(_Inout_ ATL::CString& json, _In_opt_ const BSTR value);
+
+    // Creates script objects the same way as CreateJScriptObject and CreateJScriptArray, but remembers the DISPIDs that
+    // the script engine resolves for constructor and property names so that each name is only looked up once per engine.
+    // Records with a fixed set of properties can be created from a static shape, which also skips the per-record name map.
+    // The cache is tied to the script engine it was initialized with and must be reset when that engine is released.
+    class ScriptObjectCache
+    {
+    public:
+        ScriptObjectCache();
+
+        HRESULT Initialize(_In_ IDispatchEx* pDispExScript);
+        void Reset();
+
+        HRESULT CreateArray(_In_ const std::vector<ATL::CComVariant>& vValues, _Out_ ATL::CComVariant& newArray);
+        HRESULT CreateObject(_In_ const std::map<ATL::CString, ATL::CComVariant>& mapNameValuePairs, _Out_ ATL::CComVariant& newObject);
+
+        // Creates a JS Object with the names in the shape paired to the values at the same index.
+        // The shape is used as the cache key, so it must be a static array that outlives the cache.
+        HRESULT CreateRecord(_In_reads_(count) const LPCWSTR* pShape, _In_ size_t count, _In_reads_(count) const ATL::CComVariant* pValues, _Out_ ATL::CComVariant& newObject);
+
+    private:
+        HRESULT Construct(_In_ LPCWSTR type, _Inout_ DISPID& constructorId, _Out_ ATL::CComPtr<IDispatchEx>& spObject);
+        HRESULT PutProperty(_In_ IDispatchEx* pObject, _In_ LPCWSTR name, _Inout_ DISPID& dispId, _In_ const VARIANT& value);
+
+    private:
+        ATL::CComPtr<IDispatchEx> m_spScriptDispatch;
+        DISPID m_objectConstructorId;
+        DISPID m_arrayConstructorId;
+        std::map<ATL::CString, DISPID> m_nameIds;
+        std::vector<DISPID> m_indexIds;
+        std::unordered_map<const LPCWSTR*, std::vector<DISPID>> m_shapeIds;
+    };
 };
\ No newline at end of file
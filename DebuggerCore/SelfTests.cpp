@@ -0,0 +1,156 @@
+//
+// Copyright (C) Microsoft. All rights reserved.
+//
+
+#include "stdafx.h"
+#include "SelfTests.h"
+
+namespace SelfTests
+{
+    void Check(_In_ bool condition, _In_ LPCWSTR pDescription, _Inout_ vector<CString>& failures)
+    {
+        if (!condition)
+        {
+            failures.push_back(CString(pDescription));
+        }
+    }
+
+    void CheckIdSlotMap(_Inout_ vector<CString>& failures)
+    {
+        IdSlotMap<ULONG> slotMap;
+
+        // The base is taken from the first id, and lowered when a smaller id is inserted
+        slotMap[100] = 100;
+        slotMap[90] = 90;
+        Check(slotMap.size() == 2 && slotMap.slotCount() == 11, L"IdSlotMap: rebasing to a lower id keeps only the range between the ids", failures);
+        Check(slotMap.find(90) != nullptr && *slotMap.find(90) == 90 && slotMap.find(100) != nullptr && *slotMap.find(100) == 100, L"IdSlotMap: values are still found after rebasing", failures);
+        Check(slotMap.find(95) == nullptr && slotMap.find(0) == nullptr && slotMap.find(101) == nullptr, L"IdSlotMap: ids that were never inserted are not found", failures);
+
+        vector<ULONG> ids;
+        slotMap.ForEach([&ids](ULONG id, ULONG& /* value */)
+        {
+            ids.push_back(id);
+        });
+        Check(ids.size() == 2 && ids[0] == 90 && ids[1] == 100, L"IdSlotMap: ForEach visits the ids in ascending order", failures);
+
+        // Empty slots at the end are trimmed straight away, and erasing the last id clears the map
+        slotMap.erase(100);
+        Check(slotMap.size() == 1 && slotMap.slotCount() == 1, L"IdSlotMap: erasing the highest id trims the end", failures);
+        slotMap.erase(90);
+        Check(slotMap.empty() && slotMap.slotCount() == 0, L"IdSlotMap: erasing every id releases the slots", failures);
+
+        // Empty slots at the front are only compacted once there are enough of them and they are half of the slots
+        for (ULONG id = 1; id <= 200; id++)
+        {
+            slotMap[id] = id;
+        }
+
+        for (ULONG id = 1; id < 100; id++)
+        {
+            slotMap.erase(id);
+        }
+        Check(slotMap.slotCount() == 200, L"IdSlotMap: the front is skipped while it is less than half of the slots", failures);
+
+        slotMap.erase(100);
+        Check(slotMap.size() == 100 && slotMap.slotCount() == 100, L"IdSlotMap: the front is compacted once it is half of the slots", failures);
+        Check(slotMap.find(100) == nullptr && slotMap.find(101) != nullptr && *slotMap.find(101) == 101 && slotMap.find(200) != nullptr && *slotMap.find(200) == 200, L"IdSlotMap: values are still found after compacting", failures);
+
+        slotMap[1] = 1;
+        Check(slotMap.size() == 101 && slotMap.slotCount() == 200 && slotMap.find(1) != nullptr, L"IdSlotMap: an id below a compacted base rebases again", failures);
+
+        slotMap.clear();
+        Check(slotMap.empty() && slotMap.slotCount() == 0 && slotMap.find(1) == nullptr, L"IdSlotMap: clear releases every slot", failures);
+    }
+
+    void CheckIdBitSet(_Inout_ vector<CString>& failures)
+    {
+        IdBitSet bitSet;
+
+        bitSet.insert(50);
+        bitSet.insert(40);
+        Check(bitSet.size() == 2 && bitSet.slotCount() == 11 && bitSet.contains(40) && bitSet.contains(50) && !bitSet.contains(45), L"IdBitSet: rebasing to a lower id keeps only the range between the ids", failures);
+
+        ULONG nextId = 0;
+        Check(bitSet.FindNext(0, nextId) && nextId == 40 && bitSet.FindNext(41, nextId) && nextId == 50 && !bitSet.FindNext(51, nextId), L"IdBitSet: FindNext returns the lowest id at or after the one given", failures);
+
+        bitSet.erase(50);
+        bitSet.erase(40);
+        Check(bitSet.empty() && bitSet.slotCount() == 0, L"IdBitSet: erasing every id releases the bits", failures);
+
+        for (ULONG id = 1; id <= 600; id++)
+        {
+            bitSet.insert(id);
+        }
+
+        for (ULONG id = 1; id < 300; id++)
+        {
+            bitSet.erase(id);
+        }
+        Check(bitSet.slotCount() == 600, L"IdBitSet: the front is skipped while it is less than half of the bits", failures);
+
+        bitSet.erase(300);
+        Check(bitSet.size() == 300 && bitSet.slotCount() == 300 && !bitSet.contains(300) && bitSet.contains(301) && bitSet.contains(600), L"IdBitSet: the front is compacted once it is half of the bits", failures);
+    }
+
+    void CheckLineIndex(_Inout_ vector<CString>& failures)
+    {
+        // \r\n, \n and \r each end a line, with \r\n counted as a single terminator
+        LineIndex lineIndex;
+        SourceController::BuildLineIndex(CString(L"a\r\nb\nc\rd"), lineIndex);
+        Check(lineIndex.textLength == 8 && lineIndex.lineStarts.size() == 4 && lineIndex.lineStarts[0] == 0 && lineIndex.lineStarts[1] == 3 && lineIndex.lineStarts[2] == 5 && lineIndex.lineStarts[3] == 7, L"LineIndex: each kind of line terminator starts a new line", failures);
+
+        SourceController::BuildLineIndex(CString(L"\r\r\n\n"), lineIndex);
+        Check(lineIndex.textLength == 4 && lineIndex.lineStarts.size() == 4 && lineIndex.lineStarts[1] == 1 && lineIndex.lineStarts[2] == 3 && lineIndex.lineStarts[3] == 4, L"LineIndex: terminators next to each other give empty lines", failures);
+
+        SourceController::BuildLineIndex(CString(L""), lineIndex);
+        Check(lineIndex.textLength == 0 && lineIndex.lineStarts.size() == 1 && lineIndex.lineStarts[0] == 0, L"LineIndex: empty text has a single line", failures);
+    }
+
+    void CheckTracepointExpression(_In_ LPCWSTR pMessageTemplate, _In_ LPCWSTR pExpected, _Inout_ vector<CString>& failures)
+    {
+        CString expressionText;
+        ThreadController::BuildTracepointExpression(CComBSTR(pMessageTemplate), expressionText);
+        if (expressionText != pExpected)
+        {
+            CString failure;
+            failure.Format(L"BuildTracepointExpression: \"%s\" gave %s", pMessageTemplate, static_cast<LPCWSTR>(expressionText));
+            failures.push_back(failure);
+        }
+    }
+
+    void CheckTracepointExpressions(_Inout_ vector<CString>& failures)
+    {
+        // Literal text is quoted and each {expression} is evaluated in place
+        CheckTracepointExpression(L"x is {x}!", L"\"\"+\"x is \"+(x)+\"!\"", failures);
+        CheckTracepointExpression(L"{ a }{}{b}", L"\"\"+(a)+(b)", failures);
+        CheckTracepointExpression(L"say \"hi\" {n}", L"\"\"+\"say \\\"hi\\\" \"+(n)", failures);
+
+        // A brace that is never closed is just text
+        CheckTracepointExpression(L"open {x", L"\"\"+\"open {x\"", failures);
+        CheckTracepointExpression(L"", L"\"\"", failures);
+    }
+
+    void CheckUrlPatterns(_Inout_ vector<CString>& failures)
+    {
+        // '*' matches any run of characters, including none, and the match ignores case
+        Check(ExceptionFilter::MatchesPattern(L"http://host/lib/jquery.min.js", L"*jquery*"), L"MatchesPattern: '*' on both ends matches inside the url", failures);
+        Check(ExceptionFilter::MatchesPattern(L"HTTP://Host/app.js", L"http://host/*"), L"MatchesPattern: the match ignores case", failures);
+        Check(ExceptionFilter::MatchesPattern(L"abc", L"a*b*c") && ExceptionFilter::MatchesPattern(L"abbbc", L"a*b*c"), L"MatchesPattern: several '*' backtrack to the latest one", failures);
+        Check(ExceptionFilter::MatchesPattern(L"", L"*") && ExceptionFilter::MatchesPattern(L"abc", L"abc**"), L"MatchesPattern: '*' matches an empty run", failures);
+
+        // The whole url has to match, not just a prefix or a suffix
+        Check(!ExceptionFilter::MatchesPattern(L"http://host/app.js", L"*.css"), L"MatchesPattern: a different extension does not match", failures);
+        Check(!ExceptionFilter::MatchesPattern(L"ac", L"a*b*c"), L"MatchesPattern: every literal part of the pattern is needed", failures);
+        Check(!ExceptionFilter::MatchesPattern(L"http://host/app.js", L"http://host/app"), L"MatchesPattern: a pattern without '*' does not match a longer url", failures);
+        Check(!ExceptionFilter::MatchesPattern(L"abc", L""), L"MatchesPattern: an empty pattern only matches an empty url", failures);
+    }
+
+    void RunAll(_Inout_ vector<CString>& failures)
+    {
+        CheckIdSlotMap(failures);
+        CheckIdBitSet(failures);
+        CheckLineIndex(failures);
+        CheckTracepointExpressions(failures);
+        CheckUrlPatterns(failures);
+    }
+}
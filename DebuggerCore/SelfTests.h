@@ -0,0 +1,22 @@
+//
+// Copyright (C) Microsoft. All rights reserved.
+//
+
+#pragma once
+
+using namespace ATL;
+using namespace std;
+
+//+----------------------------------------------------------------------------
+//
+//  Namespace:  SelfTests
+//
+//  Synopsis:   Checks of the parts of the debugger that are pure logic, and so
+//              need neither a script engine nor the PDM to run. They are run
+//              by the Custom.runSelfTests request from the replay tests, and
+//              each check that does not hold is reported by its description.
+//
+namespace SelfTests
+{
+    void RunAll(_Inout_ vector<CString>& failures);
+}
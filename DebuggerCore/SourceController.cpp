@@ -10,13 +10,21 @@
 ULONG SourceController::s_nextDocId = 1;
 ULONG SourceController::s_nextBpId = 1;
 
+const int SourceController::s_maxSourceTextFetchAttempts = 3;
+
+// The bytes of dynamic code text that are kept cached before the least recently used documents are dropped from the caches
+const ULONG SourceController::s_defaultDynamicTextBudget = 32 * 1024 * 1024;
+
 SourceController::SourceController() :
     m_dispatchThreadId(::GetCurrentThreadId()), // We are always created on the dispatch thread
     m_hwndDebugPipeHandler(nullptr),
     m_isBreakingOnNewWorker(false),
     m_shouldBindBreakpoints(true),
     m_isEnabled(false),
-    m_isEventListenerRegistered(false)
+    m_isEventListenerRegistered(false),
+    m_nextSourceTextVersion(1),
+    m_dynamicTextBytes(0),
+    m_dynamicTextBudget(SourceController::s_defaultDynamicTextBudget)
 {
 }
 
@@ -69,19 +77,31 @@ HRESULT SourceController::Clear()
 
     // Document changes
     m_removedDocuments.clear();
-    m_updatedDocumentInfoMap.clear();
+    m_updatedDocuments.clear();
     m_resolvedBreakpointsMap.clear();
-    m_currentDocumentInfoMap.clear();
+    m_currentDocuments.clear();
 
     // Source nodes
     m_sourceNodeMap.clear();
     m_documentInfoMap.clear();
+    m_documentsAtUrlMap.clear();
     m_sourceNodeAtApplicationMap.clear();
+    m_codeLocationCache.clear();
+    m_sourceTextCache.clear();
+    m_lineIndexCache.clear();
+    m_dynamicTextAtHashMap.clear();
+    m_dynamicTextLru.clear();
+    m_dynamicTextLruMap.clear();
+    m_dynamicTextBytes = 0;
+    m_dynamicDocumentInfo = DynamicDocumentInfo();
 
     // Breakpoints
     m_breakpointsMap.clear();
     m_breakpointsAtDocIdMap.clear();
+    m_pendingBreakpointIds.clear();
+    m_breakpointsAtLocationMap.clear();
     m_breakpointsAtUrlMap.clear();
+    m_breakpointsAtUrlRegex.clear();
 
     return S_OK;
 }
@@ -194,6 +214,26 @@ HRESULT SourceController::GetBreakpointInfosForEventBreak(_In_ const CString& ev
     return hr;
 }
 
+HRESULT SourceController::GetDocumentUrl(_In_ ULONG docId, _Out_ CComBSTR& url)
+{
+    // Can be called by either thread
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    url.Empty();
+
+    auto pDocument = m_documentInfoMap.find(docId);
+    if (pDocument == nullptr)
+    {
+        return E_NOT_FOUND;
+    }
+
+    url = pDocument->first->url;
+
+    return S_OK;
+}
+
 // Dispatch Operations
 HRESULT SourceController::RefreshSources(_Inout_ vector<shared_ptr<DocumentInfo>>& added, _Inout_ vector<shared_ptr<DocumentInfo>>& updated, _Inout_ vector<ULONG>& removed, _Inout_ vector<shared_ptr<ReboundBreakpointInfo>>& rebound)
 {
@@ -217,28 +257,25 @@ HRESULT SourceController::RefreshSources(_Inout_ vector<shared_ptr<DocumentInfo>
         // Remove them from the current list
         for (const auto& docId : removed)
         {
-            m_currentDocumentInfoMap.erase(docId);
+            m_currentDocuments.erase(docId);
         }
 
         m_removedDocuments.clear();
     }
 
     // Search the updated documents for ones that are new or updated, and then add them to the current map
-    for (const auto& dirtyDoc : m_updatedDocumentInfoMap)
+    m_updatedDocuments.ForEach([&](ULONG docId)
     {
-        ULONG docId = dirtyDoc.first;
-
         // Get the actual docInfo
-        auto docInfoTextPair = m_documentInfoMap.find(docId);
-        if (docInfoTextPair != m_documentInfoMap.end()) 
+        auto pDocInfoTextPair = m_documentInfoMap.find(docId);
+        if (pDocInfoTextPair != nullptr) 
         {
-            const shared_ptr<DocumentInfo>& docInfo = docInfoTextPair->second.first;
+            const shared_ptr<DocumentInfo>& docInfo = pDocInfoTextPair->first;
 
-            auto itDocument = m_currentDocumentInfoMap.find(docId);
-            if (itDocument == m_currentDocumentInfoMap.end())
+            if (!m_currentDocuments.contains(docId))
             {
                 // Newly added document
-                m_currentDocumentInfoMap[docId] = true;
+                m_currentDocuments.insert(docId);
                 added.push_back(docInfo);
             }
             else
@@ -247,7 +284,7 @@ HRESULT SourceController::RefreshSources(_Inout_ vector<shared_ptr<DocumentInfo>
                 updated.push_back(docInfo);
             }
         }
-    }
+    });
 
     // Update the resolved breakpoints
     for (auto& resolvedPair : m_resolvedBreakpointsMap)
@@ -282,7 +319,7 @@ HRESULT SourceController::RefreshSources(_Inout_ vector<shared_ptr<DocumentInfo>
     }
 
     m_resolvedBreakpointsMap.clear();
-    m_updatedDocumentInfoMap.clear();
+    m_updatedDocuments.clear();
 
     return S_OK;
 }
@@ -295,57 +332,199 @@ HRESULT SourceController::GetSourceText(_In_ ULONG docId, _Out_ CComBSTR& source
     // Lock the source access
     CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
 
-    HRESULT hr = S_OK;
+    shared_ptr<const SourceText> spSourceText;
+    HRESULT hr = this->GetSourceTextSnapshot(docId, spSourceText);
+    if (hr == S_OK)
+    {
+        sourceText.Attach(::SysAllocStringLen(spSourceText->text, spSourceText->text.GetLength()));
+        ATLENSURE_RETURN_HR(sourceText.m_str != nullptr, E_OUTOFMEMORY);
+    }
+
+    return hr;
+}
+
+HRESULT SourceController::GetLineColumnFromOffset(_In_ ULONG docId, _In_ ULONG offset, _Out_ ULONG& lineNumber, _Out_ ULONG& columnNumber)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+    ATLENSURE_RETURN_HR(m_spDebugApplication.p != nullptr, E_NOT_VALID_STATE);
+
+    lineNumber = 0;
+    columnNumber = 0;
+
+    shared_ptr<const LineIndex> spLineIndex;
+    HRESULT hr = this->GetLineIndex(docId, spLineIndex);
+    BPT_FAIL_IF_NOT_S_OK(hr);
+
+    // Offsets past the end of the text are reported on the last line
+    offset = min(offset, spLineIndex->textLength);
 
-    auto it = m_documentInfoMap.find(docId);
-    if (it != m_documentInfoMap.end())
+    // Find the last line that starts at or before the offset
+    const vector<ULONG>& lineStarts = spLineIndex->lineStarts;
+    auto itLine = std::upper_bound(lineStarts.begin(), lineStarts.end(), offset);
+    ATLENSURE_RETURN_HR(itLine != lineStarts.begin(), E_UNEXPECTED); // The first line always starts at 0
+    --itLine;
+
+    lineNumber = static_cast<ULONG>(itLine - lineStarts.begin());
+    columnNumber = offset - *itLine;
+
+    return S_OK;
+}
+
+HRESULT SourceController::GetOffsetFromLineColumn(_In_ ULONG docId, _In_ ULONG lineNumber, _In_ ULONG columnNumber, _Out_ ULONG& offset)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+    ATLENSURE_RETURN_HR(m_spDebugApplication.p != nullptr, E_NOT_VALID_STATE);
+
+    offset = 0;
+
+    shared_ptr<const LineIndex> spLineIndex;
+    HRESULT hr = this->GetLineIndex(docId, spLineIndex);
+    BPT_FAIL_IF_NOT_S_OK(hr);
+
+    const vector<ULONG>& lineStarts = spLineIndex->lineStarts;
+    ATLENSURE_RETURN_HR(lineNumber < lineStarts.size(), E_INVALIDARG);
+
+    // Columns past the end of the line are clamped to the start of the next line
+    ULONG lineStart = lineStarts[lineNumber];
+    ULONG lineEnd = (lineNumber + 1 < lineStarts.size() ? lineStarts[lineNumber + 1] : spLineIndex->textLength);
+    offset = lineStart + min(columnNumber, lineEnd - lineStart);
+
+    return S_OK;
+}
+
+HRESULT SourceController::SearchInContent(_In_ ULONG docId, _In_ const CComBSTR& query, _In_ bool isCaseSensitive, _In_ bool isRegex, _Inout_ vector<SearchMatch>& matches)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+    ATLENSURE_RETURN_HR(m_spDebugApplication.p != nullptr, E_NOT_VALID_STATE);
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    shared_ptr<const SourceText> spSourceText;
+    HRESULT hr = this->GetSourceTextSnapshot(docId, spSourceText);
+    BPT_FAIL_IF_NOT_S_OK(hr);
+
+    shared_ptr<const LineIndex> spLineIndex;
+    hr = this->GetLineIndex(docId, spLineIndex);
+    BPT_FAIL_IF_NOT_S_OK(hr);
+
+    UINT queryLength = query.Length();
+    if (queryLength == 0)
     {
-        CComPtr<IDebugDocumentText> spDebugDocumentText(it->second.second);
+        // An empty query matches nothing
+        return S_OK;
+    }
 
-        if (spDebugDocumentText == nullptr)
+    const vector<ULONG>& lineStarts = spLineIndex->lineStarts;
+    LPCWSTR pText = spSourceText->text;
+    const ULONG textLength = spLineIndex->textLength;
+
+    // Gets the range of a line without its terminator
+    auto getLineEnd = [&](ULONG line) -> ULONG
+    {
+        ULONG lineEnd = (line + 1 < lineStarts.size() ? lineStarts[line + 1] : textLength);
+        while (lineEnd > lineStarts[line] && (pText[lineEnd - 1] == L'\n' || pText[lineEnd - 1] == L'\r'))
         {
-            // Document without text, e.g. root node
-            sourceText = L"";
+            lineEnd--;
         }
-        else
-        {
-            // Get the source text size
-            ULONG cLines = 0;
-            ULONG cChars = 0;
-            hr = spDebugDocumentText->GetSize(&cLines, &cChars);
-            BPT_FAIL_IF_NOT_S_OK(hr);
+        return lineEnd;
+    };
+
+    auto addMatch = [&](ULONG line)
+    {
+        SearchMatch match;
+        match.lineNumber = line;
+        match.lineContent.Attach(::SysAllocStringLen(pText + lineStarts[line], getLineEnd(line) - lineStarts[line]));
+        matches.push_back(match);
+    };
 
-            if (cChars == 0)
+    if (isRegex)
+    {
+        // The ECMAScript grammar matches what the front end expects for a JavaScript regex
+        std::wregex expression;
+        try
+        {
+            auto flags = std::regex_constants::ECMAScript | std::regex_constants::optimize;
+            if (!isCaseSensitive)
             {
-                // No text
-                sourceText = L"";
-                return S_OK;
+                flags |= std::regex_constants::icase;
             }
 
-            // Allocate buffer for source text and attributes
-            ULONG size = cChars * sizeof(WCHAR);
-            std::shared_ptr<void> spSrcText(::CoTaskMemAlloc(size), ::CoTaskMemFree);
-            ATLENSURE_RETURN_HR(spSrcText.get() != nullptr, E_OUTOFMEMORY);
-
-            // Get the source text and attributes
-            ULONG cchSrcText = 0;
-            hr = spDebugDocumentText->GetText(0, (WCHAR*)spSrcText.get(), nullptr, &cchSrcText, cChars);
+            expression.assign(query.m_str, queryLength, flags);
+        }
+        catch (const std::regex_error&)
+        {
+            return E_INVALIDARG;
+        }
 
-            if (cchSrcText != cChars)
+        // Each line is searched on its own so that anchors and matches do not span lines.
+        // The search itself can throw on long minified lines (error_complexity/error_stack), which gives no matches rather than a partial list.
+        const size_t previousMatchCount = matches.size();
+        try
+        {
+            for (ULONG line = 0; line < lineStarts.size(); line++)
             {
-                // The page was probably loading between GetSize(...) and GetText(...) calls.
-                return E_NOT_VALID_STATE;
+                if (std::regex_search(pText + lineStarts[line], pText + getLineEnd(line), expression))
+                {
+                    addMatch(line);
+                }
             }
-
-            sourceText.Attach(::SysAllocStringLen((const WCHAR*)spSrcText.get(), cChars));
+        }
+        catch (const std::regex_error&)
+        {
+            matches.resize(previousMatchCount);
         }
     }
     else
     {
-        hr = E_NOT_FOUND;
+        // Case insensitive searches run over lower case copies, which keeps every offset the same as the original text
+        CString lowerText;
+        CString lowerQuery;
+        LPCWSTR pSearchText = pText;
+        LPCWSTR pQuery = query.m_str;
+        if (!isCaseSensitive)
+        {
+            lowerText = spSourceText->text;
+            lowerText.MakeLower();
+            lowerQuery = query.m_str;
+            lowerQuery.MakeLower();
+            pSearchText = lowerText;
+            pQuery = lowerQuery;
+        }
+
+        // Skip quickly to each candidate first character, and only compare the rest of the query there
+        const WCHAR firstChar = pQuery[0];
+        ULONG position = 0;
+        while (position + queryLength <= textLength)
+        {
+            LPCWSTR pCandidate = ::wmemchr(pSearchText + position, firstChar, textLength - queryLength - position + 1);
+            if (pCandidate == nullptr)
+            {
+                break;
+            }
+
+            position = static_cast<ULONG>(pCandidate - pSearchText);
+            if (::wmemcmp(pCandidate + 1, pQuery + 1, queryLength - 1) == 0)
+            {
+                // Report the line once, and continue from the start of the next line
+                ULONG line = static_cast<ULONG>(std::upper_bound(lineStarts.begin(), lineStarts.end(), position) - lineStarts.begin()) - 1;
+                addMatch(line);
+
+                if (line + 1 >= lineStarts.size())
+                {
+                    break;
+                }
+
+                position = lineStarts[line + 1];
+            }
+            else
+            {
+                position++;
+            }
+        }
     }
 
-    return hr;
+    return S_OK;
 }
 
 HRESULT SourceController::GetCodeContext(_In_ ULONG docId, _In_ ULONG start, _Out_ CComPtr<IDebugCodeContext>& spDebugCodeContext)
@@ -353,6 +532,21 @@ HRESULT SourceController::GetCodeContext(_In_ ULONG docId, _In_ ULONG start, _Ou
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
     ATLENSURE_RETURN_HR(m_spDebugApplication.p != nullptr, E_NOT_VALID_STATE);
 
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    // Use an already resolved context if we have one
+    auto pCodeLocations = m_codeLocationCache.find(docId);
+    if (pCodeLocations != nullptr)
+    {
+        auto itCodeLocation = pCodeLocations->find(start);
+        if (itCodeLocation != pCodeLocations->end())
+        {
+            spDebugCodeContext = itCodeLocation->second.spDebugCodeContext;
+            return S_OK;
+        }
+    }
+
     return this->GetCodeContextFromDocId(docId, start, spDebugCodeContext);
 }
 
@@ -375,24 +569,13 @@ HRESULT SourceController::AddCodeBreakpoint(_In_ ULONG docId, _In_ ULONG start,
     spBreakpointInfo->isBound = false;   
     spBreakpointInfo->isEnabled = false;
 
-    // Try to add to this location
+    // Try to add to this location, a failure to get the source location is propagated to the caller
     CComPtr<IDebugCodeContext> spDebugCodeContext;
-    HRESULT hrContext = this->GetCodeContext(docId, start, spDebugCodeContext);
+    shared_ptr<SourceLocationInfo> spSourceLocationInfo;
+    HRESULT hrContext = this->GetCodeLocationFromDocId(docId, start, spDebugCodeContext, spSourceLocationInfo);
     if (hrContext == S_OK || hrContext == E_PENDING)
     {
-        shared_ptr<SourceLocationInfo> spSourceLocationInfo;
-        if (hrContext == S_OK)
-        {
-            // Valid code context, so try for a source location
-            HRESULT hrSourceLoc = this->GetSourceLocation(spDebugCodeContext, spSourceLocationInfo);
-            if (hrSourceLoc != S_OK)
-            {
-                // Failed to get the source location, so we cannot add a breakpoint here
-                // Propagate that error to the caller
-                return hrSourceLoc;
-            }
-        }
-        else
+        if (hrContext == E_PENDING)
         {
             // E_PENDING requires a refresh before we can bind the breakpoint
             // so generate a temp source location
@@ -417,10 +600,10 @@ HRESULT SourceController::AddCodeBreakpoint(_In_ ULONG docId, _In_ ULONG start,
             // Create a new breakpoint
 
             // Get the info for the URL
-            auto itMap = m_documentInfoMap.find(docId);
-            ATLENSURE_RETURN_HR(itMap != m_documentInfoMap.end(), E_NOT_FOUND); // This shouldn't happen since we need to have the info in order to get the source location above
+            auto pDocInfoTextPair = m_documentInfoMap.find(docId);
+            ATLENSURE_RETURN_HR(pDocInfoTextPair != nullptr, E_NOT_FOUND); // This shouldn't happen since we need to have the info in order to get the source location above
 
-            shared_ptr<DocumentInfo> spDocumentInfo(itMap->second.first);
+            shared_ptr<DocumentInfo> spDocumentInfo(pDocInfoTextPair->first);
 
             // Success, so populate the final information
             spBreakpointInfo->url = spDocumentInfo->url;
@@ -504,12 +687,26 @@ HRESULT SourceController::AddEventBreakpoint(_In_ shared_ptr<vector<CComBSTR>> e
     return hr;
 }
 
-HRESULT SourceController::AddPendingBreakpoint(_In_ const CComBSTR& url, _In_ ULONG start, _In_ const CComBSTR& condition, _In_ bool isEnabled, _In_ bool isTracepoint, _Out_ ULONG& pBreakpointId)
+HRESULT SourceController::AddPendingBreakpoint(_In_ const CComBSTR& url, _In_ bool isUrlRegex, _In_ ULONG start, _In_ const CComBSTR& condition, _In_ bool isEnabled, _In_ bool isTracepoint, _Out_ ULONG& pBreakpointId)
 {
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
     ATLENSURE_RETURN_HR(m_spDebugApplication.p != nullptr, E_NOT_VALID_STATE);
     ATLASSERT(url.Length() > 0);
 
+    // Compile a url regex up front, so that each new document only has to run it
+    UrlRegexBreakpoint urlRegexBreakpoint;
+    if (isUrlRegex)
+    {
+        try
+        {
+            urlRegexBreakpoint.urlRegex.assign(url.m_str, url.Length(), std::regex_constants::ECMAScript | std::regex_constants::optimize);
+        }
+        catch (const std::regex_error&)
+        {
+            return E_INVALIDARG;
+        }
+    }
+
     // Lock the source access
     CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
 
@@ -530,6 +727,7 @@ HRESULT SourceController::AddPendingBreakpoint(_In_ const CComBSTR& url, _In_ UL
     spBreakpointInfo->isTracepoint = isTracepoint; 
     spBreakpointInfo->isBound = false;   
     spBreakpointInfo->isEnabled = isEnabled;
+    spBreakpointInfo->isUrlRegex = isUrlRegex;
 
     // Add breakpoint to the maps, so that it is bound when a new document with that url is added
     HRESULT hr = this->AddBreakpointInternal(spBreakpointInfo);
@@ -537,11 +735,52 @@ HRESULT SourceController::AddPendingBreakpoint(_In_ const CComBSTR& url, _In_ UL
 
     pBreakpointId = spBreakpointInfo->id;
 
+    if (isUrlRegex)
+    {
+        urlRegexBreakpoint.breakpointId = spBreakpointInfo->id;
+        m_breakpointsAtUrlRegex.push_back(std::move(urlRegexBreakpoint));
+    }
+
     if (m_isEnabled)
     {
-        hr = this->RebindAllCodeBreakpoints();
-        BPT_FAIL_IF_NOT_S_OK(hr);
+        m_shouldBindBreakpoints = true;
+
+        // Only the documents that this breakpoint can match are tried, rather than rebinding every breakpoint in every document
+        if (isUrlRegex)
+        {
+            const std::wregex& urlRegex = m_breakpointsAtUrlRegex.back().urlRegex;
+            m_documentInfoMap.ForEach([this, &spBreakpointInfo, &urlRegex](ULONG /* docId */, const pair<shared_ptr<DocumentInfo>, CComPtr<IDebugDocumentText>>& docInfoTextPair)
+            {
+                const CComBSTR& docUrl = docInfoTextPair.first->url;
+                if (!spBreakpointInfo->isBound && SourceController::MatchesUrlRegex(docUrl, urlRegex))
+                {
+                    this->BindBreakpoint(spBreakpointInfo, docInfoTextPair.first);
+                }
+            });
+        }
+        else
+        {
+            auto itDocsAtUrl = m_documentsAtUrlMap.find(SourceController::NormalizeUrl(url));
+            if (itDocsAtUrl != m_documentsAtUrlMap.end())
+            {
+                for (ULONG docId : itDocsAtUrl->second)
+                {
+                    auto pDocInfoTextPair = m_documentInfoMap.find(docId);
+                    if (pDocInfoTextPair != nullptr && this->BindBreakpoint(spBreakpointInfo, pDocInfoTextPair->first) == S_OK)
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+
+        // Fire an event for the rebind, there is nothing to report if no loaded document matched
+        if (spBreakpointInfo->isBound)
+        {
+            m_spMessageQueue->Push(PDMEventType::SourceUpdated);
+        }
     }
+
     return hr;
 }
 
@@ -568,10 +807,13 @@ HRESULT SourceController::RemoveBreakpoint(_In_ ULONG breakpointId)
             // Remove it from our maps
             if (it->second->spSourceLocation != nullptr) // Only Code breakpoints have a source location
             {
-                auto itBreakpointsAtDocId = m_breakpointsAtDocIdMap.find(it->second->spSourceLocation->docId);
-                if (itBreakpointsAtDocId != m_breakpointsAtDocIdMap.end())
+                this->RemoveBreakpointLocation(it->second);
+
+                ULONG docId = it->second->spSourceLocation->docId;
+                auto pBreakpointsAtDocId = this->FindBreakpointsAtDocId(docId);
+                if (pBreakpointsAtDocId != nullptr)
                 {
-                    auto& list = itBreakpointsAtDocId->second;
+                    auto& list = *pBreakpointsAtDocId;
                     list.erase(std::remove_if(list.begin(), list.end(), [breakpointId](const ULONG& id) { 
                         return id == breakpointId; 
                     }),
@@ -579,22 +821,32 @@ HRESULT SourceController::RemoveBreakpoint(_In_ ULONG breakpointId)
 
                     if (list.empty())
                     {
-                        m_breakpointsAtDocIdMap.erase(itBreakpointsAtDocId);
+                        this->EraseBreakpointsAtDocId(docId);
                     }
                 }
 
-                auto itBreakpointsAtUrl = m_breakpointsAtUrlMap.find(it->second->url);
-                if (itBreakpointsAtUrl != m_breakpointsAtUrlMap.end())
+                if (it->second->isUrlRegex)
                 {
-                    auto& list = itBreakpointsAtUrl->second;
-                    list.erase(std::remove_if(list.begin(), list.end(), [breakpointId](const ULONG& id) { 
-                        return id == breakpointId; 
+                    m_breakpointsAtUrlRegex.erase(std::remove_if(m_breakpointsAtUrlRegex.begin(), m_breakpointsAtUrlRegex.end(), [breakpointId](const UrlRegexBreakpoint& regexBreakpoint) {
+                        return regexBreakpoint.breakpointId == breakpointId;
                     }),
-                        list.end());
-
-                    if (list.empty())
+                        m_breakpointsAtUrlRegex.end());
+                }
+                else
+                {
+                    auto itBreakpointsAtUrl = m_breakpointsAtUrlMap.find(SourceController::NormalizeUrl(it->second->url));
+                    if (itBreakpointsAtUrl != m_breakpointsAtUrlMap.end())
                     {
-                        m_breakpointsAtUrlMap.erase(itBreakpointsAtUrl);
+                        auto& list = itBreakpointsAtUrl->second;
+                        list.erase(std::remove_if(list.begin(), list.end(), [breakpointId](const ULONG& id) { 
+                            return id == breakpointId; 
+                        }),
+                            list.end());
+
+                        if (list.empty())
+                        {
+                            m_breakpointsAtUrlMap.erase(itBreakpointsAtUrl);
+                        }
                     }
                 }
             }
@@ -678,10 +930,10 @@ HRESULT SourceController::RebindAllCodeBreakpoints()
 
     m_shouldBindBreakpoints = true;
 
-    for (const auto& map : m_documentInfoMap)
+    m_documentInfoMap.ForEach([this](ULONG /* docId */, const pair<shared_ptr<DocumentInfo>, CComPtr<IDebugDocumentText>>& docInfoTextPair)
     {
-        this->RebindBreakpoints(map.second.first);
-    }
+        this->RebindBreakpoints(docInfoTextPair.first);
+    });
 
     // Fire an event for the rebind
     m_spMessageQueue->Push(PDMEventType::SourceUpdated);  
@@ -698,10 +950,10 @@ HRESULT SourceController::UnbindAllCodeBreakpoints(_In_ const bool removeFromEng
 
     m_shouldBindBreakpoints = false;
 
-    for (const auto& map : m_documentInfoMap)
+    m_documentInfoMap.ForEach([this, removeFromEngine](ULONG docId, const pair<shared_ptr<DocumentInfo>, CComPtr<IDebugDocumentText>>& /* docInfoTextPair */)
     {
-        this->UnbindBreakpoints(map.first, removeFromEngine);
-    }
+        this->UnbindBreakpoints(docId, removeFromEngine);
+    });
 
     // Fire an event for the unbind
     m_spMessageQueue->Push(PDMEventType::SourceUpdated);  
@@ -839,6 +1091,46 @@ HRESULT SourceController::SetBreakOnNewWorker(_In_ bool enable)
     return S_OK;
 }
 
+HRESULT SourceController::SetDynamicTextBudget(_In_ ULONG budgetBytes)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    m_dynamicTextBudget = budgetBytes;
+
+    // A smaller budget takes effect straight away rather than on the next text that is fetched
+    this->EnforceDynamicTextBudget(/*keepDocId=*/ 0);
+
+    return S_OK;
+}
+
+HRESULT SourceController::GetDynamicDocumentInfo(_Out_ DynamicDocumentInfo& info)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    info = m_dynamicDocumentInfo;
+    info.cachedDocuments = static_cast<ULONG>(m_dynamicTextLru.size());
+    info.cachedBytes = m_dynamicTextBytes;
+    info.budgetBytes = m_dynamicTextBudget;
+
+    // This is only asked for occasionally, so count the documents rather than keeping a running total up to date
+    info.dynamicDocuments = 0;
+    m_documentInfoMap.ForEach([&info](ULONG /* docId */, const pair<shared_ptr<DocumentInfo>, CComPtr<IDebugDocumentText>>& docInfoTextPair)
+    {
+        if (docInfoTextPair.first->isDynamicCode)
+        {
+            info.dynamicDocuments++;
+        }
+    });
+
+    return S_OK;
+}
+
 // PDM Event Notifications
 HRESULT SourceController::OnAddChild(_In_ ULONG parentId, _In_ IDebugApplicationNode* pChildNode)
 {
@@ -893,10 +1185,10 @@ HRESULT SourceController::OnUpdate(_In_ ULONG docId)
     // Lock the source access
     CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
 
-    auto it = m_sourceNodeMap.find(docId);
-    if (it != m_sourceNodeMap.end())
+    auto pSourceNode = m_sourceNodeMap.find(docId);
+    if (pSourceNode != nullptr)
     {
-        CComObjPtr<SourceNode> spNode(it->second);
+        CComObjPtr<SourceNode> spNode(*pSourceNode);
 
         HRESULT hr = spNode->UpdateInfo();
         BPT_FAIL_IF_NOT_S_OK(hr);
@@ -907,8 +1199,19 @@ HRESULT SourceController::OnUpdate(_In_ ULONG docId)
         hr = spNode->GetDocumentInfo(spDocInfo, spDebugDocumentText);
         BPT_FAIL_IF_NOT_S_OK(hr);
 
+        // The url may have changed with the update, so reindex the document under its new one
+        auto pDocInfoTextPair = m_documentInfoMap.find(docId);
+        if (pDocInfoTextPair != nullptr)
+        {
+            this->RemoveDocumentUrl(pDocInfoTextPair->first);
+        }
+
         m_documentInfoMap[docId] = pair<shared_ptr<DocumentInfo>, CComPtr<IDebugDocumentText>>(spDocInfo, spDebugDocumentText);
-        m_updatedDocumentInfoMap[docId] = true;
+        this->AddDocumentUrl(spDocInfo);
+        m_updatedDocuments.insert(docId);
+
+        // The text has changed, so previously resolved locations may no longer be valid
+        this->InvalidateCodeLocations(docId);
 
         // Since the text was just updated, we need to rebind breakpoints for this url in case more text
         // was added that has an unbound breakpoint waiting on it.
@@ -921,6 +1224,50 @@ HRESULT SourceController::OnUpdate(_In_ ULONG docId)
     return S_OK;
 }
 
+HRESULT SourceController::OnUpdateText(_In_ ULONG docId, _In_ SourceTextChange change, _In_ ULONG position, _In_ ULONG count)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnPDMThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    auto pSourceText = m_sourceTextCache.find(docId);
+    if (pSourceText == nullptr)
+    {
+        // Nothing has been cached yet, the text will be fetched in full when it is first requested
+        return S_OK;
+    }
+
+    HRESULT hr = E_NOT_FOUND;
+    shared_ptr<const SourceText> spNewText;
+    auto pDocInfoTextPair = m_documentInfoMap.find(docId);
+    if (pDocInfoTextPair != nullptr && pDocInfoTextPair->second != nullptr)
+    {
+        hr = this->ApplySourceTextChange(pDocInfoTextPair->second, *pSourceText, change, position, count, spNewText);
+    }
+
+    if (hr == S_OK)
+    {
+        *pSourceText = spNewText;
+
+        // The changed text has its own storage now, so charge it at its new size
+        if (m_dynamicTextLruMap.find(docId) != m_dynamicTextLruMap.end())
+        {
+            this->UntrackDynamicText(docId);
+            this->TrackDynamicText(docId, spNewText->text.GetLength() * sizeof(WCHAR));
+            this->EnforceDynamicTextBudget(docId);
+        }
+    }
+    else
+    {
+        // The delta could not be applied, so drop the cached text and fetch it in full next time
+        m_sourceTextCache.erase(docId);
+        this->UntrackDynamicText(docId);
+    }
+
+    return S_OK;
+}
+
 // Helper functions
 HRESULT SourceController::AddAllSourceNodes(_In_ IDebugApplicationNode* pRootNode, _In_ const ULONG& parentId)
 {
@@ -970,10 +1317,10 @@ HRESULT SourceController::AddNode(_In_ IDebugApplicationNode* pRootNode, _In_ co
     // See if we have a parent node
     ULONG parentDocId = INVALID_ASDFILEHANDLE;
     CComObjPtr<SourceNode> spParentNode;
-    auto it = m_sourceNodeMap.find(parentId);
-    if (it != m_sourceNodeMap.end())
+    auto pParentNode = m_sourceNodeMap.find(parentId);
+    if (pParentNode != nullptr)
     {
-        spParentNode = it->second;
+        spParentNode = *pParentNode;
         parentDocId = spParentNode->GetDocId();
     }
 
@@ -1006,7 +1353,8 @@ HRESULT SourceController::AddNode(_In_ IDebugApplicationNode* pRootNode, _In_ co
 
     // Store that info in our maps
     m_documentInfoMap[newId] = pair<shared_ptr<DocumentInfo>, CComPtr<IDebugDocumentText>>(spDocInfo, spDebugDocumentText);
-    m_updatedDocumentInfoMap[newId] = true;
+    this->AddDocumentUrl(spDocInfo);
+    m_updatedDocuments.insert(newId);
 
     // Rebind breakpoints for this url
     this->RebindBreakpoints(spDocInfo);
@@ -1030,21 +1378,21 @@ HRESULT SourceController::RemoveNode(_In_ IDebugApplicationNode* pRootNode, _In_
         ULONG docId = it->second;
 
         // Get the actual node
-        auto itSourceNode = m_sourceNodeMap.find(docId);
-        if (itSourceNode != m_sourceNodeMap.end())
+        auto pSourceNode = m_sourceNodeMap.find(docId);
+        if (pSourceNode != nullptr)
         {
             // Remove all the children recursively
             map<ULONG, bool> childrenMap;
-            itSourceNode->second->GetChildren(childrenMap);
+            (*pSourceNode)->GetChildren(childrenMap);
 
             for (const auto& childIdPair : childrenMap)
             {
                 ULONG childId = childIdPair.first;
-                auto itChildNode = m_sourceNodeMap.find(childId);
-                if (itChildNode != m_sourceNodeMap.end())
+                auto pChildNode = m_sourceNodeMap.find(childId);
+                if (pChildNode != nullptr)
                 {
                     CComPtr<IDebugApplicationNode> spDebugApplicationNode;
-                    hr = itChildNode->second->GetDebugApplicationNode(spDebugApplicationNode);
+                    hr = (*pChildNode)->GetDebugApplicationNode(spDebugApplicationNode);
                     BPT_FAIL_IF_NOT_S_OK(hr);
 
                     this->RemoveNode(spDebugApplicationNode, docId);
@@ -1052,20 +1400,29 @@ HRESULT SourceController::RemoveNode(_In_ IDebugApplicationNode* pRootNode, _In_
             }
         }
 
-        auto current = m_currentDocumentInfoMap.find(docId);
-        if (current != m_currentDocumentInfoMap.end())
+        if (m_currentDocuments.contains(docId))
         {
             // Remember that this document has been removed since the last refresh
             m_removedDocuments.push_back(docId);
         }
 
         // Remove anything that was updated prior to this removal
-        m_updatedDocumentInfoMap.erase(docId);
+        m_updatedDocuments.erase(docId);
         m_resolvedBreakpointsMap.erase(docId);
 
         // Remove the actual stored node
+        auto pDocInfoTextPair = m_documentInfoMap.find(docId);
+        if (pDocInfoTextPair != nullptr)
+        {
+            this->RemoveDocumentUrl(pDocInfoTextPair->first);
+        }
+
         m_sourceNodeMap.erase(docId);
         m_documentInfoMap.erase(docId);
+        this->InvalidateCodeLocations(docId);
+        m_sourceTextCache.erase(docId);
+        m_lineIndexCache.erase(docId);
+        this->UntrackDynamicText(docId);
 
         m_sourceNodeAtApplicationMap.erase(it);
 
@@ -1132,12 +1489,13 @@ HRESULT SourceController::GetSourceLocation(_In_ IDebugCodeContext* pDebugCodeCo
         else
         {
             // Due to an issue with document.write(), the source file may have been removed already, so we default the id to the main html page
-            auto docInfoIt = m_currentDocumentInfoMap.begin();
-            if (m_currentDocumentInfoMap.size() > 1)
+            ULONG defaultDocId;
+            m_currentDocuments.FindNext(0, defaultDocId);
+            if (m_currentDocuments.size() > 1)
             {
-                docInfoIt++;
+                m_currentDocuments.FindNext(defaultDocId + 1, defaultDocId);
             }
-            spSourceLocationInfo->docId = docInfoIt->first;
+            spSourceLocationInfo->docId = defaultDocId;
 
             // Also re-write the line and column info, since this is obviously not going to point to the correct location anymore
             spSourceLocationInfo->lineNumber = 1;
@@ -1160,7 +1518,7 @@ HRESULT SourceController::GetSourceLocation(_In_ IDebugCodeContext* pDebugCodeCo
         // This occurs when the script has already been freed by chakra, we return an error 
         // so that the caller can decide to either use the following fake data, or throw an assert.
         spSourceLocationInfo.reset(new SourceLocationInfo());
-        spSourceLocationInfo->docId = m_currentDocumentInfoMap.begin()->first;
+        m_currentDocuments.FindNext(0, spSourceLocationInfo->docId);
 
         hr = E_NOT_FOUND;
     }
@@ -1177,10 +1535,10 @@ HRESULT SourceController::GetCodeContextFromDocId(_In_ ULONG docId, _In_ ULONG s
 
     HRESULT hr = S_OK;
 
-    auto it = m_documentInfoMap.find(docId);
-    if (it != m_documentInfoMap.end())
+    auto pDocInfoTextPair = m_documentInfoMap.find(docId);
+    if (pDocInfoTextPair != nullptr)
     {
-        CComPtr<IDebugDocumentText> spDebugDocumentText(it->second.second);
+        CComPtr<IDebugDocumentText> spDebugDocumentText(pDocInfoTextPair->second);
 
         CComPtr<IDebugDocumentContext> spDebugDocumentContext;
         hr = spDebugDocumentText->GetContextOfPosition(start, 1,  &spDebugDocumentContext);
@@ -1231,65 +1589,312 @@ HRESULT SourceController::GetCodeContextFromDocId(_In_ ULONG docId, _In_ ULONG s
     return hr;
 }
 
-HRESULT SourceController::GetBreakpointIdFromSourceLocation(_In_ ULONG docId, _In_ ULONG start, _Out_ ULONG& breakpointId)
+HRESULT SourceController::GetCodeLocationFromDocId(_In_ ULONG docId, _In_ ULONG start, _Out_ CComPtr<IDebugCodeContext>& spDebugCodeContext, _Out_ shared_ptr<SourceLocationInfo>& spSourceLocationInfo)
 {
     // This can be called by either thread.
 
     // Lock the source access
     CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
 
-    breakpointId = 0;  // 0 is not a valid breakpointId
-
-    // Get the context for the given document id
-    CComPtr<IDebugCodeContext> spDebugCodeContext;
-    HRESULT hr = this->GetCodeContextFromDocId(docId, start, spDebugCodeContext);
-    if (hr == S_OK)
+    // Serve repeated lookups (such as a breakpoint inside a hot loop) without going back to the PDM
+    auto pCodeLocations = m_codeLocationCache.find(docId);
+    if (pCodeLocations != nullptr)
     {
-        // Valid code context, so try for a source location
-        shared_ptr<SourceLocationInfo> spSourceLocationInfo;
-        HRESULT hrSourceLoc = this->GetSourceLocation(spDebugCodeContext, spSourceLocationInfo);
-        if (hrSourceLoc != S_OK)
+        auto itCodeLocation = pCodeLocations->find(start);
+        if (itCodeLocation != pCodeLocations->end())
         {
-            // Failed to get the source location, so we cannot find a breakpoint here
-            // Propagate that error to the caller
-            return hrSourceLoc;
-        }
+            spDebugCodeContext = itCodeLocation->second.spDebugCodeContext;
 
-        // Find an existing breakpoint here
-        shared_ptr<BreakpointInfo> spExistingBp;
-        hr = this->FindExistingBreakpoint(spSourceLocationInfo, spExistingBp);
-        if (hr == S_OK)
-        {
-            // Found an existing breakpoint
-            breakpointId = spExistingBp->id;
+            // Callers take ownership of the location (e.g. for a breakpoint), so hand out a copy
+            spSourceLocationInfo.reset(new SourceLocationInfo(*itCodeLocation->second.spSourceLocationInfo));
+            return S_OK;
         }
     }
 
-    return hr;
+    HRESULT hr = this->GetCodeContextFromDocId(docId, start, spDebugCodeContext);
+    if (hr != S_OK)
+    {
+        return hr;
+    }
+
+    // Valid code context, so try for a source location
+    hr = this->GetSourceLocation(spDebugCodeContext, spSourceLocationInfo);
+    if (hr != S_OK)
+    {
+        return hr;
+    }
+
+    // Only fully resolved locations are remembered, failures are retried on the next call
+    CodeLocation& codeLocation = m_codeLocationCache[docId][start];
+    codeLocation.spDebugCodeContext = spDebugCodeContext;
+    codeLocation.spSourceLocationInfo.reset(new SourceLocationInfo(*spSourceLocationInfo));
+
+    return S_OK;
 }
 
-HRESULT SourceController::FindExistingBreakpoint(_In_ const shared_ptr<SourceLocationInfo>& spSourceLocationInfo, _Out_ shared_ptr<BreakpointInfo>& spBreakpointInfo)
+void SourceController::InvalidateCodeLocations(_In_ ULONG docId)
 {
     // This can be called by either thread.
 
     // Lock the source access
     CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
 
-    for (const auto& bp : m_breakpointsMap)
-    {
-        shared_ptr<BreakpointInfo> spBP(bp.second);
+    m_codeLocationCache.erase(docId);
+}
 
-        if (spBP->spSourceLocation != nullptr &&
-            spBP->spSourceLocation->docId == spSourceLocationInfo->docId && 
-            spBP->spSourceLocation->charPosition == spSourceLocationInfo->charPosition &&
-            spBP->spSourceLocation->contextCount == spSourceLocationInfo->contextCount)
-        {
-            spBreakpointInfo = spBP;
-            return S_OK;
-        }
-    }
+HRESULT SourceController::GetSourceTextSnapshot(_In_ ULONG docId, _Out_ shared_ptr<const SourceText>& spSourceText)
+{
+    // This can be called by either thread.
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    auto pSourceText = m_sourceTextCache.find(docId);
+    if (pSourceText != nullptr)
+    {
+        // Move a dynamic code document to the front of the eviction order
+        auto itLru = m_dynamicTextLruMap.find(docId);
+        if (itLru != m_dynamicTextLruMap.end())
+        {
+            m_dynamicTextLru.splice(m_dynamicTextLru.begin(), m_dynamicTextLru, itLru->second);
+        }
+
+        spSourceText = *pSourceText;
+        return S_OK;
+    }
+
+    auto pDocInfoTextPair = m_documentInfoMap.find(docId);
+    if (pDocInfoTextPair == nullptr)
+    {
+        return E_NOT_FOUND;
+    }
+
+    shared_ptr<SourceText> spNewText(new SourceText());
+    spNewText->docId = docId;
+    spNewText->version = m_nextSourceTextVersion++;
+
+    // Documents without text (e.g. the root node) are cached as empty
+    CComPtr<IDebugDocumentText> spDebugDocumentText(pDocInfoTextPair->second);
+    if (spDebugDocumentText != nullptr)
+    {
+        HRESULT hr = E_NOT_VALID_STATE;
+        for (int attempt = 0; attempt < SourceController::s_maxSourceTextFetchAttempts && hr == E_NOT_VALID_STATE; attempt++)
+        {
+            // Get the source text size
+            ULONG cLines = 0;
+            ULONG cChars = 0;
+            hr = spDebugDocumentText->GetSize(&cLines, &cChars);
+            BPT_FAIL_IF_NOT_S_OK(hr);
+
+            if (cChars > 0)
+            {
+                // Get the source text directly into the string buffer
+                ULONG cchSrcText = 0;
+                hr = spDebugDocumentText->GetText(0, spNewText->text.GetBuffer(cChars), nullptr, &cchSrcText, cChars);
+                spNewText->text.ReleaseBuffer((hr == S_OK) ? min(cchSrcText, cChars) : 0);
+                BPT_FAIL_IF_NOT_S_OK(hr);
+
+                if (cchSrcText != cChars)
+                {
+                    // The page was probably loading between GetSize(...) and GetText(...) calls, so try again.
+                    hr = E_NOT_VALID_STATE;
+                }
+            }
+        }
+
+        if (hr != S_OK)
+        {
+            return hr;
+        }
+    }
+
+    // Eval'd and generated code is often byte for byte the same as an earlier document, so identical texts share one buffer
+    if (pDocInfoTextPair->first->isDynamicCode)
+    {
+        this->TrackSharedDynamicText(docId, spNewText->text);
+    }
+
+    spSourceText = spNewText;
+    m_sourceTextCache[docId] = spSourceText;
+
+    this->EnforceDynamicTextBudget(docId);
+
+    return S_OK;
+}
+
+HRESULT SourceController::GetLineIndex(_In_ ULONG docId, _Out_ shared_ptr<const LineIndex>& spLineIndex)
+{
+    // This can be called by either thread.
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    shared_ptr<const SourceText> spSourceText;
+    HRESULT hr = this->GetSourceTextSnapshot(docId, spSourceText);
+    if (hr != S_OK)
+    {
+        return hr;
+    }
+
+    auto pLineIndex = m_lineIndexCache.find(docId);
+    if (pLineIndex != nullptr && (*pLineIndex)->version == spSourceText->version)
+    {
+        spLineIndex = *pLineIndex;
+        return S_OK;
+    }
+
+    // Build the table of line starts for this version of the text
+    shared_ptr<LineIndex> spNewIndex(new LineIndex());
+    spNewIndex->version = spSourceText->version;
+    SourceController::BuildLineIndex(spSourceText->text, *spNewIndex);
+
+    spLineIndex = spNewIndex;
+    m_lineIndexCache[docId] = spLineIndex;
+
+    return S_OK;
+}
+
+void SourceController::BuildLineIndex(_In_ const CString& text, _Inout_ LineIndex& lineIndex)
+{
+    lineIndex.textLength = static_cast<ULONG>(text.GetLength());
+    lineIndex.lineStarts.clear();
+    lineIndex.lineStarts.push_back(0);
+
+    LPCWSTR pText = text;
+    const ULONG length = lineIndex.textLength;
+    for (ULONG i = 0; i < length; i++)
+    {
+        WCHAR ch = pText[i];
+        if (ch > L'\r')
+        {
+            // Most characters are above both terminators, so this is the common path
+            continue;
+        }
+
+        if (ch == L'\r')
+        {
+            // Treat \r\n as a single terminator
+            if (i + 1 < length && pText[i + 1] == L'\n')
+            {
+                i++;
+            }
+
+            lineIndex.lineStarts.push_back(i + 1);
+        }
+        else if (ch == L'\n')
+        {
+            lineIndex.lineStarts.push_back(i + 1);
+        }
+    }
+}
+
+HRESULT SourceController::ApplySourceTextChange(_In_ IDebugDocumentText* pDebugDocumentText, _In_ const shared_ptr<const SourceText>& spOldText, _In_ SourceTextChange change, _In_ ULONG position, _In_ ULONG count, _Out_ shared_ptr<const SourceText>& spNewText)
+{
+    ATLENSURE_RETURN_HR(pDebugDocumentText != nullptr, E_INVALIDARG);
+
+    const CString& oldText = spOldText->text;
+    ULONG oldLength = static_cast<ULONG>(oldText.GetLength());
+
+    // Make sure the change actually fits in the text that we have cached
+    ATLENSURE_RETURN_HR(position <= oldLength, E_INVALIDARG);
+    ATLENSURE_RETURN_HR(change == SourceTextChange::Insert || count <= oldLength - position, E_INVALIDARG);
+
+    if (count == 0)
+    {
+        // Nothing changed, so keep the current snapshot
+        spNewText = spOldText;
+        return S_OK;
+    }
+
+    // The document should now be exactly the cached length plus the change, anything else means we missed an event
+    // or the cached text was fetched after this change had already been made
+    ULONG expectedLength = oldLength;
+    if (change == SourceTextChange::Insert)
+    {
+        expectedLength += count;
+    }
+    else if (change == SourceTextChange::Remove)
+    {
+        expectedLength -= count;
+    }
+
+    ULONG cLines = 0;
+    ULONG cChars = 0;
+    HRESULT hr = pDebugDocumentText->GetSize(&cLines, &cChars);
+    BPT_FAIL_IF_NOT_S_OK(hr);
+    ATLENSURE_RETURN_HR(cChars == expectedLength, E_NOT_VALID_STATE);
+
+    // Only the changed characters are fetched from the document
+    CString changedText;
+    if (change != SourceTextChange::Remove)
+    {
+        ULONG cchChanged = 0;
+        hr = pDebugDocumentText->GetText(position, changedText.GetBuffer(count), nullptr, &cchChanged, count);
+        changedText.ReleaseBuffer((hr == S_OK) ? min(cchChanged, count) : 0);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+        ATLENSURE_RETURN_HR(cchChanged == count, E_NOT_VALID_STATE);
+    }
+
+    shared_ptr<SourceText> spText(new SourceText());
+    spText->docId = spOldText->docId;
+    spText->version = m_nextSourceTextVersion++;
 
-    return E_NOT_FOUND;
+    ULONG tailStart = (change == SourceTextChange::Insert ? position : position + count);
+    spText->text = oldText.Left(position) + changedText + oldText.Mid(tailStart);
+
+    spNewText = spText;
+    return S_OK;
+}
+
+HRESULT SourceController::GetBreakpointIdFromSourceLocation(_In_ ULONG docId, _In_ ULONG start, _Out_ ULONG& breakpointId)
+{
+    // This can be called by either thread.
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    breakpointId = 0;  // 0 is not a valid breakpointId
+
+    // Get the context and source location for the given document id
+    CComPtr<IDebugCodeContext> spDebugCodeContext;
+    shared_ptr<SourceLocationInfo> spSourceLocationInfo;
+    HRESULT hr = this->GetCodeLocationFromDocId(docId, start, spDebugCodeContext, spSourceLocationInfo);
+    if (hr == S_OK)
+    {
+        // Find an existing breakpoint here
+        shared_ptr<BreakpointInfo> spExistingBp;
+        hr = this->FindExistingBreakpoint(spSourceLocationInfo, spExistingBp);
+        if (hr == S_OK)
+        {
+            // Found an existing breakpoint
+            breakpointId = spExistingBp->id;
+        }
+    }
+
+    return hr;
+}
+
+HRESULT SourceController::FindExistingBreakpoint(_In_ const shared_ptr<SourceLocationInfo>& spSourceLocationInfo, _Out_ shared_ptr<BreakpointInfo>& spBreakpointInfo)
+{
+    // This can be called by either thread.
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    auto itBpsAtLocation = m_breakpointsAtLocationMap.find(BreakpointLocationKey(*spSourceLocationInfo));
+    if (itBpsAtLocation == m_breakpointsAtLocationMap.end() || itBpsAtLocation->second.empty())
+    {
+        return E_NOT_FOUND;
+    }
+
+    // Use the oldest breakpoint if more than one shares this location
+    ULONG bpId = *std::min_element(itBpsAtLocation->second.begin(), itBpsAtLocation->second.end());
+
+    auto itBreakpoint = m_breakpointsMap.find(bpId);
+    ATLENSURE_RETURN_HR(itBreakpoint != m_breakpointsMap.end(), E_NOT_FOUND);
+
+    spBreakpointInfo = itBreakpoint->second;
+    return S_OK;
 }
 
 HRESULT SourceController::SetBreakpointState(_In_ shared_ptr<BreakpointInfo>& spBreakpointInfo, _In_ BREAKPOINT_STATE state)
@@ -1365,11 +1970,11 @@ HRESULT SourceController::UnbindBreakpoints(_In_ ULONG docId, _In_ bool removeFr
     CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
 
     // Get all the breakpoints at the given docId
-    auto itBpsAtDocId = m_breakpointsAtDocIdMap.find(docId);
-    if (itBpsAtDocId != m_breakpointsAtDocIdMap.end())
+    auto pBpsAtDocId = this->FindBreakpointsAtDocId(docId);
+    if (pBpsAtDocId != nullptr)
     {
         // Loop through each one and update its bound flag
-        for (auto& bpId : itBpsAtDocId->second)
+        for (auto& bpId : *pBpsAtDocId)
         {
             auto itBreakpoint = m_breakpointsMap.find(bpId);
             if (itBreakpoint != m_breakpointsMap.end())
@@ -1409,54 +2014,43 @@ HRESULT SourceController::RebindBreakpoints(_In_ const shared_ptr<DocumentInfo>&
         return S_OK;
     }
 
-    // Get all the breakpoints at this url
+    // Only one breakpoint is bound at each start offset in this document
     map<ULONG, bool> addedStartOffsets;
-    auto itBpsAtUrl = m_breakpointsAtUrlMap.find(spDocInfo->url);
+    auto tryBind = [this, &spDocInfo, &addedStartOffsets](ULONG bpId)
+    {
+        // Now get the actual breakpoint info from the map
+        auto itBreakpoint = m_breakpointsMap.find(bpId);
+        if (itBreakpoint != m_breakpointsMap.end() && itBreakpoint->second->spSourceLocation != nullptr)
+        {
+            ULONG start = itBreakpoint->second->spSourceLocation->charPosition;
+            if (addedStartOffsets.find(start) == addedStartOffsets.end() && this->BindBreakpoint(itBreakpoint->second, spDocInfo) == S_OK)
+            {
+                addedStartOffsets[start] = true;
+            }
+        }
+    };
+
+    // Get all the breakpoints at this url
+    auto itBpsAtUrl = m_breakpointsAtUrlMap.find(SourceController::NormalizeUrl(spDocInfo->url));
     if (itBpsAtUrl != m_breakpointsAtUrlMap.end())
     {
         for (auto& bpId : itBpsAtUrl->second)
         {
-            // Now get the actual breakpoint info from the map
-            auto itBreakpoint = m_breakpointsMap.find(bpId);
-            if (itBreakpoint != m_breakpointsMap.end())
+            tryBind(bpId);
+        }
+    }
+
+    // Then any whose url regex matches this document
+    const CComBSTR& docUrl = spDocInfo->url;
+    if (docUrl.Length() > 0)
+    {
+        for (const auto& regexBreakpoint : m_breakpointsAtUrlRegex)
+        {
+            // Skip running the regex for breakpoints that are already bound elsewhere
+            auto itBreakpoint = m_breakpointsMap.find(regexBreakpoint.breakpointId);
+            if (itBreakpoint != m_breakpointsMap.end() && !itBreakpoint->second->isBound && SourceController::MatchesUrlRegex(docUrl, regexBreakpoint.urlRegex))
             {
-                auto breakpoint = itBreakpoint->second;
-                if (breakpoint->spSourceLocation != nullptr)
-                {
-                    ULONG start = breakpoint->spSourceLocation->charPosition;
-                    if (addedStartOffsets.find(start) == addedStartOffsets.end())
-                    {
-                        // Check that the breakpoint is inside the (perhaps partially downloaded) file
-                        if (!breakpoint->isBound && start <= spDocInfo->textLength)
-                        {
-                            CComPtr<IDebugCodeContext> spDebugCodeContext;
-                            HRESULT hr = this->GetCodeContextFromDocId(spDocInfo->docId, start, spDebugCodeContext);
-                            if (hr == S_OK)
-                            {
-                                shared_ptr<SourceLocationInfo> spSourceLocationInfo;
-                                hr = this->GetSourceLocation(spDebugCodeContext, spSourceLocationInfo);
-                                if (hr == S_OK)
-                                {
-                                    // Save the previous docId
-                                    ULONG prevDocId = breakpoint->spSourceLocation->docId;
-
-                                    // Bind the breakpoint and update the doc id
-                                    hr = spDebugCodeContext->SetBreakPoint((breakpoint->isEnabled ? BREAKPOINT_ENABLED : BREAKPOINT_DISABLED));
-                                    if (hr == S_OK)
-                                    {
-                                        // Update the breakpoint
-                                        breakpoint->spSourceLocation = spSourceLocationInfo;
-                                        breakpoint->isBound = true;
-
-                                        // Update the maps
-                                        this->ResolveBreakpoint(bpId, prevDocId, spDocInfo->docId);
-                                        addedStartOffsets[start] = true;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
+                tryBind(regexBreakpoint.breakpointId);
             }
         }
     }
@@ -1465,6 +2059,51 @@ HRESULT SourceController::RebindBreakpoints(_In_ const shared_ptr<DocumentInfo>&
     return S_OK;
 }
 
+HRESULT SourceController::BindBreakpoint(_In_ const shared_ptr<BreakpointInfo>& spBreakpointInfo, _In_ const shared_ptr<DocumentInfo>& spDocInfo)
+{
+    // This can be called by either thread.
+    ATLASSERT(spBreakpointInfo->spSourceLocation != nullptr);
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    // Check that the breakpoint is inside the (perhaps partially downloaded) file
+    ULONG start = spBreakpointInfo->spSourceLocation->charPosition;
+    if (spBreakpointInfo->isBound || start > spDocInfo->textLength)
+    {
+        return S_FALSE;
+    }
+
+    CComPtr<IDebugCodeContext> spDebugCodeContext;
+    shared_ptr<SourceLocationInfo> spSourceLocationInfo;
+    HRESULT hr = this->GetCodeLocationFromDocId(spDocInfo->docId, start, spDebugCodeContext, spSourceLocationInfo);
+    if (hr != S_OK)
+    {
+        return S_FALSE;
+    }
+
+    // Save the previous docId
+    ULONG prevDocId = spBreakpointInfo->spSourceLocation->docId;
+
+    // Bind the breakpoint and update the doc id
+    hr = spDebugCodeContext->SetBreakPoint((spBreakpointInfo->isEnabled ? BREAKPOINT_ENABLED : BREAKPOINT_DISABLED));
+    if (hr != S_OK)
+    {
+        return S_FALSE;
+    }
+
+    // Update the breakpoint
+    this->RemoveBreakpointLocation(spBreakpointInfo);
+    spBreakpointInfo->spSourceLocation = spSourceLocationInfo;
+    spBreakpointInfo->isBound = true;
+    this->AddBreakpointLocation(spBreakpointInfo);
+
+    // Update the maps
+    this->ResolveBreakpoint(spBreakpointInfo->id, prevDocId, spDocInfo->docId);
+
+    return S_OK;
+}
+
 HRESULT SourceController::ResolveBreakpoint(_In_ ULONG bpId, _In_ ULONG prevDocId, _In_ ULONG newDocId)
 {
     // This can be called by either thread.
@@ -1473,29 +2112,33 @@ HRESULT SourceController::ResolveBreakpoint(_In_ ULONG bpId, _In_ ULONG prevDocI
     CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
 
     // Find all the breakpoints at the given docId
-    auto itBps = m_breakpointsAtDocIdMap.find(prevDocId);
-    if (itBps != m_breakpointsAtDocIdMap.end())
+    auto pList = this->FindBreakpointsAtDocId(prevDocId);
+    if (pList != nullptr)
     {
         // Now find the matching breakpoint in the vector for this docId
-        auto pList = &itBps->second;
+        bool isMoved = false;
         for (size_t i = 0; i < pList->size(); i++)
         {
             if (pList->at(i) == bpId)
             {
-                // Move to the new docId
-                m_breakpointsAtDocIdMap[newDocId].push_back(bpId);
-                m_resolvedBreakpointsMap[newDocId].push_back(bpId);
-
                 // Delete from the previous docId
                 pList->erase(pList->begin() + i);
+                isMoved = true;
                 break;
             }
         }
 
         // Remove an empty vector
-        if (itBps->second.empty())
+        if (pList->empty())
         {
-            m_breakpointsAtDocIdMap.erase(itBps);
+            this->EraseBreakpointsAtDocId(prevDocId);
+        }
+
+        if (isMoved)
+        {
+            // Move to the new docId, this is done after the erase since adding a slot can move the previous list
+            this->GetBreakpointsAtDocId(newDocId).push_back(bpId);
+            m_resolvedBreakpointsMap[newDocId].push_back(bpId);
         }
     }
 
@@ -1513,13 +2156,322 @@ HRESULT SourceController::AddBreakpointInternal(_In_ const shared_ptr<Breakpoint
     m_breakpointsMap[spBreakpointInfo->id] = spBreakpointInfo;
     if (spBreakpointInfo->spSourceLocation != nullptr)
     {
-        m_breakpointsAtDocIdMap[spBreakpointInfo->spSourceLocation->docId].push_back(spBreakpointInfo->id);
-        m_breakpointsAtUrlMap[spBreakpointInfo->url].push_back(spBreakpointInfo->id);
+        this->GetBreakpointsAtDocId(spBreakpointInfo->spSourceLocation->docId).push_back(spBreakpointInfo->id);
+        if (!spBreakpointInfo->isUrlRegex)
+        {
+            m_breakpointsAtUrlMap[SourceController::NormalizeUrl(spBreakpointInfo->url)].push_back(spBreakpointInfo->id);
+        }
+
+        this->AddBreakpointLocation(spBreakpointInfo);
     }
 
     return S_OK;
 }
 
+void SourceController::AddBreakpointLocation(_In_ const shared_ptr<BreakpointInfo>& spBreakpointInfo)
+{
+    // This can be called by either thread.
+    ATLASSERT(spBreakpointInfo->spSourceLocation != nullptr);
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    m_breakpointsAtLocationMap[BreakpointLocationKey(*spBreakpointInfo->spSourceLocation)].push_back(spBreakpointInfo->id);
+}
+
+void SourceController::RemoveBreakpointLocation(_In_ const shared_ptr<BreakpointInfo>& spBreakpointInfo)
+{
+    // This can be called by either thread.
+    ATLASSERT(spBreakpointInfo->spSourceLocation != nullptr);
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    auto itBpsAtLocation = m_breakpointsAtLocationMap.find(BreakpointLocationKey(*spBreakpointInfo->spSourceLocation));
+    if (itBpsAtLocation != m_breakpointsAtLocationMap.end())
+    {
+        const ULONG breakpointId = spBreakpointInfo->id;
+        auto& list = itBpsAtLocation->second;
+        list.erase(std::remove(list.begin(), list.end(), breakpointId), list.end());
+
+        if (list.empty())
+        {
+            m_breakpointsAtLocationMap.erase(itBpsAtLocation);
+        }
+    }
+}
+
+vector<ULONG>* SourceController::FindBreakpointsAtDocId(_In_ ULONG docId)
+{
+    // This must be called with the sources lock held
+
+    if (docId == 0)
+    {
+        return (m_pendingBreakpointIds.empty() ? nullptr : &m_pendingBreakpointIds);
+    }
+
+    return m_breakpointsAtDocIdMap.find(docId);
+}
+
+vector<ULONG>& SourceController::GetBreakpointsAtDocId(_In_ ULONG docId)
+{
+    // This must be called with the sources lock held
+
+    // Pending breakpoints use docId 0, they stay out of the slot map so that it is not based at 0 for as long as one is pending
+    if (docId == 0)
+    {
+        return m_pendingBreakpointIds;
+    }
+
+    return m_breakpointsAtDocIdMap[docId];
+}
+
+void SourceController::EraseBreakpointsAtDocId(_In_ ULONG docId)
+{
+    // This must be called with the sources lock held
+
+    if (docId == 0)
+    {
+        m_pendingBreakpointIds.clear();
+    }
+    else
+    {
+        m_breakpointsAtDocIdMap.erase(docId);
+    }
+}
+
+void SourceController::AddDocumentUrl(_In_ const shared_ptr<DocumentInfo>& spDocInfo)
+{
+    // This can be called by either thread.
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    if (spDocInfo->url.Length() > 0)
+    {
+        m_documentsAtUrlMap[SourceController::NormalizeUrl(spDocInfo->url)].push_back(spDocInfo->docId);
+    }
+}
+
+void SourceController::RemoveDocumentUrl(_In_ const shared_ptr<DocumentInfo>& spDocInfo)
+{
+    // This can be called by either thread.
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    if (spDocInfo->url.Length() == 0)
+    {
+        return;
+    }
+
+    auto itDocsAtUrl = m_documentsAtUrlMap.find(SourceController::NormalizeUrl(spDocInfo->url));
+    if (itDocsAtUrl != m_documentsAtUrlMap.end())
+    {
+        const ULONG docId = spDocInfo->docId;
+        auto& list = itDocsAtUrl->second;
+        list.erase(std::remove(list.begin(), list.end(), docId), list.end());
+
+        if (list.empty())
+        {
+            m_documentsAtUrlMap.erase(itDocsAtUrl);
+        }
+    }
+}
+
+CComBSTR SourceController::NormalizeUrl(_In_ const CComBSTR& url)
+{
+    // The fragment never changes which script is loaded
+    CString normalized(url);
+    int fragmentStart = normalized.Find(L'#');
+    if (fragmentStart >= 0)
+    {
+        normalized.Truncate(fragmentStart);
+    }
+
+    // The scheme and host are case insensitive, as is the whole of a file url since the paths are on Windows
+    int schemeEnd = normalized.Find(L"://");
+    if (schemeEnd > 0)
+    {
+        CString scheme = normalized.Left(schemeEnd);
+        if (scheme.CompareNoCase(L"file") == 0)
+        {
+            normalized.Replace(L'\\', L'/');
+            normalized.MakeLower();
+        }
+        else
+        {
+            int pathStart = normalized.Find(L'/', schemeEnd + 3);
+            if (pathStart < 0)
+            {
+                pathStart = normalized.GetLength();
+            }
+
+            CString authority = normalized.Left(pathStart);
+            authority.MakeLower();
+            normalized = authority + normalized.Mid(pathStart);
+        }
+    }
+
+    return CComBSTR(normalized);
+}
+
+void SourceController::TrackDynamicText(_In_ ULONG docId, _In_ ULONGLONG chargedBytes)
+{
+    // This can be called by either thread.
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    DynamicTextEntry entry = { docId, chargedBytes, 0, false };
+    m_dynamicTextLru.push_front(entry);
+    m_dynamicTextLruMap[docId] = m_dynamicTextLru.begin();
+    m_dynamicTextBytes += chargedBytes;
+}
+
+void SourceController::TrackSharedDynamicText(_In_ ULONG docId, _Inout_ CString& text)
+{
+    // This can be called by either thread.
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    ULONGLONG textBytes = text.GetLength() * sizeof(WCHAR);
+    ULONGLONG hash = SourceController::HashSourceText(text);
+
+    auto itShared = m_dynamicTextAtHashMap.find(hash);
+    if (itShared == m_dynamicTextAtHashMap.end())
+    {
+        // The first document with this text, it is charged to the shared text rather than the document
+        SharedDynamicText shared;
+        shared.text = text;
+        shared.ownerCount = 1;
+        m_dynamicTextAtHashMap[hash] = shared;
+        m_dynamicTextBytes += textBytes;
+    }
+    else if (itShared->second.text == text)
+    {
+        // CString storage is reference counted, so assigning it drops our copy without copying the shared one
+        text = itShared->second.text;
+        itShared->second.ownerCount++;
+        m_dynamicDocumentInfo.sharedDocuments++;
+        m_dynamicDocumentInfo.sharedBytes += textBytes;
+    }
+    else
+    {
+        // A hash collision with a different text, which just keeps its own storage
+        this->TrackDynamicText(docId, textBytes);
+        return;
+    }
+
+    DynamicTextEntry entry = { docId, 0, hash, true };
+    m_dynamicTextLru.push_front(entry);
+    m_dynamicTextLruMap[docId] = m_dynamicTextLru.begin();
+}
+
+void SourceController::UntrackDynamicText(_In_ ULONG docId)
+{
+    // This can be called by either thread.
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    auto itLru = m_dynamicTextLruMap.find(docId);
+    if (itLru != m_dynamicTextLruMap.end())
+    {
+        this->ReleaseDynamicText(*itLru->second);
+        m_dynamicTextLru.erase(itLru->second);
+        m_dynamicTextLruMap.erase(itLru);
+    }
+}
+
+void SourceController::ReleaseDynamicText(_In_ const DynamicTextEntry& entry)
+{
+    // This must be called with the sources lock held
+
+    m_dynamicTextBytes -= entry.chargedBytes;
+
+    // Shared text stays charged until its last owner lets go of it, and is forgotten at the same time
+    if (entry.isShared)
+    {
+        auto itShared = m_dynamicTextAtHashMap.find(entry.hash);
+        if (itShared != m_dynamicTextAtHashMap.end() && --itShared->second.ownerCount == 0)
+        {
+            m_dynamicTextBytes -= itShared->second.text.GetLength() * sizeof(WCHAR);
+            m_dynamicTextAtHashMap.erase(itShared);
+        }
+    }
+}
+
+void SourceController::EnforceDynamicTextBudget(_In_ ULONG keepDocId)
+{
+    // This can be called by either thread.
+
+    // Lock the source access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csSourcesLock);
+
+    if (m_dynamicTextBudget == 0)
+    {
+        return;
+    }
+
+    // Walk from the least recently used end, documents with bound breakpoints keep their code locations for the break lookup.
+    // The documents themselves stay, since the PDM still owns them, so anything dropped here is fetched again if it is asked for.
+    // Dropping a document that shares its text only frees the text once the last document sharing it is dropped too.
+    auto it = m_dynamicTextLru.end();
+    while (m_dynamicTextBytes > m_dynamicTextBudget && it != m_dynamicTextLru.begin())
+    {
+        --it;
+        ULONG docId = it->docId;
+        if (docId == keepDocId || this->FindBreakpointsAtDocId(docId) != nullptr)
+        {
+            continue;
+        }
+
+        this->ReleaseDynamicText(*it);
+        m_dynamicTextLruMap.erase(docId);
+        it = m_dynamicTextLru.erase(it);
+
+        m_sourceTextCache.erase(docId);
+        m_lineIndexCache.erase(docId);
+        this->InvalidateCodeLocations(docId);
+
+        m_dynamicDocumentInfo.evictedDocuments++;
+    }
+}
+
+bool SourceController::MatchesUrlRegex(_In_ const CComBSTR& url, _In_ const std::wregex& urlRegex)
+{
+    if (url.Length() == 0)
+    {
+        return false;
+    }
+
+    // The regex comes from the front end and this runs while documents are added, so a search that throws is just no match
+    try
+    {
+        return std::regex_search(url.m_str, url.m_str + url.Length(), urlRegex);
+    }
+    catch (const std::regex_error&)
+    {
+        return false;
+    }
+}
+
+ULONGLONG SourceController::HashSourceText(_In_ const CString& text)
+{
+    // 64 bit FNV-1a over the characters of the text, the text is compared in full on a match so collisions only cost sharing
+    ULONGLONG hash = 14695981039346656037ULL;
+    LPCWSTR pText = text.GetString();
+    int length = text.GetLength();
+    for (int i = 0; i < length; i++)
+    {
+        hash = (hash ^ pText[i]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
 HRESULT SourceController::CreateUniqueBpIdForMutationBreakpoint(_Out_ ULONG& id)
 {
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
@@ -7,6 +7,7 @@
 #include "PDMEventMessageQueue.h"
 #include "DebuggerStructs.h"
 #include "SourceNode.h"
+#include "IdSlotMap.h"
 
 using namespace ATL;
 using namespace std;
@@ -36,14 +37,18 @@ public:
     HRESULT GetSourceLocationForCallFrame(_In_ IDebugCodeContext* pDebugCodeContext, _Out_ shared_ptr<SourceLocationInfo>& spSourceLocationInfo, _Out_ bool& isInternal);
     HRESULT GetBreakpointInfoForBreak(_In_ ULONG docId, _In_ ULONG start, _Out_ shared_ptr<BreakpointInfo>& spBreakpointInfo);
     HRESULT GetBreakpointInfosForEventBreak(_In_ const CString& eventType, _Out_ vector<shared_ptr<BreakpointInfo>>& breakpointList);
+    HRESULT GetDocumentUrl(_In_ ULONG docId, _Out_ CComBSTR& url);
 
     // Dispatch Operations
     HRESULT RefreshSources(_Inout_ vector<shared_ptr<DocumentInfo>>& added, _Inout_ vector<shared_ptr<DocumentInfo>>& updated, _Inout_ vector<ULONG>& removed, _Inout_ vector<shared_ptr<ReboundBreakpointInfo>>& rebound);
     HRESULT GetSourceText(_In_ ULONG docId, _Out_ CComBSTR& sourceText);
+    HRESULT GetLineColumnFromOffset(_In_ ULONG docId, _In_ ULONG offset, _Out_ ULONG& lineNumber, _Out_ ULONG& columnNumber);
+    HRESULT GetOffsetFromLineColumn(_In_ ULONG docId, _In_ ULONG lineNumber, _In_ ULONG columnNumber, _Out_ ULONG& offset);
+    HRESULT SearchInContent(_In_ ULONG docId, _In_ const CComBSTR& query, _In_ bool isCaseSensitive, _In_ bool isRegex, _Inout_ vector<SearchMatch>& matches);
     HRESULT GetCodeContext(_In_ ULONG docId, _In_ ULONG start, _Out_ CComPtr<IDebugCodeContext>& spDebugCodeContext);
     HRESULT AddCodeBreakpoint(_In_ ULONG docId, _In_ ULONG start, _In_ const CComBSTR& condition, _In_ bool isTracepoint, _Out_ shared_ptr<BreakpointInfo>& spBreakpointInfo);
     HRESULT AddEventBreakpoint(_In_ shared_ptr<vector<CComBSTR>> eventTypes, _In_ bool isEnabled, _In_ const CComBSTR& condition, _In_ bool isTracepoint, _Out_ shared_ptr<BreakpointInfo>& spBreakpointInfo);
-    HRESULT AddPendingBreakpoint(_In_ const CComBSTR& url, _In_ ULONG start, _In_ const CComBSTR& condition, _In_ bool isEnabled, _In_ bool isTracepoint, _Out_ ULONG& pBreakpointId);
+    HRESULT AddPendingBreakpoint(_In_ const CComBSTR& url, _In_ bool isUrlRegex, _In_ ULONG start, _In_ const CComBSTR& condition, _In_ bool isEnabled, _In_ bool isTracepoint, _Out_ ULONG& pBreakpointId);
     HRESULT RemoveBreakpoint(_In_ ULONG breakpointId);
     HRESULT UpdateBreakpoint(_In_ ULONG breakpointId, _In_ const CComBSTR& condition, _In_ bool isTracepoint);
     HRESULT SetBreakpointEnabledState(_In_ ULONG breakpointId, _In_ bool enable);
@@ -54,11 +59,15 @@ public:
     HRESULT UnbindAllEventBreakpoints(_In_ const bool removeListeners);
     HRESULT GetIsMappedEventType(_In_ const CString& eventType, _Out_ bool& isMapped);
     HRESULT SetBreakOnNewWorker(_In_ bool enable);
+    HRESULT SetDynamicTextBudget(_In_ ULONG budgetBytes);
+    HRESULT GetDynamicDocumentInfo(_Out_ DynamicDocumentInfo& info);
+    static void BuildLineIndex(_In_ const CString& text, _Inout_ LineIndex& lineIndex);
 
     // PDM Event Notifications
     HRESULT OnAddChild(_In_ ULONG parentId, _In_ IDebugApplicationNode* pChildNode);
     HRESULT OnRemoveChild(_In_ ULONG parentId, _In_ IDebugApplicationNode* pChildNode);
     HRESULT OnUpdate(_In_ ULONG docId);
+    HRESULT OnUpdateText(_In_ ULONG docId, _In_ SourceTextChange change, _In_ ULONG position, _In_ ULONG count);
 
     HRESULT CreateUniqueBpIdForMutationBreakpoint(_Out_ ULONG& id);
 private:
@@ -67,14 +76,34 @@ private:
     HRESULT RemoveNode(_In_ IDebugApplicationNode* pRootNode, _In_ const ULONG& parentId);
     HRESULT GetSourceLocation(_In_ IDebugCodeContext* pDebugCodeContext, _Out_ shared_ptr<SourceLocationInfo>& spSourceLocationInfo);
     HRESULT GetCodeContextFromDocId(_In_ ULONG docId, _In_ ULONG start, _Out_ CComPtr<IDebugCodeContext>& spDebugCodeContext);
+    HRESULT GetCodeLocationFromDocId(_In_ ULONG docId, _In_ ULONG start, _Out_ CComPtr<IDebugCodeContext>& spDebugCodeContext, _Out_ shared_ptr<SourceLocationInfo>& spSourceLocationInfo);
+    void InvalidateCodeLocations(_In_ ULONG docId);
+    HRESULT GetSourceTextSnapshot(_In_ ULONG docId, _Out_ shared_ptr<const SourceText>& spSourceText);
+    HRESULT GetLineIndex(_In_ ULONG docId, _Out_ shared_ptr<const LineIndex>& spLineIndex);
+    HRESULT ApplySourceTextChange(_In_ IDebugDocumentText* pDebugDocumentText, _In_ const shared_ptr<const SourceText>& spOldText, _In_ SourceTextChange change, _In_ ULONG position, _In_ ULONG count, _Out_ shared_ptr<const SourceText>& spNewText);
     HRESULT GetBreakpointIdFromSourceLocation(_In_ ULONG docId, _In_ ULONG start, _Out_ ULONG& breakpointId);
     HRESULT FindExistingBreakpoint(_In_ const shared_ptr<SourceLocationInfo>& spSourceLocationInfo, _Out_ shared_ptr<BreakpointInfo>& spBreakpointInfo);
     HRESULT SetBreakpointState(_In_ shared_ptr<BreakpointInfo>& spBreakpointInfo, _In_ BREAKPOINT_STATE state);
     HRESULT UnbindBreakpoints(_In_ ULONG docId, _In_ bool removeFromEngine);
     HRESULT RebindBreakpoints(_In_ const shared_ptr<DocumentInfo>& spDocInfo);
+    HRESULT BindBreakpoint(_In_ const shared_ptr<BreakpointInfo>& spBreakpointInfo, _In_ const shared_ptr<DocumentInfo>& spDocInfo);
     HRESULT ResolveBreakpoint(_In_ ULONG bpId, _In_ ULONG prevDocId, _In_ ULONG newDocId);
     HRESULT AddBreakpointInternal(_In_ const shared_ptr<BreakpointInfo>& spBreakpointInfo);
+    void AddBreakpointLocation(_In_ const shared_ptr<BreakpointInfo>& spBreakpointInfo);
+    void RemoveBreakpointLocation(_In_ const shared_ptr<BreakpointInfo>& spBreakpointInfo);
+    vector<ULONG>* FindBreakpointsAtDocId(_In_ ULONG docId);
+    vector<ULONG>& GetBreakpointsAtDocId(_In_ ULONG docId);
+    void EraseBreakpointsAtDocId(_In_ ULONG docId);
     HRESULT UpdateEventTypeMap(_In_ const vector<CComBSTR>& eventTypes, _In_ const ULONG breakpointId, _In_ const bool addEvents);
+    void AddDocumentUrl(_In_ const shared_ptr<DocumentInfo>& spDocInfo);
+    void RemoveDocumentUrl(_In_ const shared_ptr<DocumentInfo>& spDocInfo);
+    static CComBSTR NormalizeUrl(_In_ const CComBSTR& url);
+    void TrackDynamicText(_In_ ULONG docId, _In_ ULONGLONG chargedBytes);
+    void TrackSharedDynamicText(_In_ ULONG docId, _Inout_ CString& text);
+    void UntrackDynamicText(_In_ ULONG docId);
+    void EnforceDynamicTextBudget(_In_ ULONG keepDocId);
+    static bool MatchesUrlRegex(_In_ const CComBSTR& url, _In_ const std::wregex& urlRegex);
+    static ULONGLONG HashSourceText(_In_ const CString& text);
 
     // This must be static to ensure unique doc id's across debugging sessions.
     static ULONG s_nextDocId;
@@ -82,6 +111,106 @@ private:
     static ULONG s_nextBpId;
     static ULONG CreateUniqueBpId() { return SourceController::s_nextBpId++; } 
 
+    static const int s_maxSourceTextFetchAttempts;
+    static const ULONG s_defaultDynamicTextBudget;
+
+    // Key for finding the breakpoints at an exact source location
+    struct BreakpointLocationKey
+    {
+        ULONG docId;
+        ULONG charPosition;
+        ULONG contextCount;
+
+        BreakpointLocationKey(_In_ const SourceLocationInfo& location) :
+            docId(location.docId),
+            charPosition(location.charPosition),
+            contextCount(location.contextCount)
+        { }
+
+        bool operator==(_In_ const BreakpointLocationKey& other) const
+        {
+            return (docId == other.docId && charPosition == other.charPosition && contextCount == other.contextCount);
+        }
+    };
+
+    struct BreakpointLocationKeyHash
+    {
+        size_t operator()(_In_ const BreakpointLocationKey& key) const
+        {
+            size_t hash = key.docId;
+            hash = (hash * 31) + key.charPosition;
+            hash = (hash * 31) + key.contextCount;
+            return hash;
+        }
+    };
+
+    // A pending breakpoint whose url is a regex, compiled once when the breakpoint is added
+    struct UrlRegexBreakpoint
+    {
+        ULONG breakpointId;
+        std::wregex urlRegex;
+    };
+
+    // A dynamic code document whose text is cached, and the bytes of storage it is charged for.
+    // A document sharing its text is charged nothing itself, the shared text is charged once for all of its owners.
+    struct DynamicTextEntry
+    {
+        ULONG docId;
+        ULONGLONG chargedBytes;
+        ULONGLONG hash;
+        bool isShared;
+    };
+
+    // A dynamic code text that one or more documents share, kept until the last of them lets go of it
+    struct SharedDynamicText
+    {
+        CString text;
+        ULONG ownerCount;
+    };
+
+    // Needs the entry type above, so it is declared here rather than with the other helpers
+    void ReleaseDynamicText(_In_ const DynamicTextEntry& entry);
+
+    // A code context and the source location it resolved to
+    struct CodeLocation
+    {
+        CComPtr<IDebugCodeContext> spDebugCodeContext;
+        shared_ptr<SourceLocationInfo> spSourceLocationInfo;
+    };
+
+    // Hashers for the url/event type and application node keyed maps
+    struct BstrHash
+    {
+        size_t operator()(_In_ const CComBSTR& key) const
+        {
+            // FNV-1a over the characters of the string
+            size_t hash = 2166136261U;
+            UINT length = key.Length();
+            for (UINT i = 0; i < length; i++)
+            {
+                hash = (hash ^ key.m_str[i]) * 16777619U;
+            }
+            return hash;
+        }
+    };
+
+    struct BstrEqual
+    {
+        bool operator()(_In_ const CComBSTR& left, _In_ const CComBSTR& right) const
+        {
+            UINT length = left.Length();
+            return (length == right.Length() && (length == 0 || ::wmemcmp(left.m_str, right.m_str, length) == 0));
+        }
+    };
+
+    struct ApplicationNodeHash
+    {
+        size_t operator()(_In_ const CComPtr<IDebugApplicationNode>& key) const
+        {
+            return std::hash<IDebugApplicationNode*>()(key.p);
+        }
+    };
+
 private:
     DWORD m_dispatchThreadId;
     HWND m_hwndDebugPipeHandler;
@@ -95,19 +224,42 @@ private:
     // Document changes
     map<ULONG, vector<ULONG>> m_resolvedBreakpointsMap;
     vector<ULONG> m_removedDocuments;
-    map<ULONG, bool> m_updatedDocumentInfoMap;
-    map<ULONG, bool> m_currentDocumentInfoMap;
+    IdBitSet m_updatedDocuments;
+    IdBitSet m_currentDocuments;
 
     // Source nodes
-    map<ULONG, CComObjPtr<SourceNode>> m_sourceNodeMap;
-    map<CComPtr<IDebugApplicationNode>, ULONG> m_sourceNodeAtApplicationMap;
-    map<ULONG, pair<shared_ptr<DocumentInfo>, CComPtr<IDebugDocumentText>>> m_documentInfoMap;
+    IdSlotMap<CComObjPtr<SourceNode>> m_sourceNodeMap;
+    unordered_map<CComPtr<IDebugApplicationNode>, ULONG, ApplicationNodeHash> m_sourceNodeAtApplicationMap;
+    IdSlotMap<pair<shared_ptr<DocumentInfo>, CComPtr<IDebugDocumentText>>> m_documentInfoMap;
+    unordered_map<CComBSTR, vector<ULONG>, BstrHash, BstrEqual> m_documentsAtUrlMap;
+
+    // Resolved code locations for each document, keyed by character offset
+    IdSlotMap<unordered_map<ULONG, CodeLocation>> m_codeLocationCache;
+
+    // Source text snapshots, built on first request and then kept up to date from the text change events
+    IdSlotMap<shared_ptr<const SourceText>> m_sourceTextCache;
+    ULONG m_nextSourceTextVersion;
+
+    // Line start tables, rebuilt when they no longer match the version of the cached source text
+    IdSlotMap<shared_ptr<const LineIndex>> m_lineIndexCache;
+
+    // Dynamic code text, identical texts share one buffer found through the hash of their content.
+    // The least recently used documents are dropped from the caches once the charged bytes go over the budget (0 for no budget).
+    unordered_map<ULONGLONG, SharedDynamicText> m_dynamicTextAtHashMap;
+    list<DynamicTextEntry> m_dynamicTextLru; // Most recently used first
+    unordered_map<ULONG, list<DynamicTextEntry>::iterator> m_dynamicTextLruMap;
+    ULONGLONG m_dynamicTextBytes;
+    ULONG m_dynamicTextBudget;
+    DynamicDocumentInfo m_dynamicDocumentInfo;
 
     // Breakpoints
     map<ULONG, shared_ptr<BreakpointInfo>> m_breakpointsMap;
-    map<ULONG, vector<ULONG>> m_breakpointsAtDocIdMap;
-    map<CComBSTR, vector<ULONG>> m_breakpointsAtUrlMap;
-    map<CComBSTR, vector<ULONG>> m_breakpointsAtEventTypeMap;
+    IdSlotMap<vector<ULONG>> m_breakpointsAtDocIdMap;
+    vector<ULONG> m_pendingBreakpointIds; // Breakpoints waiting for a document, kept apart from the docId slots
+    unordered_map<BreakpointLocationKey, vector<ULONG>, BreakpointLocationKeyHash> m_breakpointsAtLocationMap;
+    unordered_map<CComBSTR, vector<ULONG>, BstrHash, BstrEqual> m_breakpointsAtUrlMap; // Keyed by normalized url
+    vector<UrlRegexBreakpoint> m_breakpointsAtUrlRegex;
+    unordered_map<CComBSTR, vector<ULONG>, BstrHash, BstrEqual> m_breakpointsAtEventTypeMap;
 
     CComObjPtr<PDMEventMessageQueue> m_spMessageQueue;
     CComPtr<IRemoteDebugApplication> m_spDebugApplication;
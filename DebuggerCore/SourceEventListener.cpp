@@ -111,31 +111,31 @@ HRESULT SourceEventListener::onDestroy()
     return S_OK;
 }
 
-HRESULT SourceEventListener::onInsertText(_In_ ULONG /* cCharacterPosition */, _In_ ULONG /* cNumToInsert */)
+HRESULT SourceEventListener::onInsertText(_In_ ULONG cCharacterPosition, _In_ ULONG cNumToInsert)
 {
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnPDMThread(m_dispatchThreadId), E_UNEXPECTED);
 
     // Even if cNumToInsert is 0, we still need to forward the event to update breakpoint bindings.
     // Deduplication of successive update document events occurs in DebugProvider.
-    return this->OnSourceTextChange();
+    return this->OnSourceTextChange(SourceTextChange::Insert, cCharacterPosition, cNumToInsert);
 }
 
-HRESULT SourceEventListener::onRemoveText(_In_ ULONG /* cCharacterPosition */, _In_ ULONG /* cNumToRemove */)
+HRESULT SourceEventListener::onRemoveText(_In_ ULONG cCharacterPosition, _In_ ULONG cNumToRemove)
 {
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnPDMThread(m_dispatchThreadId), E_UNEXPECTED);
 
     // Even if cNumToRemove is 0, we still need to forward the event to update breakpoint bindings.
     // Deduplication of successive update document events occurs in DebugProvider.
-    return this->OnSourceTextChange();
+    return this->OnSourceTextChange(SourceTextChange::Remove, cCharacterPosition, cNumToRemove);
 }
 
-HRESULT SourceEventListener::onReplaceText(_In_ ULONG /* cCharacterPosition */, _In_ ULONG /* cNumToReplace */)
+HRESULT SourceEventListener::onReplaceText(_In_ ULONG cCharacterPosition, _In_ ULONG cNumToReplace)
 {
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnPDMThread(m_dispatchThreadId), E_UNEXPECTED);
 
     // Even if cNumToReplace is 0, we still need to forward the event to update breakpoint bindings.
     // Deduplication of successive update document events occurs in DebugProvider.
-    return this->OnSourceTextChange();
+    return this->OnSourceTextChange(SourceTextChange::Replace, cCharacterPosition, cNumToReplace);
 }
 
 HRESULT SourceEventListener::onUpdateTextAttributes(_In_ ULONG /* cCharacterPosition */, _In_ ULONG /* cNumToUpdate */)
@@ -151,7 +151,11 @@ HRESULT SourceEventListener::onUpdateDocumentAttributes(_In_ TEXT_DOC_ATTR /* te
 }
 
 // Helper functions
-HRESULT SourceEventListener::OnSourceTextChange()
+HRESULT SourceEventListener::OnSourceTextChange(_In_ SourceTextChange change, _In_ ULONG position, _In_ ULONG count)
 {
+    // Apply the delta to any cached text before the update event reads the document info
+    HRESULT hr = m_spSourceController->OnUpdateText(m_ownerId, change, position, count);
+    BPT_FAIL_IF_NOT_S_OK(hr);
+
     return m_spSourceController->OnUpdate(m_ownerId);
 }
@@ -42,7 +42,7 @@ public:
     STDMETHOD(onUpdateDocumentAttributes)(_In_ TEXT_DOC_ATTR textdocattr);
 
 private:
-    HRESULT OnSourceTextChange();
+    HRESULT OnSourceTextChange(_In_ SourceTextChange change, _In_ ULONG position, _In_ ULONG count);
 
 private:
     DWORD m_dispatchThreadId;
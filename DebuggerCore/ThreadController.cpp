@@ -5,18 +5,32 @@
 #include "stdafx.h"
 #include "ThreadController.h"
 #include "PDMThreadCallback.h"
+#include "ScriptHelpers.h"
 #include "DebugThreadWindowMessages.h"
 #include <algorithm>
 #include "ad1ex.h"
 
 // Ids start at 1 so that '0' can be classed as invalid
 ULONG ThreadController::s_nextFrameId = 1;
-ULONG ThreadController::s_nextPropertyId = 1;
+ULONG ThreadController::s_nextEvalBatchId = 1;
 
 // The maximum number of eval calls we can have running simultaneously,
 // Exceeding this number will cause the current ones to abort so that the new one can run.
 const int ThreadController::s_maxConcurrentEvalCount = 20;
 
+// The time in milliseconds that the expressions in an eval batch get to complete when the caller does not give a timeout
+const ULONG ThreadController::s_defaultEvalTimeout = 5000;
+
+// The number of steps in a row that can be taken out of blackboxed code before we give up and let the script run,
+// so that a blackboxed infinite loop does not leave the debugger stepping forever with nothing on screen
+const ULONG ThreadController::s_maxBlackboxedSteps = 1000;
+
+// The object group that the locals of each call frame are placed in, matching the group the front end uses for the call stack
+const CString ThreadController::s_backtraceObjectGroup = L"backtrace";
+
+// The number of children fetched from the PDM in each call when enumerating the members of a property
+const ULONG ThreadController::s_propertyEnumBatchSize = 64;
+
 // The identifier prepended to any script eval's to mark them as coming from the F12 debugger.
 // The Q: property indicates the current size of the eval queue showing how many other pending evals are waiting.
 const CString ThreadController::s_f12EvalIdentifierPrefix = L"/*F12Eval Q:";
@@ -33,7 +47,10 @@ ThreadController::ThreadController() :
     m_isDocked(false),
     m_isConnected(false),
     m_mainIEScriptThreadId(0),
-    m_currentPDMThreadId(0)
+    m_currentPDMThreadId(0),
+    m_isCallStackComplete(true),
+    m_hasBlackboxPattern(false),
+    m_blackboxedStepCount(0)
 {
 }
 
@@ -242,6 +259,9 @@ HRESULT ThreadController::Disconnect()
     // Clear all source nodes but don't release the Controller since we will re-use it on next connect
     m_spSourceController->Clear();
 
+    // The breakpoints the conditions belong to are gone along with the sources
+    this->ClearBreakpointConditions();
+
     // Do Release the IDebugApplication pointer, since we get a new one when we next connect
     m_spDebugApplication.Release();
 
@@ -279,6 +299,25 @@ HRESULT ThreadController::Resume(_In_ BREAKRESUMEACTION breakResumeAction, _In_
         return E_NOT_VALID_STATE;
     }
 
+    return this->ResumeFromBreak(breakResumeAction, errorResumeAction, /*shouldNotifyBreakModeChanged=*/ true);
+}
+
+HRESULT ThreadController::ResumeInternalBreak()
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    if (!this->IsConnected() || !this->IsAtBreak())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    // This break was never shown to the user, so IE is not told that we resumed,
+    // since it was never told about the break in the first place (see BeginBreakNotification)
+    return this->ResumeFromBreak(BREAKRESUMEACTION_CONTINUE, ERRORRESUMEACTION_AbortCallAndReturnErrorToCaller, /*shouldNotifyBreakModeChanged=*/ false);
+}
+
+HRESULT ThreadController::ResumeFromBreak(_In_ BREAKRESUMEACTION breakResumeAction, _In_ ERRORRESUMEACTION errorResumeAction, _In_ bool shouldNotifyBreakModeChanged)
+{
     HRESULT hr = S_OK;
 
     // Scope for the CallFrame lock, the local smart pointer's addref will keep it alive after the lock
@@ -354,7 +393,7 @@ HRESULT ThreadController::Resume(_In_ BREAKRESUMEACTION breakResumeAction, _In_
     }
 
     // The synchronous call to resume can occasionally cause a PDM break, if that happens, we will still be at a break here, so don't update IE
-    if (!this->IsAtBreak())
+    if (shouldNotifyBreakModeChanged && !this->IsAtBreak())
     {
         // Inform the BHO that we have resumed from the break
         // We need to use send message to make sure that the pipe handler has sent the message to the BHO before we
@@ -433,6 +472,86 @@ HRESULT ThreadController::SetBreakOnFirstChanceExceptions(_In_ bool breakOnFirst
     return hr;
 }
 
+HRESULT ThreadController::SetExceptionFilter(_In_ const vector<CString>& ignoredUrlPatterns, _In_ ULONG sampleRate, _In_ ULONG maxBreaksPerSite, _In_ ULONG rateLimitInterval)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    // The filter is read on the PDM thread when an exception is thrown
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
+
+    m_exceptionFilter.SetIgnoredUrlPatterns(ignoredUrlPatterns);
+    m_exceptionFilter.SetSampleRate(sampleRate);
+    m_exceptionFilter.SetRateLimit(maxBreaksPerSite, rateLimitInterval);
+
+    // Start counting again under the new rules
+    m_exceptionFilter.Reset();
+
+    return S_OK;
+}
+
+HRESULT ThreadController::GetExceptionFilterInfo(_Out_ ExceptionFilterInfo& info)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
+    m_exceptionFilter.GetInfo(info);
+
+    return S_OK;
+}
+
+HRESULT ThreadController::SetBlackboxPattern(_In_ const CString& pattern)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    // Compile the pattern before taking the lock, so that a bad pattern leaves the current one in place
+    std::wregex expression;
+    if (!pattern.IsEmpty())
+    {
+        try
+        {
+            expression.assign(pattern, pattern.GetLength(), std::regex_constants::ECMAScript | std::regex_constants::optimize);
+        }
+        catch (const std::regex_error&)
+        {
+            return E_INVALIDARG;
+        }
+    }
+
+    // The pattern is read on the PDM thread when a step completes
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
+
+    m_hasBlackboxPattern = !pattern.IsEmpty();
+    m_blackboxPattern = std::move(expression);
+    m_blackboxedDocuments.clear();
+
+    return S_OK;
+}
+
+HRESULT ThreadController::ContinueBlackboxedStep()
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    if (!this->IsConnected() || !this->IsAtBreak())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    // Like Chrome, whichever way the user was stepping we leave the blackboxed function and stop at the first statement after it returns.
+    // If we keep landing in blackboxed code we stop stepping and let the script run, rather than ever showing a blackboxed frame.
+    BREAKRESUMEACTION breakResumeAction = BREAKRESUMEACTION_STEP_OUT;
+    {
+        CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
+        if (m_blackboxedStepCount > ThreadController::s_maxBlackboxedSteps)
+        {
+            breakResumeAction = BREAKRESUMEACTION_CONTINUE;
+            m_blackboxedStepCount = 0;
+        }
+    }
+
+    // The front end never saw this break, so resume the same way as for any other break we handled ourselves
+    return this->ResumeFromBreak(breakResumeAction, ERRORRESUMEACTION_AbortCallAndReturnErrorToCaller, /*shouldNotifyBreakModeChanged=*/ false);
+}
+
 HRESULT ThreadController::SetBreakOnNewWorker(_In_ bool enable)
 {
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
@@ -495,7 +614,7 @@ HRESULT ThreadController::GetBreakEventInfo(_Out_ shared_ptr<BreakEventInfo>& sp
     return S_OK;
 }
 
-HRESULT ThreadController::GetCallFrames(_Inout_ vector<shared_ptr<CallFrameInfo>>& spFrames)
+HRESULT ThreadController::GetCallFrames(_In_ ULONG framesNeeded, _Inout_ vector<shared_ptr<CallFrameInfo>>& spFrames)
 {
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
 
@@ -507,8 +626,26 @@ HRESULT ThreadController::GetCallFrames(_Inout_ vector<shared_ptr<CallFrameInfo>
         return E_NOT_VALID_STATE;
     }
 
-    for (auto& frameId : m_callFrames)
+    // A framesNeeded of 0 means the whole callstack
+    if (!m_isCallStackComplete && (framesNeeded == 0 || m_callFrames.size() < framesNeeded))
+    {
+        // The frames have to be created on the PDM thread, which takes this lock itself
+        lock.Unlock();
+
+        HRESULT hr = this->CallDebuggerThread(PDMThreadCallbackMethod::PopulateCallStack, (DWORD_PTR)this, (DWORD_PTR)framesNeeded);
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        lock.Lock();
+        if (!this->IsAtBreak())
+        {
+            return E_NOT_VALID_STATE;
+        }
+    }
+
+    size_t frameCount = (framesNeeded == 0 ? m_callFrames.size() : min(m_callFrames.size(), (size_t)framesNeeded));
+    for (size_t i = 0; i < frameCount; i++)
     {
+        ULONG frameId = m_callFrames[i];
         auto it = m_callFramesInfoMap.find(frameId);
         if (it != m_callFramesInfoMap.end())
         {
@@ -519,7 +656,7 @@ HRESULT ThreadController::GetCallFrames(_Inout_ vector<shared_ptr<CallFrameInfo>
     return S_OK;
 }
 
-HRESULT ThreadController::GetLocals(_In_ ULONG frameId, _Out_ ULONG& propertyId)
+HRESULT ThreadController::GetLocals(_In_ ULONG frameId, _Out_ PropertyHandle& propertyId)
 {
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
 
@@ -544,7 +681,7 @@ HRESULT ThreadController::GetLocals(_In_ ULONG frameId, _Out_ ULONG& propertyId)
     return S_OK;
 }
 
-HRESULT ThreadController::EnumeratePropertyMembers(_In_ ULONG propertyId, _In_ UINT radix, _Inout_ vector<shared_ptr<PropertyInfo>>& spPropertyInfos)
+HRESULT ThreadController::GetScopeChain(_In_ ULONG frameId, _Out_ ScopeChainInfo& scopeChain)
 {
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
 
@@ -556,11 +693,95 @@ HRESULT ThreadController::EnumeratePropertyMembers(_In_ ULONG propertyId, _In_ U
         return E_NOT_VALID_STATE;
     }
 
-    auto it = m_propertyMap.find(propertyId);
-    if (it != m_propertyMap.end())
+    scopeChain.localsId = 0;
+    scopeChain.closureIds.clear();
+
+    auto it = m_localsMap.find(frameId);
+    if (it == m_localsMap.end())
+    {
+        return E_NOT_FOUND;
+    }
+
+    CComPtr<IDebugProperty> spLocalsDebugProperty;
+    ULONG groupId = 0;
+    HRESULT hr = m_propertyHandles.Get(it->second, spLocalsDebugProperty, &groupId);
+    BPT_FAIL_IF_NOT_S_OK(hr);
+
+    // The front end asks for the scope chain of every frame on each snapshot, so the closure handles are kept for the rest of the break.
+    // ReleaseObjectGroup drops the entries whose handles it frees, so a cached entry is always still valid.
+    auto itCached = m_scopeChainMap.find(frameId);
+    if (itCached != m_scopeChainMap.end() && itCached->second.localsId == it->second)
+    {
+        scopeChain = itCached->second;
+        return S_OK;
+    }
+
+    scopeChain.localsId = it->second;
+
+    // The closure scopes are the fake members of the locals, so only ask for the attributes and the property itself.
+    // The real locals are skipped without creating a handle or fetching any of their strings.
+    CComPtr<IEnumDebugPropertyInfo> spEnumProps;
+    hr = spLocalsDebugProperty->EnumMembers(PROP_INFO_ATTRIBUTES | PROP_INFO_DEBUGPROP, /*radix=*/ 10, IID_IEnumDebugPropertyInfo, &spEnumProps);
+    if (hr != S_OK)
+    {
+        // A frame without members just has no closure scopes
+        m_scopeChainMap[frameId] = scopeChain;
+        return S_OK;
+    }
+
+    CAutoVectorPtr<DebugPropertyInfo> spDebugPropertyInfos;
+    bool alloced = spDebugPropertyInfos.Allocate(ThreadController::s_propertyEnumBatchSize);
+    ATLENSURE_RETURN_HR(alloced == true, E_OUTOFMEMORY);
+
+    ULONG numFetched = 0;
+    do
+    {
+        numFetched = 0;
+        hr = spEnumProps->Next(ThreadController::s_propertyEnumBatchSize, spDebugPropertyInfos.m_p, &numFetched);
+        numFetched = min(numFetched, ThreadController::s_propertyEnumBatchSize);
+
+        for (ULONG i = 0; i < numFetched; i++)
+        {
+            // Take ownership of the reference the enumerator gave us, the handle table adds its own
+            CComPtr<IDebugProperty> spDebugProperty;
+            spDebugProperty.Attach(spDebugPropertyInfos[i].m_pDebugProp);
+
+            bool isFake = ((spDebugPropertyInfos[i].m_dwAttrib & DBGPROP_ATTRIB_VALUE_IS_FAKE) == DBGPROP_ATTRIB_VALUE_IS_FAKE);
+            if (isFake && spDebugProperty.p != nullptr)
+            {
+                PropertyHandle closureId;
+                if (m_propertyHandles.Add(spDebugProperty, groupId, closureId) == S_OK)
+                {
+                    scopeChain.closureIds.push_back(closureId);
+                }
+            }
+        }
+    } while (hr == S_OK && numFetched == ThreadController::s_propertyEnumBatchSize);
+
+    m_scopeChainMap[frameId] = scopeChain;
+
+    return S_OK;
+}
+
+HRESULT ThreadController::EnumeratePropertyMembers(_In_ PropertyHandle propertyId, _In_ UINT radix, _In_ ULONG start, _In_ ULONG length, _Inout_ vector<shared_ptr<PropertyInfo>>& spPropertyInfos, _Out_ ULONG& totalCount)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    totalCount = 0;
+
+    // Lock the callframe access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
+
+    if (!this->IsConnected() || !this->IsAtBreak())
     {
-        CComPtr<IDebugProperty> spDebugProperty = it->second;
+        return E_NOT_VALID_STATE;
+    }
 
+    // Children are placed in the same object group as their parent
+    CComPtr<IDebugProperty> spDebugProperty;
+    ULONG groupId = 0;
+    if (m_propertyHandles.Get(propertyId, spDebugProperty, &groupId) == S_OK)
+    {
         // Get all the members for the children
         CComPtr<IEnumDebugPropertyInfo> spEnumProps;
         HRESULT hr = spDebugProperty->EnumMembers(PROP_INFO_ALL, radix, IID_IEnumDebugPropertyInfo, &spEnumProps);
@@ -588,27 +809,71 @@ HRESULT ThreadController::EnumeratePropertyMembers(_In_ ULONG propertyId, _In_ U
         hr = spEnumProps->GetCount(&count);
         if (hr == S_OK) // Since GetCount can fail when walking the properties, we return the hr which results in an empty array
         {
-            for (ULONG i = 0; i < count; i++)
+            totalCount = count;
+            if (start >= count)
+            {
+                return S_OK;
+            }
+
+            // Length 0 means to return all of the remaining properties
+            ULONG end = (length == 0 || length > count - start) ? count : start + length;
+
+            // Move straight to the requested window so that children before it are never materialized
+            if (start > 0)
             {
-                // Fetch each child one at a time, if we fail to get all of them, we can return with the successful ones
-                CAutoVectorPtr<DebugPropertyInfo> spDebugPropertyInfo;
-                bool alloced = spDebugPropertyInfo.Allocate(1);
-                ATLENSURE_RETURN_HR(alloced == true, E_OUTOFMEMORY);
+                hr = spEnumProps->Skip(start);
+                BPT_FAIL_IF_NOT_S_OK(hr);
+            }
+
+            CAutoVectorPtr<DebugPropertyInfo> spDebugPropertyInfos;
+            bool alloced = spDebugPropertyInfos.Allocate(min(end - start, ThreadController::s_propertyEnumBatchSize));
+            ATLENSURE_RETURN_HR(alloced == true, E_OUTOFMEMORY);
 
-                // Fetch the next child and add it to the list
+            ULONG position = start;
+            while (position < end)
+            {
+                // Fetch the next batch of children, if we fail to get all of them, we can return with the successful ones
+                ULONG requested = min(end - position, ThreadController::s_propertyEnumBatchSize);
                 ULONG numFetched = 0;
-                hr = spEnumProps->Next(1, spDebugPropertyInfo.m_p, &numFetched);
-                if (hr == S_OK && numFetched == 1) // This can fail for certain properties (e.g. location) in some conditions (e.g. a navigation), so we just ignore and continue
+                hr = spEnumProps->Next(requested, spDebugPropertyInfos.m_p, &numFetched);
+                numFetched = min(numFetched, requested);
+
+                for (ULONG i = 0; i < numFetched; i++)
                 {
                     // Get the property info
                     shared_ptr<PropertyInfo> spPropertyInfo;
-                    hr = this->PopulatePropertyInfo(spDebugPropertyInfo[0], spPropertyInfo);
-                    if (hr == S_OK)
+                    HRESULT hrPopulate = this->PopulatePropertyInfo(spDebugPropertyInfos[i], groupId, spPropertyInfo);
+                    if (hrPopulate == S_OK)
                     {
                         // Store this to the out parameter
                         spPropertyInfos.push_back(spPropertyInfo);
                     }
                 }
+
+                position += numFetched;
+
+                if (FAILED(hr) && position < end)
+                {
+                    // This can fail for certain properties (e.g. location) in some conditions (e.g. a navigation),
+                    // so we step over the child that stopped the batch using a single fetch, ignore it, and continue
+                    ULONG numSkipped = 0;
+                    hr = spEnumProps->Next(1, spDebugPropertyInfos.m_p, &numSkipped);
+                    if (hr == S_OK && numSkipped == 1)
+                    {
+                        shared_ptr<PropertyInfo> spPropertyInfo;
+                        if (this->PopulatePropertyInfo(spDebugPropertyInfos[0], groupId, spPropertyInfo) == S_OK)
+                        {
+                            spPropertyInfos.push_back(spPropertyInfo);
+                        }
+                    }
+
+                    position++;
+                }
+                else if (hr != S_OK || numFetched < requested)
+                {
+                    // The enumerator ran out of children before the count it reported
+                    break;
+                }
             }
         }
     }
@@ -620,7 +885,7 @@ HRESULT ThreadController::EnumeratePropertyMembers(_In_ ULONG propertyId, _In_ U
     return S_OK;
 }
 
-HRESULT ThreadController::SetPropertyValueAsString(_In_ ULONG propertyId, _In_ BSTR* pValue, _In_ UINT radix)
+HRESULT ThreadController::SetPropertyValueAsString(_In_ PropertyHandle propertyId, _In_ BSTR* pValue, _In_ UINT radix)
 {
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
 
@@ -634,20 +899,58 @@ HRESULT ThreadController::SetPropertyValueAsString(_In_ ULONG propertyId, _In_ B
 
     HRESULT hr = S_OK;
 
-    auto it = m_propertyMap.find(propertyId);
-    if (it != m_propertyMap.end())
+    CComPtr<IDebugProperty> spDebugProperty;
+    hr = m_propertyHandles.Get(propertyId, spDebugProperty);
+    if (hr == S_OK)
     {
-        hr = it->second->SetValueAsString(*pValue, radix);
+        hr = spDebugProperty->SetValueAsString(*pValue, radix);
     }
-    else
+
+    return hr;
+}
+
+HRESULT ThreadController::ReleaseObjectGroup(_In_ const CString& objectGroup)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    // Lock the callframe access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
+
+    HRESULT hr = m_propertyHandles.ReleaseObjectGroup(objectGroup);
+    if (hr == S_OK)
     {
-        hr = E_NOT_FOUND;
+        // Forget the scope chains that were created in the released group, they are created again if they are asked for.
+        // The closures are always in the same group as their locals, so checking the locals handle is enough.
+        for (auto it = m_scopeChainMap.begin(); it != m_scopeChainMap.end();)
+        {
+            CComPtr<IDebugProperty> spLocalsDebugProperty;
+            if (m_propertyHandles.Get(it->second.localsId, spLocalsDebugProperty) != S_OK)
+            {
+                it = m_scopeChainMap.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
     }
 
     return hr;
 }
 
-HRESULT ThreadController::Eval(_In_ ULONG frameId, _In_ const CComBSTR& evalString, _In_ ULONG radix, _Out_ shared_ptr<PropertyInfo>& spPropertyInfo)
+HRESULT ThreadController::GetPropertyHandleInfo(_Out_ PropertyHandleTableInfo& info)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    // Lock the callframe access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
+
+    m_propertyHandles.GetMemoryInfo(info);
+
+    return S_OK;
+}
+
+HRESULT ThreadController::Eval(_In_ ULONG frameId, _In_ const CComBSTR& evalString, _In_ ULONG radix, _In_ const CString& objectGroup, _Out_ shared_ptr<PropertyInfo>& spPropertyInfo)
 {
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
 
@@ -693,60 +996,25 @@ HRESULT ThreadController::Eval(_In_ ULONG frameId, _In_ const CComBSTR& evalStri
         // This will allow the PDM thread to update the callstacks on its thread.
         lock.Unlock();
 
-        // Local scope for COM objects.
-        {
-            // Keep our reference alive until all evals have finished (or been aborted)
-            CComObjPtr<ThreadController> spKeepAlive(this);
-
-            // Create expression callback
-            CComObject<EvalCallback>* pDebugCallback;
-            CComObject<EvalCallback>::CreateInstance(&pDebugCallback);
-            ATLENSURE_RETURN_HR(pDebugCallback != nullptr, E_NOINTERFACE);
-            
-            CComObjPtr<EvalCallback> spDebugCallback(pDebugCallback);
-            hr = spDebugCallback->Initialize();
-            BPT_FAIL_IF_NOT_S_OK(hr);
-
-            // Add this to our list so we can abandon it if we resume or close before it completes
-            m_evalCallbacks.push_back(::make_pair(spDebugExpression, spDebugCallback));
-
-            // Evaluate the expression
-            hr = spDebugExpression->Start(spDebugCallback);
-            BPT_FAIL_IF_NOT_S_OK(hr);
-
-            hr = spDebugCallback->WaitForCompletion();
-
-            // Remove from our list
-            ATLENSURE_RETURN_HR(m_evalCallbacks.back().first == spDebugExpression, E_UNEXPECTED);
-            m_evalCallbacks.pop_back();
-
-            // Check if we were closed down before this evaluation completed, if so just return abort failure
-            if (hr == E_ABORT)
-            {
-                return hr;
-            }
-        }
-
-        HRESULT returnResult;
         CComPtr<IDebugProperty> spDebugProperty;
-
-        // Determine if the expression evaluation was successful
-        hr = spDebugExpression->GetResultAsDebugProperty(&returnResult, &spDebugProperty);
-        BPT_FAIL_IF_NOT_S_OK(hr);
-
-        // The get result function should always succeed, but the actual result from the eval could fail if
-        // chakra was unable to process the request. If that is the case we should return the failure out
-        // to the caller, which will result in sending null to the JavaScript which is handled correctly.
-        if (returnResult != S_OK)
+        hr = this->RunDebugExpression(spDebugExpression, spDebugProperty);
+        if (hr != S_OK)
         {
-            return returnResult;
+            return hr;
         }
 
         DebugPropertyInfo propInfo;
         hr = spDebugProperty->GetPropertyInfo(PROP_INFO_ALL, radix, &propInfo);
         if (hr == S_OK)
         {
-            hr = this->PopulatePropertyInfo(propInfo, spPropertyInfo);
+            // Take the lock back before storing the result in the property handle table
+            lock.Lock();
+            if (!this->IsAtBreak())
+            {
+                return E_NOT_VALID_STATE;
+            }
+
+            hr = this->PopulatePropertyInfo(propInfo, m_propertyHandles.GetObjectGroupId(objectGroup), spPropertyInfo);
         }
         else
         {
@@ -761,10 +1029,12 @@ HRESULT ThreadController::Eval(_In_ ULONG frameId, _In_ const CComBSTR& evalStri
     return hr;
 }
 
-HRESULT ThreadController::CanSetNextStatement(_In_ ULONG docId, _In_ ULONG start)
+HRESULT ThreadController::BeginEvalBatch(_In_ ULONG frameId, _In_ const vector<CComBSTR>& expressions, _In_ ULONG radix, _In_ const CString& objectGroup, _In_ ULONG timeout, _Out_ ULONG& batchId)
 {
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
 
+    batchId = 0;
+
     // Lock the callframe access
     CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
 
@@ -773,65 +1043,531 @@ HRESULT ThreadController::CanSetNextStatement(_In_ ULONG docId, _In_ ULONG start
         return E_NOT_VALID_STATE;
     }
 
-    HRESULT hr = S_OK;
+    auto it = m_debugFrameMap.find(frameId);
+    if (it == m_debugFrameMap.end())
+    {
+        return E_NOT_FOUND;
+    }
 
-    // We use the current call frame, which should be the first one in the m_callFrames list
-    ULONG firstFrameId = (m_callFrames.empty() ? 0 : m_callFrames.front());
+    CComQIPtr<IDebugExpressionContext> spEvalContext(it->second);
+    ATLENSURE_RETURN_HR(spEvalContext.p != nullptr, E_NOINTERFACE);
 
-    auto it = m_debugFrameMap.find(firstFrameId);
-    if (it != m_debugFrameMap.end())
-    {
-        // Get the code context for the passed in map
-        // If it is not found, we fail gracefully (no assert) to the caller
-        CComPtr<IDebugCodeContext> spDebugCodeContext;
-        hr = m_spSourceController->GetCodeContext(docId, start, spDebugCodeContext);
-        if (hr == S_OK) // This could fail due to requiring a refresh (the caller will handle the hresult)
-        {
-            CComQIPtr<IDebugStackFrame> spStackFrame(it->second);
-            ATLENSURE_RETURN_HR(spStackFrame.p != nullptr, E_NOINTERFACE);
+    PendingEvalBatch batch;
+    batch.spBatch.reset(new EvalBatchInfo());
+    batch.spBatch->batchId = ThreadController::CreateUniqueEvalBatchId();
+    batch.spBatch->results.resize(expressions.size());
+    batch.radix = radix;
+    batch.groupId = m_propertyHandles.GetObjectGroupId(objectGroup);
+    batch.deadline = ::GetTickCount64() + (timeout != 0 ? timeout : ThreadController::s_defaultEvalTimeout);
 
-            CComQIPtr<ISetNextStatement> spSetter(spStackFrame);
-            ATLENSURE_RETURN_HR(spSetter.p != nullptr, E_NOINTERFACE);
+    // Parse everything up front, an expression that does not parse fails on its own without affecting the rest of the batch
+    for (size_t i = 0; i < expressions.size(); i++)
+    {
+        CString evalWithId;
+        evalWithId.Format(ThreadController::s_f12EvalIdentifier, static_cast<ULONG>(m_evalCallbacks.size() + i));
+        evalWithId.Append(expressions[i]);
 
-            hr = spSetter->CanSetNextStatement(spStackFrame, spDebugCodeContext);
+        PendingEval eval;
+        eval.index = i;
+        HRESULT hr = spEvalContext->ParseLanguageText(evalWithId, radix, L"" /* not actually used, but required */, DEBUG_TEXT_RETURNVALUE | DEBUG_TEXT_ISEXPRESSION, &eval.spDebugExpression);
+        if (hr != S_OK)
+        {
+            batch.spBatch->results[i].status = EvalStatus::Failed;
+            continue;
         }
+
+        batch.evals.push_back(eval);
     }
-    else
+
+    batchId = batch.spBatch->batchId;
+    if (batch.evals.empty())
     {
-        return E_NOT_FOUND;
+        // Nothing is running, but the results are still delivered asynchronously like any other batch
+        m_finishedEvalBatches.push_back(batch.spBatch);
+        m_spMessageQueue->Push(PDMEventType::EvalCompleted);
+
+        return S_OK;
     }
 
-    return hr;
+    // The expressions are queued and started as the concurrent eval limit allows,
+    // anything not started yet is picked up again as the running ones complete.
+    // Once the batch is stored its results are always delivered, so a failure to start is reported through the batch.
+    m_evalBatches[batchId] = batch;
+    this->StartQueuedEvals(lock);
+
+    return S_OK;
 }
 
-HRESULT ThreadController::SetNextStatement(_In_ ULONG docId, _In_ ULONG start)
+HRESULT ThreadController::StartQueuedEvals(_Inout_ CComCritSecLock<CComAutoCriticalSection>& lock)
 {
-    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+    // This must be called with the callframes lock held, it is released while the expressions are started
 
-    // Lock the callframe access
-    CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
+    struct StartingEval
+    {
+        ULONG batchId;
+        size_t index;
+        CComPtr<IDebugExpression> spDebugExpression;
+        CComObjPtr<AsyncEvalCallback> spCallback;
+    };
+    vector<StartingEval> starting;
 
-    if (!this->IsConnected() || !this->IsAtBreak())
+    // Batched evals share the concurrent eval limit with single evals
+    size_t runningCount = m_evalCallbacks.size();
+    for (const auto& batchPair : m_evalBatches)
     {
-        return E_NOT_VALID_STATE;
+        for (const auto& eval : batchPair.second.evals)
+        {
+            if (eval.spCallback.p != nullptr)
+            {
+                runningCount++;
+            }
+        }
     }
 
     HRESULT hr = S_OK;
-
-    // We use the current call frame, which should be the first one in the m_callFrames list
-    ULONG firstFrameId = (m_callFrames.empty() ? 0 : m_callFrames.front());
-
-    auto it = m_debugFrameMap.find(firstFrameId);
-    if (it != m_debugFrameMap.end())
+    for (auto itBatch = m_evalBatches.begin(); itBatch != m_evalBatches.end() && hr == S_OK; ++itBatch)
     {
-        // Get the code context for the passed in map
-        // If it is not found, we fail gracefully (no assert) to the caller
-        CComPtr<IDebugCodeContext> spDebugCodeContext;
-        hr = m_spSourceController->GetCodeContext(docId, start, spDebugCodeContext);
-        if (hr == S_OK) // This could fail due to requiring a refresh (the caller will handle the hresult)
+        for (auto& eval : itBatch->second.evals)
         {
-            CComQIPtr<IDebugStackFrame> spStackFrame(it->second);
-            ATLENSURE_RETURN_HR(spStackFrame.p != nullptr, E_NOINTERFACE);
+            if (runningCount >= static_cast<size_t>(ThreadController::s_maxConcurrentEvalCount))
+            {
+                break;
+            }
+
+            if (eval.spCallback.p != nullptr)
+            {
+                continue;
+            }
+
+            // If we cannot create a callback, the ones we already have are still started and the rest stay queued
+            CComObject<AsyncEvalCallback>* pCallback;
+            hr = CComObject<AsyncEvalCallback>::CreateInstance(&pCallback);
+            if (hr != S_OK)
+            {
+                break;
+            }
+
+            CComObjPtr<AsyncEvalCallback> spCallback(pCallback);
+            hr = spCallback->Initialize(m_spMessageQueue);
+            if (hr != S_OK)
+            {
+                break;
+            }
+
+            // Mark it as running now so that it is not picked up again while the lock is free
+            eval.spCallback = spCallback;
+            runningCount++;
+
+            StartingEval startingEval;
+            startingEval.batchId = itBatch->first;
+            startingEval.index = eval.index;
+            startingEval.spDebugExpression = eval.spDebugExpression;
+            startingEval.spCallback = spCallback;
+            starting.push_back(startingEval);
+        }
+    }
+
+    if (starting.empty())
+    {
+        return hr;
+    }
+
+    // Free the lock as we no longer use the eval context, the PDM may need the callstack to run the expressions
+    lock.Unlock();
+
+    // Start the expressions without waiting, the PDM runs them in order and each callback
+    // queues a notification for the dispatch thread when its expression completes.
+    vector<bool> hasStarted(starting.size(), false);
+    for (size_t i = 0; i < starting.size(); i++)
+    {
+        hasStarted[i] = (starting[i].spDebugExpression->Start(starting[i].spCallback) == S_OK);
+    }
+
+    lock.Lock();
+    if (!this->IsAtBreak())
+    {
+        // We resumed while starting the expressions, so they will never complete
+        for (auto& startingEval : starting)
+        {
+            startingEval.spDebugExpression->Abort();
+        }
+
+        return E_NOT_VALID_STATE;
+    }
+
+    // Expressions that did not start fail on their own without affecting the rest of their batch
+    bool hasFailedStart = false;
+    for (size_t i = 0; i < starting.size(); i++)
+    {
+        auto it = m_evalBatches.find(starting[i].batchId);
+        if (hasStarted[i] || it == m_evalBatches.end())
+        {
+            continue;
+        }
+
+        hasFailedStart = true;
+
+        auto& evals = it->second.evals;
+        for (auto itEval = evals.begin(); itEval != evals.end(); ++itEval)
+        {
+            if (itEval->index == starting[i].index)
+            {
+                it->second.spBatch->results[itEval->index].status = EvalStatus::Failed;
+                evals.erase(itEval);
+                break;
+            }
+        }
+    }
+
+    // No callback will fire for these, so make sure the dispatch comes back for a batch that may now be finished
+    if (hasFailedStart)
+    {
+        m_spMessageQueue->Push(PDMEventType::EvalCompleted);
+    }
+
+    return hr;
+}
+
+HRESULT ThreadController::CancelEvalBatch(_In_ ULONG batchId)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    // Lock the callframe access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
+
+    auto it = m_evalBatches.find(batchId);
+    if (it == m_evalBatches.end())
+    {
+        return E_NOT_FOUND;
+    }
+
+    for (auto& eval : it->second.evals)
+    {
+        if (eval.spCallback.p != nullptr)
+        {
+            eval.spDebugExpression->Abort();
+        }
+
+        it->second.spBatch->results[eval.index].status = EvalStatus::Cancelled;
+    }
+
+    m_finishedEvalBatches.push_back(it->second.spBatch);
+    m_evalBatches.erase(it);
+    m_spMessageQueue->Push(PDMEventType::EvalCompleted);
+
+    return S_OK;
+}
+
+HRESULT ThreadController::GetFinishedEvalBatches(_Inout_ vector<shared_ptr<EvalBatchInfo>>& batches, _Out_ bool& hasPendingBatches)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    hasPendingBatches = false;
+
+    // The property info returned by the PDM owns its strings and a reference on the property,
+    // so the holder frees whatever was not handed over to a PropertyInfo, whichever way we leave
+    struct CompletedEval
+    {
+        ULONG batchId;
+        size_t index;
+        ULONG radix;
+        CComPtr<IDebugExpression> spDebugExpression;
+        HRESULT hr;
+        DebugPropertyInfo propInfo;
+
+        CompletedEval() :
+            batchId(0),
+            index(0),
+            radix(10),
+            hr(E_FAIL)
+        {
+            ::ZeroMemory(&propInfo, sizeof(propInfo));
+        }
+
+        ~CompletedEval()
+        {
+            if ((propInfo.m_dwValidFields & DBGPROP_INFO_NAME) == DBGPROP_INFO_NAME)
+            {
+                ::SysFreeString(propInfo.m_bstrName);
+            }
+
+            if ((propInfo.m_dwValidFields & DBGPROP_INFO_TYPE) == DBGPROP_INFO_TYPE)
+            {
+                ::SysFreeString(propInfo.m_bstrType);
+            }
+
+            if ((propInfo.m_dwValidFields & DBGPROP_INFO_VALUE) == DBGPROP_INFO_VALUE)
+            {
+                ::SysFreeString(propInfo.m_bstrValue);
+            }
+
+            if ((propInfo.m_dwValidFields & DBGPROP_INFO_FULLNAME) == DBGPROP_INFO_FULLNAME)
+            {
+                ::SysFreeString(propInfo.m_bstrFullName);
+            }
+
+            if ((propInfo.m_dwValidFields & DBGPROP_INFO_DEBUGPROP) == DBGPROP_INFO_DEBUGPROP && propInfo.m_pDebugProp != nullptr)
+            {
+                propInfo.m_pDebugProp->Release();
+            }
+        }
+
+    private:
+        CompletedEval(const CompletedEval&);
+        CompletedEval& operator=(const CompletedEval&);
+    };
+    vector<unique_ptr<CompletedEval>> completed;
+
+    // Lock the callframe access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
+
+    // Find the expressions that have completed and time out the ones that have run for too long
+    ULONGLONG now = ::GetTickCount64();
+    for (auto& batchPair : m_evalBatches)
+    {
+        PendingEvalBatch& batch = batchPair.second;
+        for (auto itEval = batch.evals.begin(); itEval != batch.evals.end();)
+        {
+            // Expressions still waiting for a free eval slot have no callback yet
+            bool isRunning = (itEval->spCallback.p != nullptr);
+            if (isRunning && itEval->spCallback->IsCompleted())
+            {
+                unique_ptr<CompletedEval> spEval(new CompletedEval());
+                spEval->batchId = batchPair.first;
+                spEval->index = itEval->index;
+                spEval->radix = batch.radix;
+                spEval->spDebugExpression = itEval->spDebugExpression;
+                completed.push_back(std::move(spEval));
+            }
+            else if (now >= batch.deadline)
+            {
+                if (isRunning)
+                {
+                    itEval->spDebugExpression->Abort();
+                }
+
+                batch.spBatch->results[itEval->index].status = EvalStatus::TimedOut;
+            }
+            else
+            {
+                ++itEval;
+                continue;
+            }
+
+            itEval = batch.evals.erase(itEval);
+        }
+    }
+
+    // Free the lock while the results are fetched from the PDM, as in Eval
+    lock.Unlock();
+
+    for (auto& spEval : completed)
+    {
+        HRESULT returnResult;
+        CComPtr<IDebugProperty> spDebugProperty;
+        spEval->hr = spEval->spDebugExpression->GetResultAsDebugProperty(&returnResult, &spDebugProperty);
+        if (spEval->hr == S_OK && returnResult == S_OK && spDebugProperty.p != nullptr)
+        {
+            spEval->hr = spDebugProperty->GetPropertyInfo(PROP_INFO_ALL, spEval->radix, &spEval->propInfo);
+            if (spEval->hr != S_OK)
+            {
+                spEval->propInfo.m_dwValidFields = 0;
+            }
+        }
+        else
+        {
+            spEval->hr = E_FAIL;
+        }
+    }
+
+    lock.Lock();
+
+    bool isAtBreak = this->IsAtBreak();
+    for (auto& spEval : completed)
+    {
+        auto it = m_evalBatches.find(spEval->batchId);
+        if (it == m_evalBatches.end() || !isAtBreak)
+        {
+            // Cancelled while we were fetching the result, the holder frees the property info
+            continue;
+        }
+
+        EvalResultInfo& result = it->second.spBatch->results[spEval->index];
+        result.status = EvalStatus::Failed;
+        if (spEval->hr == S_OK && this->PopulatePropertyInfo(spEval->propInfo, it->second.groupId, result.spPropertyInfo) == S_OK)
+        {
+            // The strings now belong to the PropertyInfo, the holder still releases our reference on the property
+            spEval->propInfo.m_dwValidFields &= ~(DBGPROP_INFO_NAME | DBGPROP_INFO_TYPE | DBGPROP_INFO_VALUE | DBGPROP_INFO_FULLNAME);
+            result.status = EvalStatus::Completed;
+        }
+    }
+
+    // Start anything that was waiting for the expressions that just completed
+    if (isAtBreak)
+    {
+        this->StartQueuedEvals(lock);
+    }
+
+    // Hand back every batch that has nothing left running
+    batches.insert(batches.end(), m_finishedEvalBatches.begin(), m_finishedEvalBatches.end());
+    m_finishedEvalBatches.clear();
+
+    for (auto it = m_evalBatches.begin(); it != m_evalBatches.end();)
+    {
+        if (it->second.evals.empty())
+        {
+            batches.push_back(it->second.spBatch);
+            it = m_evalBatches.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    hasPendingBatches = !m_evalBatches.empty();
+
+    return S_OK;
+}
+
+void ThreadController::RemoveBreakpointCondition(_In_ ULONG breakpointId)
+{
+    // This can be called whether or not we are at a break
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
+
+    m_conditionCache.erase(breakpointId);
+}
+
+void ThreadController::ClearBreakpointConditions()
+{
+    // This can be called whether or not we are at a break
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
+
+    m_conditionCache.clear();
+}
+
+HRESULT ThreadController::EvaluateBreakConditions(_In_ const shared_ptr<BreakEventInfo>& spBreakInfo, _Out_ bool& shouldBreak, _Inout_ vector<TracepointMessage>& tracepointMessages)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+    ATLENSURE_RETURN_HR(spBreakInfo.get() != nullptr, E_INVALIDARG);
+
+    shouldBreak = true;
+
+    // Only breakpoint breaks have conditions, every other break (steps, exceptions, pauses) always stops
+    if (spBreakInfo->breakReason != BREAKREASON_BREAKPOINT || spBreakInfo->breakpoints.empty())
+    {
+        return S_OK;
+    }
+
+    // We stop if any of the breakpoints at this location wants to stop,
+    // but every tracepoint at the location still logs its message even when we are going to stop anyway.
+    shouldBreak = false;
+    for (const auto& spBreakpoint : spBreakInfo->breakpoints)
+    {
+        if (spBreakpoint->isTracepoint)
+        {
+            // Tracepoints never stop, a message that fails to evaluate is logged as an error instead
+            TracepointMessage message;
+            this->EvaluateTracepoint(spBreakInfo->firstFrameId, *spBreakpoint, message);
+            tracepointMessages.push_back(message);
+            continue;
+        }
+
+        if (shouldBreak)
+        {
+            // Already stopping, so there is no need to run any more conditions
+            continue;
+        }
+
+        if (spBreakpoint->condition.Length() == 0)
+        {
+            shouldBreak = true;
+            continue;
+        }
+
+        bool result = true;
+        HRESULT hr = this->EvaluateConditionalBreakpoint(spBreakInfo->firstFrameId, *spBreakpoint, result);
+        if (hr != S_OK || result)
+        {
+            // A condition that fails to evaluate stops as well, so that the user can see the problem
+            shouldBreak = true;
+        }
+    }
+
+    return S_OK;
+}
+
+HRESULT ThreadController::CanSetNextStatement(_In_ ULONG docId, _In_ ULONG start)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    // Lock the callframe access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
+
+    if (!this->IsConnected() || !this->IsAtBreak())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    HRESULT hr = S_OK;
+
+    // We use the current call frame, which should be the first one in the m_callFrames list
+    ULONG firstFrameId = (m_callFrames.empty() ? 0 : m_callFrames.front());
+
+    auto it = m_debugFrameMap.find(firstFrameId);
+    if (it != m_debugFrameMap.end())
+    {
+        // Get the code context for the passed in map
+        // If it is not found, we fail gracefully (no assert) to the caller
+        CComPtr<IDebugCodeContext> spDebugCodeContext;
+        hr = m_spSourceController->GetCodeContext(docId, start, spDebugCodeContext);
+        if (hr == S_OK) // This could fail due to requiring a refresh (the caller will handle the hresult)
+        {
+            CComQIPtr<IDebugStackFrame> spStackFrame(it->second);
+            ATLENSURE_RETURN_HR(spStackFrame.p != nullptr, E_NOINTERFACE);
+
+            CComQIPtr<ISetNextStatement> spSetter(spStackFrame);
+            ATLENSURE_RETURN_HR(spSetter.p != nullptr, E_NOINTERFACE);
+
+            hr = spSetter->CanSetNextStatement(spStackFrame, spDebugCodeContext);
+        }
+    }
+    else
+    {
+        return E_NOT_FOUND;
+    }
+
+    return hr;
+}
+
+HRESULT ThreadController::SetNextStatement(_In_ ULONG docId, _In_ ULONG start)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    // Lock the callframe access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
+
+    if (!this->IsConnected() || !this->IsAtBreak())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    HRESULT hr = S_OK;
+
+    // We use the current call frame, which should be the first one in the m_callFrames list
+    ULONG firstFrameId = (m_callFrames.empty() ? 0 : m_callFrames.front());
+
+    auto it = m_debugFrameMap.find(firstFrameId);
+    if (it != m_debugFrameMap.end())
+    {
+        // Get the code context for the passed in map
+        // If it is not found, we fail gracefully (no assert) to the caller
+        CComPtr<IDebugCodeContext> spDebugCodeContext;
+        hr = m_spSourceController->GetCodeContext(docId, start, spDebugCodeContext);
+        if (hr == S_OK) // This could fail due to requiring a refresh (the caller will handle the hresult)
+        {
+            CComQIPtr<IDebugStackFrame> spStackFrame(it->second);
+            ATLENSURE_RETURN_HR(spStackFrame.p != nullptr, E_NOINTERFACE);
 
             CComQIPtr<ISetNextStatement> spSetter(spStackFrame);
             ATLENSURE_RETURN_HR(spSetter.p != nullptr, E_NOINTERFACE);
@@ -848,19 +1584,54 @@ HRESULT ThreadController::SetNextStatement(_In_ ULONG docId, _In_ ULONG start)
 }
 
 // PDM Event Notifications
-HRESULT ThreadController::OnPDMBreak(_In_ IRemoteDebugApplicationThread* pRDAThread, _In_ BREAKREASON br, _In_ const CComBSTR& description, _In_ WORD errorId, _In_ bool isFirstChance, _In_ bool isUserUnhandled)
+HRESULT ThreadController::OnPDMBreak(_In_ IRemoteDebugApplicationThread* pRDAThread, _In_ BREAKREASON br, _In_opt_ IActiveScriptErrorDebug* pError, _In_ const CComBSTR& description, _In_ WORD errorId, _In_ bool isFirstChance, _In_ bool isUserUnhandled)
 {
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnPDMThread(m_dispatchThreadId), E_UNEXPECTED);
 
     CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
 
-    // Get the new call stack information
+    // First chance exceptions that the user filtered out are resumed before we walk the stack or create anything for the break.
+    // We cannot resume synchronously from here without deadlocking the PDM, so the dispatch is asked to resume straight away instead.
+    // User unhandled exceptions always stop, since the user would otherwise never see them.
+    if (br == BREAKREASON_ERROR && isFirstChance && !isUserUnhandled && pError != nullptr && this->IsFilteredException(pError))
+    {
+        m_spCurrentBrokenThread = pRDAThread;
+        m_spCurrentBreakInfo.reset(new BreakEventInfo());
+        m_spCurrentBreakInfo->breakReason = br;
+        m_spCurrentBreakInfo->isFirstChanceException = true;
+
+        m_spMessageQueue->Push(PDMEventType::ExceptionFiltered);
+
+        return S_OK;
+    }
+
+    // Get the new call stack information, only the top frame is needed to process the break,
+    // the rest of the frames are created when the front end asks for them
     m_spCurrentBrokenThread = pRDAThread;
-    this->PopulateCallStack();
+    m_spStackFrameEnum.Release();
+    m_isCallStackComplete = false;
+    this->PopulateCallStack(/*framesNeeded=*/ 1);
 
     // If the callframe list is empty, we were not given any information about this break, so default to invalid id (0)
     ULONG firstFrameId = (m_callFrames.empty() ? 0 : m_callFrames.front());
 
+    // A step that finished inside blackboxed code is continued without the front end ever seeing it.
+    // Like filtered exceptions, the dispatch has to do the actual step since we cannot resume from here.
+    if (br == BREAKREASON_STEP && this->IsBlackboxedFrame(firstFrameId))
+    {
+        m_blackboxedStepCount++;
+
+        m_spCurrentBreakInfo.reset(new BreakEventInfo());
+        m_spCurrentBreakInfo->firstFrameId = firstFrameId;
+        m_spCurrentBreakInfo->breakReason = br;
+
+        m_spMessageQueue->Push(PDMEventType::BlackboxedStep);
+
+        return S_OK;
+    }
+
+    m_blackboxedStepCount = 0;
+
     // Set our new break state
     m_spCurrentBreakInfo.reset(new BreakEventInfo());
     m_spCurrentBreakInfo->firstFrameId = firstFrameId;
@@ -949,6 +1720,11 @@ HRESULT ThreadController::OnWaitCallback()
     return this->WaitForBreakNotification();
 }
 
+HRESULT ThreadController::OnPopulateCallStackCallback(_In_ ULONG framesNeeded)
+{
+    return this->PopulateCallStack(framesNeeded);
+}
+
 // Helper functions
 HRESULT ThreadController::GetRemoteDebugApplication(_Out_ CComPtr<IRemoteDebugApplication>& spRemoteDebugApplication)
 {
@@ -998,7 +1774,7 @@ HRESULT ThreadController::CallDebuggerThread(_In_ PDMThreadCallbackMethod method
     return hr;
 }
 
-HRESULT ThreadController::PopulateCallStack()
+HRESULT ThreadController::PopulateCallStack(_In_ ULONG framesNeeded)
 {
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnPDMThread(m_dispatchThreadId), E_UNEXPECTED);
     ATLENSURE_RETURN_HR(this->IsAtBreak(), E_NOT_VALID_STATE);
@@ -1006,22 +1782,40 @@ HRESULT ThreadController::PopulateCallStack()
     // Lock the access to the callstack so that we are thread safe
     CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
 
-    CComPtr<IEnumDebugStackFrames> pStackFrameEnum;
-    HRESULT hr = m_spCurrentBrokenThread->EnumStackFrames(&pStackFrameEnum);
-    if (hr == S_OK)
+    if (m_isCallStackComplete)
+    {
+        return S_OK;
+    }
+
+    HRESULT hr = S_OK;
+    if (m_spStackFrameEnum.p == nullptr)
     {
-        if ((hr = pStackFrameEnum->Reset()) != S_OK)
+        // The enumerator is kept for the whole break so that later frames continue where the last call stopped
+        hr = m_spCurrentBrokenThread->EnumStackFrames(&m_spStackFrameEnum);
+        if (hr == S_OK && (hr = m_spStackFrameEnum->Reset()) != S_OK)
         {
+            m_spStackFrameEnum.Release();
             return hr;
         }
+    }
 
-        shared_ptr<DebugStackFrameDescriptor> spFrameDescriptor(new DebugStackFrameDescriptor());
+    if (hr == S_OK)
+    {
         ULONG nFetched;
-        for (ULONG ulIndex = 0; (pStackFrameEnum->Next(1, spFrameDescriptor.get(), &nFetched) == S_OK) && (nFetched == 1); ulIndex++)
+        while (framesNeeded == 0 || m_callFrames.size() < framesNeeded)
         {
+            // Each frame needs its own descriptor since the CallFrame holds on to it
+            shared_ptr<DebugStackFrameDescriptor> spFrameDescriptor(new DebugStackFrameDescriptor());
+            if (m_spStackFrameEnum->Next(1, spFrameDescriptor.get(), &nFetched) != S_OK || nFetched != 1)
+            {
+                // We have walked the whole stack, so there is nothing left to create
+                m_isCallStackComplete = true;
+                m_spStackFrameEnum.Release();
+                break;
+            }
+
             // Get a new identifier for this source node
             ULONG newFrameId = ThreadController::CreateUniqueFrameId();
-            ULONG newPropertyId = ThreadController::CreateUniquePropertyId();
 
             // Create object that represents the source file
             CComObject<CallFrame>* pFrame;
@@ -1045,24 +1839,31 @@ HRESULT ThreadController::PopulateCallStack()
             // Store that info in our maps
             m_callFramesInfoMap[newFrameId] = spFrameInfo;
             m_debugFrameMap[newFrameId] = spStackFrame;
-            m_propertyMap[newPropertyId] = spLocalsDebugProperty;
+            PropertyHandle newPropertyId;
+            hr = m_propertyHandles.Add(spLocalsDebugProperty, m_propertyHandles.GetObjectGroupId(ThreadController::s_backtraceObjectGroup), newPropertyId);
+            BPT_FAIL_IF_NOT_S_OK(hr);
 
             // Link the locals to the frame id for later lookup
             m_localsMap[newFrameId] = newPropertyId;
         }
     }
+    else
+    {
+        m_isCallStackComplete = true;
+    }
 
     return S_OK;
 }
 
-HRESULT ThreadController::PopulatePropertyInfo(_Inout_ DebugPropertyInfo& propInfo, _Out_ shared_ptr<PropertyInfo>& spPropertyInfo)
+HRESULT ThreadController::PopulatePropertyInfo(_Inout_ DebugPropertyInfo& propInfo, _In_ ULONG groupId, _Out_ shared_ptr<PropertyInfo>& spPropertyInfo)
 {
     ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
     ATLENSURE_RETURN_HR(propInfo.m_pDebugProp != nullptr, E_INVALIDARG);
 
     // Store this property for later enumeration
-    ULONG newPropertyId = ThreadController::CreateUniquePropertyId();
-    m_propertyMap[newPropertyId] = propInfo.m_pDebugProp;
+    PropertyHandle newPropertyId;
+    HRESULT hr = m_propertyHandles.Add(propInfo.m_pDebugProp, groupId, newPropertyId);
+    BPT_FAIL_IF_NOT_S_OK(hr);
 
     // Create the info and assign to the out param
     spPropertyInfo.reset(new PropertyInfo());
@@ -1106,6 +1907,317 @@ HRESULT ThreadController::PopulatePropertyInfo(_Inout_ DebugPropertyInfo& propIn
     return S_OK;
 }
 
+bool ThreadController::IsFilteredException(_In_ IActiveScriptErrorDebug* pError)
+{
+    ATLENSURE_RETURN_VAL(ThreadHelpers::IsOnPDMThread(m_dispatchThreadId), false);
+    ATLENSURE_RETURN_VAL(pError != nullptr, false);
+
+    if (m_exceptionFilter.IsEmpty())
+    {
+        return false;
+    }
+
+    // The throw site is the position the engine reports for the error, so no stack walk is needed to find it
+    DWORD sourceContext = 0;
+    ULONG lineNumber = 0;
+    LONG column = 0;
+    if (pError->GetSourcePosition(&sourceContext, &lineNumber, &column) != S_OK)
+    {
+        return false;
+    }
+
+    // Only look up the document when there are url rules to match against it
+    CComBSTR url;
+    if (m_exceptionFilter.HasUrlPatterns())
+    {
+        CComPtr<IDebugDocumentContext> spDocumentContext;
+        if (pError->GetDocumentContext(&spDocumentContext) == S_OK && spDocumentContext.p != nullptr)
+        {
+            CComPtr<IDebugDocument> spDocument;
+            if (spDocumentContext->GetDocument(&spDocument) == S_OK && spDocument.p != nullptr)
+            {
+                spDocument->GetName(DOCUMENTNAMETYPE_URL, &url);
+            }
+        }
+    }
+
+    return !m_exceptionFilter.ShouldBreak(sourceContext, lineNumber, column, url, ::GetTickCount64());
+}
+
+bool ThreadController::IsBlackboxedFrame(_In_ ULONG frameId)
+{
+    ATLENSURE_RETURN_VAL(ThreadHelpers::IsOnPDMThread(m_dispatchThreadId), false);
+
+    if (!m_hasBlackboxPattern)
+    {
+        return false;
+    }
+
+    auto it = m_callFramesInfoMap.find(frameId);
+    if (it == m_callFramesInfoMap.end() || it->second->isInternal)
+    {
+        // Frames without a document cannot be matched, so they are never skipped
+        return false;
+    }
+
+    ULONG docId = it->second->sourceLocation.docId;
+    auto cached = m_blackboxedDocuments.find(docId);
+    if (cached != m_blackboxedDocuments.end())
+    {
+        return cached->second;
+    }
+
+    bool isBlackboxed = false;
+    CComBSTR url;
+    if (m_spSourceController->GetDocumentUrl(docId, url) == S_OK && url.Length() > 0)
+    {
+        // The pattern comes from the front end, so a search that throws (e.g. error_complexity) just means the frame is not blackboxed,
+        // rather than an exception escaping the break handler on the PDM thread
+        try
+        {
+            isBlackboxed = std::regex_search(url.m_str, url.m_str + url.Length(), m_blackboxPattern);
+        }
+        catch (const std::regex_error&)
+        {
+            isBlackboxed = false;
+        }
+    }
+
+    m_blackboxedDocuments[docId] = isBlackboxed;
+
+    return isBlackboxed;
+}
+
+HRESULT ThreadController::RunDebugExpression(_In_ IDebugExpression* pDebugExpression, _Out_ CComPtr<IDebugProperty>& spDebugProperty)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+    ATLENSURE_RETURN_HR(pDebugExpression != nullptr, E_INVALIDARG);
+
+    HRESULT hr = S_OK;
+    CComPtr<IDebugExpression> spDebugExpression(pDebugExpression);
+
+    // Local scope for COM objects.
+    {
+        // Keep our reference alive until all evals have finished (or been aborted)
+        CComObjPtr<ThreadController> spKeepAlive(this);
+
+        // Create expression callback
+        CComObject<EvalCallback>* pDebugCallback;
+        CComObject<EvalCallback>::CreateInstance(&pDebugCallback);
+        ATLENSURE_RETURN_HR(pDebugCallback != nullptr, E_NOINTERFACE);
+            
+        CComObjPtr<EvalCallback> spDebugCallback(pDebugCallback);
+        hr = spDebugCallback->Initialize();
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        // Add this to our list so we can abandon it if we resume or close before it completes
+        m_evalCallbacks.push_back(::make_pair(spDebugExpression, spDebugCallback));
+
+        // Evaluate the expression
+        hr = spDebugExpression->Start(spDebugCallback);
+        if (hr != S_OK)
+        {
+            m_evalCallbacks.pop_back();
+        }
+        BPT_FAIL_IF_NOT_S_OK(hr);
+
+        hr = spDebugCallback->WaitForCompletion();
+
+        // Remove from our list
+        ATLENSURE_RETURN_HR(m_evalCallbacks.back().first == spDebugExpression, E_UNEXPECTED);
+        m_evalCallbacks.pop_back();
+
+        // Check if we were closed down before this evaluation completed, if so just return abort failure
+        if (hr == E_ABORT)
+        {
+            return hr;
+        }
+    }
+
+    HRESULT returnResult;
+
+    // Determine if the expression evaluation was successful
+    hr = spDebugExpression->GetResultAsDebugProperty(&returnResult, &spDebugProperty);
+    BPT_FAIL_IF_NOT_S_OK(hr);
+
+    // The get result function should always succeed, but the actual result from the eval could fail if
+    // chakra was unable to process the request. If that is the case we should return the failure out
+    // to the caller, which will result in sending null to the JavaScript which is handled correctly.
+    if (returnResult != S_OK)
+    {
+        spDebugProperty.Release();
+        return returnResult;
+    }
+
+    return S_OK;
+}
+
+HRESULT ThreadController::EvaluateBreakpointExpression(_In_ ULONG frameId, _In_ const BreakpointInfo& breakpoint, _Out_ CComBSTR& value)
+{
+    ATLENSURE_RETURN_HR(ThreadHelpers::IsOnDispatchThread(m_dispatchThreadId), E_UNEXPECTED);
+
+    value.Empty();
+
+    // Lock the callframe access
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csCallFramesLock);
+
+    if (!this->IsConnected() || !this->IsAtBreak())
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    auto it = m_debugFrameMap.find(frameId);
+    if (it == m_debugFrameMap.end())
+    {
+        return E_NOT_FOUND;
+    }
+
+    CComQIPtr<IDebugExpressionContext> spEvalContext(it->second);
+    ATLENSURE_RETURN_HR(spEvalContext.p != nullptr, E_NOINTERFACE);
+
+    // The expression text is only prepared again when the breakpoint's condition or kind changes
+    ConditionCacheEntry& entry = m_conditionCache[breakpoint.id];
+    if (entry.condition != breakpoint.condition || entry.isTracepoint != breakpoint.isTracepoint)
+    {
+        entry.condition = breakpoint.condition;
+        entry.isTracepoint = breakpoint.isTracepoint;
+        entry.expressionText.Format(ThreadController::s_f12EvalIdentifier, 0);
+        if (breakpoint.isTracepoint)
+        {
+            ThreadController::BuildTracepointExpression(breakpoint.condition, entry.expressionText);
+        }
+        else
+        {
+            entry.expressionText.AppendFormat(L"!!(%s)", static_cast<LPCWSTR>(breakpoint.condition));
+        }
+    }
+
+    CComPtr<IDebugExpression> spDebugExpression;
+    HRESULT hr = spEvalContext->ParseLanguageText(entry.expressionText, /*radix=*/ 10, L"" /* not actually used, but required */, DEBUG_TEXT_RETURNVALUE | DEBUG_TEXT_ISEXPRESSION, &spDebugExpression);
+    BPT_FAIL_IF_NOT_S_OK(hr);
+
+    // Free the lock while the expression runs so the PDM thread can still use the callstack
+    lock.Unlock();
+
+    CComPtr<IDebugProperty> spDebugProperty;
+    hr = this->RunDebugExpression(spDebugExpression, spDebugProperty);
+    BPT_FAIL_IF_NOT_S_OK(hr);
+
+    DebugPropertyInfo propInfo;
+    hr = spDebugProperty->GetPropertyInfo(PROP_INFO_VALUE, /*radix=*/ 10, &propInfo);
+    BPT_FAIL_IF_NOT_S_OK(hr);
+
+    value.Attach(((propInfo.m_dwValidFields & DBGPROP_INFO_VALUE) == DBGPROP_INFO_VALUE) ? propInfo.m_bstrValue : nullptr);
+
+    return S_OK;
+}
+
+HRESULT ThreadController::EvaluateConditionalBreakpoint(_In_ ULONG frameId, _In_ const BreakpointInfo& breakpoint, _Out_ bool& result)
+{
+    result = true;
+
+    CComBSTR value;
+    HRESULT hr = this->EvaluateBreakpointExpression(frameId, breakpoint, value);
+    BPT_FAIL_IF_NOT_S_OK(hr);
+
+    // The condition was wrapped with !! so the result is always a boolean
+    result = (value.Length() > 0 && wcscmp(value, L"true") == 0);
+
+    return S_OK;
+}
+
+HRESULT ThreadController::EvaluateTracepoint(_In_ ULONG frameId, _In_ const BreakpointInfo& breakpoint, _Out_ TracepointMessage& message)
+{
+    message.breakpointId = breakpoint.id;
+    message.url = breakpoint.url;
+    if (breakpoint.spSourceLocation.get() != nullptr)
+    {
+        message.docId = breakpoint.spSourceLocation->docId;
+
+        // Use the same line index that breakpoints are resolved against, so the logged location matches the one the front end set
+        HRESULT hr = m_spSourceController->GetLineColumnFromOffset(message.docId, breakpoint.spSourceLocation->charPosition, message.lineNumber, message.columnNumber);
+        ATLASSERT(hr == S_OK); // In retail bits the message is still logged, at the start of the document
+
+        // A url regex breakpoint reports the document it is bound in rather than the regex
+        if (breakpoint.isUrlRegex)
+        {
+            m_spSourceController->GetDocumentUrl(message.docId, message.url);
+        }
+    }
+
+    // Stamp the message with the time of the hit rather than the time it gets flushed to the front end
+    FILETIME fileTime;
+    ::GetSystemTimeAsFileTime(&fileTime);
+    ULARGE_INTEGER time;
+    time.LowPart = fileTime.dwLowDateTime;
+    time.HighPart = fileTime.dwHighDateTime;
+    message.timestamp = static_cast<double>(time.QuadPart - 116444736000000000ULL) / 10000000.0; // 100ns intervals since 1601 to seconds since 1970
+
+    CComBSTR value;
+    HRESULT hr = this->EvaluateBreakpointExpression(frameId, breakpoint, value);
+    if (hr != S_OK)
+    {
+        // Log the template itself so the user can see which tracepoint failed
+        message.text = breakpoint.condition;
+        message.isError = true;
+        return hr;
+    }
+
+    // The expression always produces a string, which the PDM returns wrapped in quotes
+    UINT length = value.Length();
+    if (length >= 2 && value[0] == L'\"' && value[length - 1] == L'\"')
+    {
+        message.text.Attach(::SysAllocStringLen(value.m_str + 1, length - 2));
+    }
+    else
+    {
+        message.text.Attach(value.Detach());
+    }
+
+    return S_OK;
+}
+
+void ThreadController::BuildTracepointExpression(_In_ const CComBSTR& messageTemplate, _Inout_ CString& expressionText)
+{
+    // The message is literal text with expressions to evaluate in braces, for example "x is {x}",
+    // which becomes the single expression ""+"x is "+(x) so each hit only needs one eval.
+    CString message(messageTemplate);
+    expressionText.Append(L"\"\"");
+
+    int position = 0;
+    while (position < message.GetLength())
+    {
+        int open = message.Find(L'{', position);
+        int close = (open < 0 ? -1 : message.Find(L'}', open + 1));
+        if (close < 0)
+        {
+            // No more complete expressions, so the rest is literal text
+            break;
+        }
+
+        if (open > position)
+        {
+            expressionText.AppendChar(L'+');
+            ScriptHelpers::AppendJSONString(expressionText, CComBSTR(message.Mid(position, open - position)));
+        }
+
+        CString expression(message.Mid(open + 1, close - open - 1));
+        expression.Trim();
+        if (!expression.IsEmpty())
+        {
+            expressionText.AppendFormat(L"+(%s)", static_cast<LPCWSTR>(expression));
+        }
+
+        position = close + 1;
+    }
+
+    if (position < message.GetLength())
+    {
+        expressionText.AppendChar(L'+');
+        ScriptHelpers::AppendJSONString(expressionText, CComBSTR(message.Mid(position)));
+    }
+}
+
 HRESULT ThreadController::ClearBreakInfo()
 {
     // Lock the callstack, so that we are thread safe
@@ -1121,14 +2233,39 @@ HRESULT ThreadController::ClearBreakInfo()
         itPair.second->Abort();
     }
 
+    // Batches that are still running are cancelled, and handed back to the dispatch with everything that has not completed yet
+    for (auto& batchPair : m_evalBatches)
+    {
+        for (auto& eval : batchPair.second.evals)
+        {
+            if (eval.spCallback.p != nullptr)
+            {
+                eval.spDebugExpression->Abort();
+            }
+
+            batchPair.second.spBatch->results[eval.index].status = EvalStatus::Cancelled;
+        }
+
+        m_finishedEvalBatches.push_back(batchPair.second.spBatch);
+    }
+
+    if (!m_evalBatches.empty())
+    {
+        m_evalBatches.clear();
+        m_spMessageQueue->Push(PDMEventType::EvalCompleted);
+    }
+
     // Since we just resumed from the breakpoint, clear out all the information that was stored about the previous break,
     // Also ensure to release the IRemoteDebugApplicationThread so that the PDM can dispose of it.
+    m_spStackFrameEnum.Release();
+    m_isCallStackComplete = true;
     m_callFrames.clear();
     m_callFramesInfoMap.clear();
     m_callFrameMap.clear();
     m_localsMap.clear();
+    m_scopeChainMap.clear();
     m_debugFrameMap.clear();
-    m_propertyMap.clear();
+    m_propertyHandles.Clear();
 
     m_spCurrentBrokenThread.Release();
     
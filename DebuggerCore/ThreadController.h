@@ -10,6 +10,8 @@
 #include "SourceController.h"
 #include "ThreadEventListener.h"
 #include "CallFrame.h"
+#include "PropertyHandleTable.h"
+#include "ExceptionFilter.h"
 
 using namespace ATL;
 using namespace std;
@@ -43,26 +45,42 @@ public:
     HRESULT Disconnect();
     HRESULT Pause();
     HRESULT Resume(_In_ BREAKRESUMEACTION breakResumeAction, _In_ ERRORRESUMEACTION errorResumeAction = ERRORRESUMEACTION_AbortCallAndReturnErrorToCaller);
+    HRESULT ResumeInternalBreak();
     HRESULT GetThreadDescriptions(_Inout_ vector<CComBSTR>& spThreadDescriptions);
     HRESULT SetBreakOnFirstChanceExceptions(_In_ bool breakOnFirstChance);
+    HRESULT SetExceptionFilter(_In_ const vector<CString>& ignoredUrlPatterns, _In_ ULONG sampleRate, _In_ ULONG maxBreaksPerSite, _In_ ULONG rateLimitInterval);
+    HRESULT GetExceptionFilterInfo(_Out_ ExceptionFilterInfo& info);
+    HRESULT SetBlackboxPattern(_In_ const CString& pattern);
+    HRESULT ContinueBlackboxedStep();
     HRESULT SetBreakOnNewWorker(_In_ bool enable);
     HRESULT SetNextEvent(_In_ const CString& eventBreakpointType);
 
     // Break Mode Actions
     HRESULT GetCurrentThreadDescription(_Out_ CComBSTR& threadDescription);
     HRESULT GetBreakEventInfo(_Out_ shared_ptr<BreakEventInfo>& spBreakInfo);
-    HRESULT GetCallFrames(_Inout_ vector<shared_ptr<CallFrameInfo>>& spFrames);
-    HRESULT GetLocals(_In_ ULONG frameId, _Out_ ULONG& propertyId);
-    HRESULT EnumeratePropertyMembers(_In_ ULONG propertyId, _In_ UINT radix, _Inout_ vector<shared_ptr<PropertyInfo>>& spPropertyInfos);
-    HRESULT SetPropertyValueAsString(_In_ ULONG propertyId, _In_ BSTR* pValue, _In_ UINT radix);
-    HRESULT Eval(_In_ ULONG frameId, _In_ const CComBSTR& evalString, _In_ ULONG radix, _Out_ shared_ptr<PropertyInfo>& spPropertyInfo);
+    HRESULT GetCallFrames(_In_ ULONG framesNeeded, _Inout_ vector<shared_ptr<CallFrameInfo>>& spFrames);
+    HRESULT GetLocals(_In_ ULONG frameId, _Out_ PropertyHandle& propertyId);
+    HRESULT GetScopeChain(_In_ ULONG frameId, _Out_ ScopeChainInfo& scopeChain);
+    HRESULT EnumeratePropertyMembers(_In_ PropertyHandle propertyId, _In_ UINT radix, _In_ ULONG start, _In_ ULONG length, _Inout_ vector<shared_ptr<PropertyInfo>>& spPropertyInfos, _Out_ ULONG& totalCount);
+    HRESULT SetPropertyValueAsString(_In_ PropertyHandle propertyId, _In_ BSTR* pValue, _In_ UINT radix);
+    HRESULT ReleaseObjectGroup(_In_ const CString& objectGroup);
+    HRESULT GetPropertyHandleInfo(_Out_ PropertyHandleTableInfo& info);
+    HRESULT Eval(_In_ ULONG frameId, _In_ const CComBSTR& evalString, _In_ ULONG radix, _In_ const CString& objectGroup, _Out_ shared_ptr<PropertyInfo>& spPropertyInfo);
+    HRESULT BeginEvalBatch(_In_ ULONG frameId, _In_ const vector<CComBSTR>& expressions, _In_ ULONG radix, _In_ const CString& objectGroup, _In_ ULONG timeout, _Out_ ULONG& batchId);
+    HRESULT CancelEvalBatch(_In_ ULONG batchId);
+    HRESULT GetFinishedEvalBatches(_Inout_ vector<shared_ptr<EvalBatchInfo>>& batches, _Out_ bool& hasPendingBatches);
+    HRESULT EvaluateBreakConditions(_In_ const shared_ptr<BreakEventInfo>& spBreakInfo, _Out_ bool& shouldBreak, _Inout_ vector<TracepointMessage>& tracepointMessages);
+    void RemoveBreakpointCondition(_In_ ULONG breakpointId);
+    void ClearBreakpointConditions();
+    static void BuildTracepointExpression(_In_ const CComBSTR& messageTemplate, _Inout_ CString& expressionText);
     HRESULT CanSetNextStatement(_In_ ULONG docId, _In_ ULONG start);
     HRESULT SetNextStatement(_In_ ULONG docId, _In_ ULONG start);
 
     // PDM Event Notifications
-    HRESULT OnPDMBreak(_In_ IRemoteDebugApplicationThread* pRDAThread, _In_ BREAKREASON br, _In_ const CComBSTR& description, _In_ WORD errorId, _In_ bool isFirstChance, _In_ bool isUserUnhandled);
+    HRESULT OnPDMBreak(_In_ IRemoteDebugApplicationThread* pRDAThread, _In_ BREAKREASON br, _In_opt_ IActiveScriptErrorDebug* pError, _In_ const CComBSTR& description, _In_ WORD errorId, _In_ bool isFirstChance, _In_ bool isUserUnhandled);
     HRESULT OnPDMClose();
     HRESULT OnWaitCallback();
+    HRESULT OnPopulateCallStackCallback(_In_ ULONG framesNeeded);
 
     // IE Break Notification
     HRESULT BeginBreakNotification();
@@ -70,20 +88,30 @@ public:
 private:
     HRESULT GetRemoteDebugApplication(_Out_ CComPtr<IRemoteDebugApplication>& spRemoteDebugApplication);
     HRESULT CallDebuggerThread(_In_ PDMThreadCallbackMethod method, _In_opt_ DWORD_PTR pController, _In_opt_ DWORD_PTR pArgs);
-    HRESULT PopulateCallStack();
-    HRESULT EvaluateConditionalBreakpoint(_In_ ULONG frameId, _In_ CComBSTR& condition, _In_ bool isTracepoint, _Out_ bool& result);
-    HRESULT PopulatePropertyInfo(_Inout_ DebugPropertyInfo& propInfo, _Out_ shared_ptr<PropertyInfo>& spPropertyInfo);
+    HRESULT PopulateCallStack(_In_ ULONG framesNeeded);
+    bool IsFilteredException(_In_ IActiveScriptErrorDebug* pError);
+    bool IsBlackboxedFrame(_In_ ULONG frameId);
+    HRESULT RunDebugExpression(_In_ IDebugExpression* pDebugExpression, _Out_ CComPtr<IDebugProperty>& spDebugProperty);
+    HRESULT EvaluateBreakpointExpression(_In_ ULONG frameId, _In_ const BreakpointInfo& breakpoint, _Out_ CComBSTR& value);
+    HRESULT EvaluateConditionalBreakpoint(_In_ ULONG frameId, _In_ const BreakpointInfo& breakpoint, _Out_ bool& result);
+    HRESULT EvaluateTracepoint(_In_ ULONG frameId, _In_ const BreakpointInfo& breakpoint, _Out_ TracepointMessage& message);
+    HRESULT PopulatePropertyInfo(_Inout_ DebugPropertyInfo& propInfo, _In_ ULONG groupId, _Out_ shared_ptr<PropertyInfo>& spPropertyInfo);
     HRESULT WaitForBreakNotification();
+    HRESULT StartQueuedEvals(_Inout_ CComCritSecLock<CComAutoCriticalSection>& lock);
+    HRESULT ResumeFromBreak(_In_ BREAKRESUMEACTION breakResumeAction, _In_ ERRORRESUMEACTION errorResumeAction, _In_ bool shouldNotifyBreakModeChanged);
     HRESULT ClearBreakInfo();
 
     // This must be static to ensure unique call frame id's across debugging sessions.
     static ULONG s_nextFrameId;
     static ULONG CreateUniqueFrameId() { return ThreadController::s_nextFrameId++; }
-
-    static ULONG s_nextPropertyId;
-    static ULONG CreateUniquePropertyId() { return ThreadController::s_nextPropertyId++; }
+    static ULONG s_nextEvalBatchId;
+    static ULONG CreateUniqueEvalBatchId() { return ThreadController::s_nextEvalBatchId++; }
 
     static const int s_maxConcurrentEvalCount;
+    static const ULONG s_defaultEvalTimeout;
+    static const ULONG s_maxBlackboxedSteps;
+    static const ULONG s_propertyEnumBatchSize;
+    static const CString s_backtraceObjectGroup;
     static const CString s_f12EvalIdentifierPrefix;
     static const CString s_f12EvalIdentifierPrefixEnd;
     static const CString s_f12EvalIdentifier;
@@ -106,17 +134,62 @@ private:
     CComAutoCriticalSection m_csThreadControllerLock;
     CComAutoCriticalSection m_csCallFramesLock;
 
-    // Call frames
+    // Call frames, these are only materialized from the stack frame enumerator as they are asked for
+    CComPtr<IEnumDebugStackFrames> m_spStackFrameEnum;
+    bool m_isCallStackComplete;
     vector<ULONG> m_callFrames;
     map<ULONG, shared_ptr<CallFrameInfo>> m_callFramesInfoMap;
     map<ULONG, CComObjPtr<CallFrame>> m_callFrameMap;
 
     // Locals, evals, and watches
-    map<ULONG, ULONG> m_localsMap;
+    map<ULONG, PropertyHandle> m_localsMap;
+    map<ULONG, ScopeChainInfo> m_scopeChainMap; // Keyed by frame id, for the duration of the break
     map<ULONG, CComPtr<IDebugStackFrame>> m_debugFrameMap;
-    map<ULONG, CComPtr<IDebugProperty>> m_propertyMap;
+    PropertyHandleTable m_propertyHandles;
     vector<pair<CComPtr<IDebugExpression>, CComObjPtr<EvalCallback>>> m_evalCallbacks;
 
+    // Eval batches that still have expressions running or waiting to start, keyed by batch id
+    struct PendingEval
+    {
+        size_t index;
+        CComPtr<IDebugExpression> spDebugExpression;
+        CComObjPtr<AsyncEvalCallback> spCallback; // Null until the expression is started
+    };
+    struct PendingEvalBatch
+    {
+        shared_ptr<EvalBatchInfo> spBatch;
+        vector<PendingEval> evals;
+        ULONG radix;
+        ULONG groupId;
+        ULONGLONG deadline;
+    };
+    map<ULONG, PendingEvalBatch> m_evalBatches;
+    vector<shared_ptr<EvalBatchInfo>> m_finishedEvalBatches;
+
+    // The prepared expression text of conditional breakpoints and tracepoints, keyed by breakpoint id, it is parsed in the frame of each hit
+    struct ConditionCacheEntry
+    {
+        CComBSTR condition;
+        bool isTracepoint;
+        CString expressionText;
+
+        ConditionCacheEntry() :
+            isTracepoint(false)
+        {
+        }
+    };
+    map<ULONG, ConditionCacheEntry> m_conditionCache;
+
+    // First chance exceptions that should be resumed without stopping, this is used on the PDM thread so it is also under the callframes lock
+    ExceptionFilter m_exceptionFilter;
+
+    // Scripts that stepping should pass straight through, matched against the document url.
+    // The result for each document is cached since the pattern only changes when the front end sets a new one.
+    bool m_hasBlackboxPattern;
+    std::wregex m_blackboxPattern;
+    unordered_map<ULONG, bool> m_blackboxedDocuments;
+    ULONG m_blackboxedStepCount;
+
     // Debugging
     shared_ptr<BreakEventInfo> m_spCurrentBreakInfo;
     CComPtr<IRemoteDebugApplicationThread> m_spCurrentBrokenThread;
@@ -107,7 +107,7 @@ STDMETHODIMP ThreadEventListener::onHandleBreakPoint(
     // Notify the controller
     if (m_spThreadController.p != nullptr)
     {
-        m_spThreadController->OnPDMBreak(prpt, br, bstrErrorDescription, errorId, !!fIsFirstChance, !!fIsUserUnhandled);
+        m_spThreadController->OnPDMBreak(prpt, br, pError, bstrErrorDescription, errorId, !!fIsFirstChance, !!fIsUserUnhandled);
     }
 
     return hr;
@@ -24,6 +24,8 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <regex>
+#include <unordered_map>
 #include <vector>
 #include <jsrt.h>
 
@@ -59,41 +59,31 @@ LRESULT IEDiagnosticsAdapter::OnCopyData(UINT nMsg, WPARAM wParam, LPARAM lParam
 
 LRESULT IEDiagnosticsAdapter::OnMessageFromIE(UINT nMsg, WPARAM wParam, LPARAM lParam, _Inout_ BOOL& /*bHandled*/)
 {
-    CString message;
-    // Scope for the copied data
-    {
-        // Take ownership of the copydata struct memory
-        unique_ptr<COPYDATASTRUCT, void(*)(COPYDATASTRUCT*)> spParams(reinterpret_cast<PCOPYDATASTRUCT>(lParam), ::FreeCopyDataStructCopy);
-
-        // Get the string message from the structure
-        CopyDataPayload_StringMessage_Data* pMessage = reinterpret_cast<CopyDataPayload_StringMessage_Data*>(spParams->lpData);
-        LPCWSTR lpString = reinterpret_cast<LPCWSTR>(reinterpret_cast<BYTE*>(pMessage)+pMessage->uMessageOffset);
-        message = lpString;
-    }
+    // Take ownership of the copydata struct memory
+    unique_ptr<COPYDATASTRUCT, void(*)(COPYDATASTRUCT*)> spParams(reinterpret_cast<PCOPYDATASTRUCT>(lParam), ::FreeCopyDataStructCopy);
 
     HWND proxyHwnd = reinterpret_cast<HWND>(wParam);
 
-    string utf8;
-    int length = message.GetLength();
-    LPWSTR buffer = message.GetBuffer();
-
-    // Convert the message into valid UTF-8 text
-    int utf8Length = ::WideCharToMultiByte(CP_UTF8, 0, buffer, length, nullptr, 0, nullptr, nullptr);
-    if (utf8Length == 0)
-    {
-        message.ReleaseBuffer();
-        ATLENSURE_RETURN_HR(false, ::GetLastError());
-    }
-
-    utf8.resize(utf8Length);
-    utf8Length = ::WideCharToMultiByte(CP_UTF8, 0, buffer, length, &utf8[0], static_cast<int>(utf8.length()), nullptr, nullptr);
-    message.ReleaseBuffer();
-    ATLENSURE_RETURN_HR(utf8Length > 0, ::GetLastError());
-
-
+    // The proxy may have packed several messages into this transfer, so handle each one in order
+    HRESULT hr = ::ForEachCopyDataMessage(spParams.get(), [this, proxyHwnd](LPCWSTR lpString, size_t length) -> HRESULT {
+        string utf8;
+        if (length > 0)
+        {
+            // Convert the message into valid UTF-8 text
+            int utf8Length = ::WideCharToMultiByte(CP_UTF8, 0, lpString, static_cast<int>(length), nullptr, 0, nullptr, nullptr);
+            ATLENSURE_RETURN_HR(utf8Length > 0, ::AtlHresultFromLastError());
+
+            utf8.resize(utf8Length);
+            utf8Length = ::WideCharToMultiByte(CP_UTF8, 0, lpString, static_cast<int>(length), &utf8[0], static_cast<int>(utf8.length()), nullptr, nullptr);
+            ATLENSURE_RETURN_HR(utf8Length > 0, ::AtlHresultFromLastError());
+        }
+
+        // Now that we have parsed out the arguments, let the websocketHandler handle it
+        m_webSocketHander->OnMessageFromIE(utf8, proxyHwnd);
+        return S_OK;
+    });
+    FAIL_IF_NOT_S_OK(hr);
 
-    // Now that we have parsed out the arguments, let the websocketHandler handle it
-    m_webSocketHander->OnMessageFromIE(utf8, proxyHwnd);
     return 0;
 }
 
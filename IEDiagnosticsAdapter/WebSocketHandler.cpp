@@ -239,7 +239,7 @@ void WebSocketHandler::OnMessage(websocketpp::connection_hdl hdl, server::messag
 
         // Message from WebKit client to IE
         CString message(msg->get_payload().c_str());
-        this->SendMessageToInstance(m_clientConnections[hdl], message);
+        this->QueueMessageToInstance(m_clientConnections[hdl], message);
     }
 }
 
@@ -507,28 +507,54 @@ HRESULT WebSocketHandler::ConnectToInstance(_In_ IEInstance& instance)
 
 HRESULT WebSocketHandler::SendMessageToInstance(_In_ HWND& instanceHwnd, _In_ CString& message)
 {
-    const size_t ucbParamsSize = sizeof(CopyDataPayload_StringMessage_Data);
-    const size_t ucbStringSize = sizeof(WCHAR) * (::wcslen(message) + 1);
-    const size_t ucbBufferSize = ucbParamsSize + ucbStringSize;
-    std::unique_ptr<BYTE> pBuffer;
-    try
+    // Send anything still waiting to be flushed first, so that the proxy sees the messages in order
+    vector<CString> messages;
+    auto it = m_pendingInstanceMessages.find(instanceHwnd);
+    if (it != m_pendingInstanceMessages.end())
     {
-        pBuffer.reset(new BYTE[ucbBufferSize]);
+        messages.swap(it->second);
+        m_pendingInstanceMessages.erase(it);
     }
-    catch (std::bad_alloc&)
+
+    messages.push_back(message);
+
+    return this->SendMessagesToInstance(instanceHwnd, messages);
+}
+
+void WebSocketHandler::QueueMessageToInstance(_In_ HWND instanceHwnd, _In_ CString& message)
+{
+    vector<CString>& pending = m_pendingInstanceMessages[instanceHwnd];
+    pending.push_back(message);
+
+    if (pending.size() == 1)
     {
-        return E_OUTOFMEMORY;
+        // Flush after the server has dispatched the rest of the messages it has already read,
+        // so that a burst from the client goes across to the proxy in a single transfer
+        m_server.get_io_service().post(boost::bind(&WebSocketHandler::FlushMessagesToInstance, this, instanceHwnd));
     }
+}
 
-    COPYDATASTRUCT copyData;
-    copyData.dwData = CopyDataPayload_ProcSignature::StringMessage_Signature;
-    copyData.cbData = static_cast<DWORD>(ucbBufferSize);
-    copyData.lpData = pBuffer.get();
+void WebSocketHandler::FlushMessagesToInstance(_In_ HWND instanceHwnd)
+{
+    auto it = m_pendingInstanceMessages.find(instanceHwnd);
+    if (it == m_pendingInstanceMessages.end())
+    {
+        // Already sent
+        return;
+    }
 
-    CopyDataPayload_StringMessage_Data* pData = reinterpret_cast<CopyDataPayload_StringMessage_Data*>(pBuffer.get());
-    pData->uMessageOffset = static_cast<UINT>(ucbParamsSize);
+    vector<CString> messages;
+    messages.swap(it->second);
+    m_pendingInstanceMessages.erase(it);
 
-    HRESULT hr = ::StringCbCopyEx(reinterpret_cast<LPWSTR>(pBuffer.get() + pData->uMessageOffset), ucbStringSize, message, NULL, NULL, STRSAFE_IGNORE_NULLS);
+    this->SendMessagesToInstance(instanceHwnd, messages);
+}
+
+HRESULT WebSocketHandler::SendMessagesToInstance(_In_ HWND instanceHwnd, _In_ const vector<CString>& messages)
+{
+    vector<BYTE> buffer;
+    COPYDATASTRUCT copyData;
+    HRESULT hr = ::MakeCopyDataPayload(messages, buffer, copyData);
     FAIL_IF_NOT_S_OK(hr);
 
     ::SendMessage(instanceHwnd, WM_COPYDATA, reinterpret_cast<WPARAM>(m_AdapterhWnd), reinterpret_cast<LPARAM>(&copyData));
@@ -66,6 +66,9 @@ private:
     // Helper functions
     HRESULT ConnectToInstance(_In_ IEInstance& instance);
     HRESULT InjectScript(_In_ const LPCWSTR id, _In_ const LPCWSTR scriptName, _In_ const DWORD resourceId, _In_ HWND hwnd);
+    void QueueMessageToInstance(_In_ HWND instanceHwnd, _In_ CString& message);
+    void FlushMessagesToInstance(_In_ HWND instanceHwnd);
+    HRESULT SendMessagesToInstance(_In_ HWND instanceHwnd, _In_ const vector<CString>& messages);
 
     // window message handlers
 	void OnMessageFromIEHandler(string message, HWND proxyHwnd);
@@ -85,6 +88,7 @@ private:
     map<HWND, IEInstance> m_instances;
     map<websocketpp::connection_hdl, HWND, owner_less<websocketpp::connection_hdl>> m_clientConnections;
     map<HWND, websocketpp::connection_hdl> m_proxyConnections;
+    map<HWND, vector<CString>> m_pendingInstanceMessages;
 	string m_AdaptorLogging_EnvironmentVariable;
 	AdapterTest m_adapterTest;
 };
\ No newline at end of file
@@ -50,6 +50,14 @@ module IEDiagnosticsAdapter {
         UnsetBreakOnAnyNewWorkerStarting = 3
     }
 
+    enum EvalStatus {
+        Pending = 0,
+        Completed = 1,
+        Failed = 2,
+        TimedOut = 3,
+        Cancelled = 4
+    }
+
     interface ISourceLocation {
         docId: number;
         start: number;
@@ -115,6 +123,41 @@ module IEDiagnosticsAdapter {
         longDocumentId: number;
     }
 
+    interface ITracepointMessage {
+        breakpointId: number;
+        docId: number;
+        lineNumber: number;
+        columnNumber: number;
+        timestamp: number;
+        isError: boolean;
+        url: string;
+        text: string;
+    }
+
+    interface IDocumentsSuppressedInfo {
+        count: number;
+        totalSuppressed: number;
+        maxDynamicDocuments: number;
+    }
+
+    interface IEvalResult {
+        status: EvalStatus;
+        propertyInfo: IPropertyInfo;
+    }
+
+    interface IEvalBatchResult {
+        batchId: number;
+        results: IEvalResult[];
+    }
+
+    interface IExceptionFilterInfo {
+        exceptionsSeen: number;
+        filteredByUrl: number;
+        filteredBySampling: number;
+        filteredByRateLimit: number;
+        throwSites: number;
+    }
+
     interface IPropertyInfo {
         propertyId: string;
         name: string;
@@ -128,6 +171,40 @@ module IEDiagnosticsAdapter {
         returnValue: boolean;
     }
 
+    interface ILineColumn {
+        lineNumber: number;
+        columnNumber: number;
+    }
+
+    interface ISearchMatch {
+        lineNumber: number;
+        lineContent: string;
+    }
+
+    interface IPropertyHandleInfo {
+        liveHandles: number;
+        slotCapacity: number;
+        freeSlots: number;
+        objectGroups: number;
+        bytesReserved: number;
+    }
+
+    interface IDynamicDocumentInfo {
+        dynamicDocuments: number;
+        cachedDocuments: number;
+        sharedDocuments: number;
+        evictedDocuments: number;
+        cachedBytes: number;
+        sharedBytes: number;
+        budgetBytes: number;
+    }
+
+    interface IPauseSnapshot {
+        callFrames: any[];
+        reason: string;
+        data: any;
+    }
+
     interface IPropertyInfoContainer {
         propInfos: IPropertyInfo[];
         hasAdditionalChildren: boolean;
@@ -146,12 +223,18 @@ module IEDiagnosticsAdapter {
         addEventListener(type: "onUpdateDocuments", listener: (documents: IDocument[]) => void): void;
         addEventListener(type: "onResolveBreakpoints", listener: (breakpoints: IResolvedBreakpointInfo[]) => void): void;
         addEventListener(type: "onBreak", listener: (breakEventInfo: IBreakEventInfo) => void): void;
+        addEventListener(type: "onTracepointMessages", listener: (messages: ITracepointMessage[]) => void): void;
+        addEventListener(type: "onEvalBatchComplete", listener: (batch: IEvalBatchResult) => void): void;
+        addEventListener(type: "onDocumentsSuppressed", listener: (info: IDocumentsSuppressedInfo) => void): void;
         removeEventListener(type: string, listener: Function): void;
         removeEventListener(type: "onAddDocuments", listener: (documents: IDocument[]) => void): void;
         removeEventListener(type: "onRemoveDocuments", listener: (docIds: number[]) => void): void;
         removeEventListener(type: "onUpdateDocuments", listener: (documents: IDocument[]) => void): void;
         removeEventListener(type: "onResolveBreakpoints", listener: (breakpoints: IResolvedBreakpointInfo[]) => void): void;
         removeEventListener(type: "onBreak", listener: (breakEventInfo: IBreakEventInfo) => void): void;
+        removeEventListener(type: "onTracepointMessages", listener: (messages: ITracepointMessage[]) => void): void;
+        removeEventListener(type: "onEvalBatchComplete", listener: (batch: IEvalBatchResult) => void): void;
+        removeEventListener(type: "onDocumentsSuppressed", listener: (info: IDocumentsSuppressedInfo) => void): void;
         enable(): boolean;
         disable(): boolean;
         isEnabled(): boolean;
@@ -176,7 +259,7 @@ module IEDiagnosticsAdapter {
         getFrames(framesNeeded: number): IStackFrame[];
         getSourceText(docId: number): IGetSourceTextResult;
         getLocals(frameId: number): number; /* propertyNum */
-        eval(frameId: number, evalString: string): IPropertyInfo;
+        eval(frameId: number, evalString: string, objectGroup: string): IPropertyInfo;
         getChildProperties(propertyId: number, start: number, length: number): IPropertyInfoContainer;
         setPropertyValueAsString(propertyId: number, value: string): boolean;
 
@@ -184,6 +267,27 @@ module IEDiagnosticsAdapter {
         setNextStatement(docId: number, position: number): boolean;
         setBreakOnFirstChanceExceptions(value: boolean): boolean;
 
+        getLineColumnFromOffset(docId: number, offset: number): ILineColumn;
+        getOffsetFromLineColumn(docId: number, lineNumber: number, columnNumber: number): number;
+        searchInContent(docId: number, query: string, caseSensitive: boolean, isRegex: boolean): ISearchMatch[];
+
+        releaseObjectGroup(objectGroup: string): boolean;
+        getPropertyHandleInfo(): IPropertyHandleInfo;
+
+        getPauseSnapshot(maxFrames: number): IPauseSnapshot;
+
+        evalBatch(frameId: number, expressions: string[], objectGroup: string, timeout: number): number; /* batchId */
+        cancelEvalBatch(batchId: number): boolean;
+
+        setExceptionFilter(ignoredUrlPatterns: string[], sampleRate: number, maxBreaksPerSite: number, rateLimitInterval: number): boolean;
+        getExceptionFilterInfo(): IExceptionFilterInfo;
+        setBlackboxPattern(pattern: string): boolean;
+        addPendingBreakpointByUrlRegex(urlRegex: string, start: number, condition: string, isEnabled: boolean, isTracepoint: boolean): number;
+        setDynamicDocumentLimit(maxDynamicDocuments: number): boolean;
+        setDynamicDocumentCacheBudget(budgetBytes: number): boolean;
+        getDynamicDocumentInfo(): IDynamicDocumentInfo;
+        runSelfTests(): string[];
+
         canSetMutationBreakpoint(propertyId: number, setOnObject: boolean, mutationType: MutationType): boolean;
         setMutationBreakpoint(propertyId: number, setOnObject: boolean, mutationType: MutationType): ISetMutationBreakpointResult;
         deleteMutationBreakpoint(breakpointId: number): boolean;
@@ -199,22 +303,25 @@ module IEDiagnosticsAdapter {
     declare var debug: IDebuggerDispatch;
 
     class DebuggerProxy {
+        // Frames built for Debugger.paused, the rest of a deeper callstack is fetched with Custom.getCallFrames
+        private static PausedFrameLimit: number = 32;
+
         private _debugger: IDebuggerDispatch;
         private _isAtBreakpoint: boolean;
         private _isAwaitingDebuggerEnableCall: boolean;
         private _isEnabled: boolean;
         private _documentMap: Map<string, number>;
-        private _lineEndingsMap: Map<number, number[]>;
         private _intellisenseExpression: string;
         private _intellisenseFrame: any;
+        private _pendingEvalRequests: Map<number, number>;
 
         constructor() {
             this._debugger = debug;
             this._isAtBreakpoint = false;
             this._documentMap = new Map<string, number>();
-            this._lineEndingsMap = new Map<number, number[]>();
             this._intellisenseFrame = null;
             this._intellisenseExpression = "";
+            this._pendingEvalRequests = new Map<number, number>();
 
             // Hook up notifications
             this._debugger.addEventListener("onAddDocuments", (documents: IDocument[]) => this.onAddDocuments(documents));
@@ -222,6 +329,9 @@ module IEDiagnosticsAdapter {
             this._debugger.addEventListener("onUpdateDocuments", (documents: IDocument[]) => this.onUpdateDocuments(documents));
             this._debugger.addEventListener("onResolveBreakpoints", (breakpoints: IResolvedBreakpointInfo[]) => this.onResolveBreakpoints(breakpoints));
             this._debugger.addEventListener("onBreak", (breakEventInfo: IBreakEventInfo) => this.onBreak(breakEventInfo));
+            this._debugger.addEventListener("onTracepointMessages", (messages: ITracepointMessage[]) => this.onTracepointMessages(messages));
+            this._debugger.addEventListener("onEvalBatchComplete", (batch: IEvalBatchResult) => this.onEvalBatchComplete(batch));
+            this._debugger.addEventListener("onDocumentsSuppressed", (info: IDocumentsSuppressedInfo) => this.onDocumentsSuppressed(info));
 
             host.addEventListener("onmessage", (data: string) => this.onMessage(data));
         }
@@ -265,41 +375,88 @@ module IEDiagnosticsAdapter {
             }
         }
 
-        private getLineEndings(docId: number, text?: string): number[] {
-            if (!this._lineEndingsMap.has(docId)) {
-                var textResult = text || this._debugger.getSourceText(docId).text;
-                if (textResult) {
-                    var total = [];
-                    var lines = textResult.split(/\r\n|\n|\r/);
-                    for (var i = 0; i < lines.length; i++) {
-                        total.push(lines[i].length + 2);
-                    }
+        private getLineColumnFromOffset(docId: number, offset: number): any {
+            var lineColumn = this._debugger.getLineColumnFromOffset(docId, offset);
+            return { lineNumber: lineColumn.lineNumber, columnNumber: lineColumn.columnNumber, scriptId: "" + docId };
+        }
 
-                    this._lineEndingsMap.set(docId, total);
-                } else {
-                    this._lineEndingsMap.set(docId, [0]);
-                }
+        private getTracepointTemplate(params: any): string {
+            // A log point is sent either as a message with {expression} placeholders, or as a condition that calls console.log.
+            // Both are turned into the message template that the native tracepoints evaluate, so the hit is logged without pausing.
+            if (typeof params.logMessage === "string") {
+                return params.logMessage;
+            }
+
+            var condition: string = params.condition || "";
+            var prefix = /^\s*(?:\/\*\*\s*DEVTOOLS_LOGPOINT\s*\*\/)?\s*console\.log\(/.exec(condition);
+            if (!prefix) {
+                return null;
+            }
+
+            // Only a single call whose argument list is the whole condition is a log point, so something like
+            // "console.log(a) || console.log(b)" stays a plain condition
+            var argsEnd = this.findClosingParenthesis(condition, prefix[0].length);
+            if (argsEnd < 0 || !/^\s*;?\s*$/.test(condition.substring(argsEnd + 1))) {
+                return null;
+            }
+
+            var args = condition.substring(prefix[0].length, argsEnd);
+            if (args.indexOf("{") < 0 && args.indexOf("}") < 0) {
+                // Placeholders cannot contain braces, so anything with them is left as a plain condition that logs through the console
+                return "{[" + args + "].join(\" \")}";
             }
 
-            return this._lineEndingsMap.get(docId);
+            return null;
         }
 
-        private getLineColumnFromOffset(docId: number, offset: number): any {
-            var lineEndings = this.getLineEndings(docId);
+        private checkTracepointTemplates(): string[] {
+            // The conditions that should and should not become log points, returns a description of each one that is handled wrongly
+            var cases = [
+                { condition: "console.log(a, b)", expected: "{[a, b].join(\" \")}" },
+                { condition: "/** DEVTOOLS_LOGPOINT */ console.log(\"x)\", f(y));", expected: "{[\"x)\", f(y)].join(\" \")}" },
+                { condition: "console.log(a) || console.log(b)", expected: null },
+                { condition: "console.log(a", expected: null },
+                { condition: "console.log({ a: 1 })", expected: null },
+                { condition: "x > 1", expected: null }
+            ];
+
+            var failures: string[] = [];
+            for (var i = 0; i < cases.length; i++) {
+                var template = this.getTracepointTemplate({ condition: cases[i].condition });
+                if (template !== cases[i].expected) {
+                    failures.push("getTracepointTemplate: " + JSON.stringify(cases[i].condition) + " gave " + JSON.stringify(template));
+                }
+            }
 
-            var columnNumber = 0;
-            var lineNumber = 0;
-            var charCount = 0;
-            for (var i = 0; i < lineEndings.length; i++) {
-                charCount += lineEndings[i];
-                if (offset < charCount) {
-                    lineNumber = i;
-                    columnNumber = charCount - offset;
-                    break;
+            return failures;
+        }
+
+        private findClosingParenthesis(text: string, start: number): number {
+            // Returns the index of the parenthesis that closes the one just before start, or -1 if it is never closed.
+            // Parentheses inside string literals are skipped.
+            var depth = 1;
+            var quote: string = null;
+            for (var i = start; i < text.length; i++) {
+                var c = text.charAt(i);
+                if (quote) {
+                    if (c === "\\") {
+                        i++;
+                    } else if (c === quote) {
+                        quote = null;
+                    }
+                } else if (c === "\"" || c === "'" || c === "`") {
+                    quote = c;
+                } else if (c === "(") {
+                    depth++;
+                } else if (c === ")") {
+                    depth--;
+                    if (depth === 0) {
+                        return i;
+                    }
                 }
             }
 
-            return { lineNumber: lineNumber, columnNumber: columnNumber, scriptId: "" + docId };
+            return -1;
         }
 
         private getRemoteObjectFromProp(prop: IPropertyInfo): IWebKitPropResult {
@@ -376,7 +533,7 @@ module IEDiagnosticsAdapter {
 
         private callFunctionOn(request: IWebKitRequest): IWebKitResult {
             if (this._intellisenseFrame && this._intellisenseExpression) {
-                var prop = this._debugger.eval(this._intellisenseFrame, this._intellisenseExpression);
+                var prop = this._debugger.eval(this._intellisenseFrame, this._intellisenseExpression, "completion");
                 this._intellisenseExpression = "";
                 this._intellisenseFrame = null;
 
@@ -421,7 +578,7 @@ module IEDiagnosticsAdapter {
                     break;
 
                 case "evaluate":
-                    var prop = debug.eval(request.params.contextId, request.params.expression);
+                    var prop = debug.eval(request.params.contextId, request.params.expression, request.params.objectGroup || "");
                     if (prop) {
                         processedResult = {
                             result: this.getRemoteObjectFromProp(prop)
@@ -430,6 +587,11 @@ module IEDiagnosticsAdapter {
 
                     break;
 
+                case "releaseObjectGroup":
+                    this._debugger.releaseObjectGroup(request.params.objectGroup);
+                    processedResult = { result: {} };
+                    break;
+
                 case "getProperties":
                     var id = parseInt(request.params.objectId);
                     var props = this._debugger.getChildProperties(id, 0, 0);
@@ -486,6 +648,71 @@ module IEDiagnosticsAdapter {
                     this.debuggerResume(BreakResumeAction.Continue);
                     return host.postMessageToEngine("browser", this._isAtBreakpoint, "{\"method\":\"Custom.testResetState\"}");
                     break;
+
+                case "setExceptionFilter":
+                    // Rules for skipping first chance exceptions natively, before the page pays for a break
+                    var success = this._debugger.setExceptionFilter(request.params.ignoredUrlPatterns || null, request.params.sampleRate || 0, request.params.maxBreaksPerSite || 0, request.params.rateLimitInterval || 0);
+                    this.postResponse(request.id, {
+                        result: {
+                            success: success,
+                            filterInfo: this._debugger.getExceptionFilterInfo()
+                        }
+                    });
+                    break;
+
+                case "setDynamicDocumentLimit":
+                    // Pages that eval thousands of scripts only get the first maxDynamicDocuments of them listed, 0 lists them all
+                    this.postResponse(request.id, {
+                        result: {
+                            success: this._debugger.setDynamicDocumentLimit(request.params.maxDynamicDocuments || 0)
+                        }
+                    });
+                    break;
+
+                case "setDynamicDocumentCacheBudget":
+                    // The bytes of eval'd script text kept cached natively, 0 keeps all of it
+                    var success = this._debugger.setDynamicDocumentCacheBudget(request.params.budgetBytes || 0);
+                    this.postResponse(request.id, {
+                        result: {
+                            success: success,
+                            documentInfo: this._debugger.getDynamicDocumentInfo()
+                        }
+                    });
+                    break;
+
+                case "getDynamicDocumentInfo":
+                    this.postResponse(request.id, {
+                        result: {
+                            documentInfo: this._debugger.getDynamicDocumentInfo()
+                        }
+                    });
+                    break;
+
+                case "getCallFrames":
+                    // The frames past the ones sent with Debugger.paused, maxFrames of 0 gets the whole callstack
+                    if (!this._isAtBreakpoint) {
+                        this.postResponse(request.id, {
+                            error: { description: "Can only get call frames when paused" }
+                        });
+                        break;
+                    }
+
+                    var snapshot = this._debugger.getPauseSnapshot(request.params.maxFrames || 0);
+                    this.postResponse(request.id, {
+                        result: {
+                            callFrames: snapshot.callFrames
+                        }
+                    });
+                    break;
+
+                case "runSelfTests":
+                    // Checks of the pure logic that need no page or break, the replay tests expect no failures
+                    this.postResponse(request.id, {
+                        result: {
+                            failures: this._debugger.runSelfTests().concat(this.checkTracepointTemplates())
+                        }
+                    });
+                    break;
             }
         }
 
@@ -520,12 +747,12 @@ module IEDiagnosticsAdapter {
                         this._intellisenseFrame = request.params.callFrameId;
                     }
 
+                    // The eval runs asynchronously, the response is sent once its batch completes
                     var frameId = parseInt(request.params.callFrameId);
-                    var prop = this._debugger.eval(frameId, request.params.expression);
-                    if (prop) {
-                        processedResult = {
-                            result: this.getRemoteObjectFromProp(prop)
-                        };
+                    var batchId = this._debugger.evalBatch(frameId, [request.params.expression], request.params.objectGroup || "", 0);
+                    if (batchId) {
+                        this._pendingEvalRequests.set(batchId, request.id);
+                        return;
                     }
 
                     break;
@@ -534,7 +761,6 @@ module IEDiagnosticsAdapter {
                     var docId: number = parseInt(request.params.scriptId);
                     var textResult = this._debugger.getSourceText(docId);
                     if (!textResult.loadFailed) {
-                        this.getLineEndings(docId, textResult.text);
                         processedResult = {
                             result: {
                                 scriptSource: " " + textResult.text
@@ -558,6 +784,14 @@ module IEDiagnosticsAdapter {
                     break;
 
                 case "searchInContent":
+                    var docId: number = parseInt(request.params.scriptId);
+                    var matches = this._debugger.searchInContent(docId, request.params.query, !!request.params.caseSensitive, !!request.params.isRegex);
+                    processedResult = {
+                        result: {
+                            result: matches
+                        }
+                    };
+
                     break;
 
                 case "setBreakpoint":
@@ -568,16 +802,14 @@ module IEDiagnosticsAdapter {
                         try {
                             var docId: number = this._documentMap.get(request.params.url);
 
-                            var lineEndings = this.getLineEndings(docId);
-
-                            var charCount = 0;
-                            for (var i = 0; i < request.params.lineNumber; i++) {
-                                charCount += lineEndings[i];
+                            var charCount = this._debugger.getOffsetFromLineColumn(docId, request.params.lineNumber, request.params.columnNumber || 0);
+                            if (charCount < 0) {
+                                throw new Error("Invalid location");
                             }
 
-                            charCount += request.params.columnNumber;
-
-                            var info = this._debugger.addCodeBreakpoint(docId, charCount, request.params.condition, false);
+                            var tracepoint = this.getTracepointTemplate(request.params);
+                            var isTracepoint = (tracepoint !== null);
+                            var info = this._debugger.addCodeBreakpoint(docId, charCount, (isTracepoint ? tracepoint : request.params.condition), isTracepoint);
                             var location = this.getLineColumnFromOffset(docId, info.location.start);
 
                             processedResult = {
@@ -609,6 +841,16 @@ module IEDiagnosticsAdapter {
                 case "setScriptSource":
                     break;
 
+                case "skipStackFrames":
+                    // The script pattern is matched natively, so steps that land in those scripts never reach the front end
+                    if (!this._debugger.setBlackboxPattern(request.params.script || "")) {
+                        processedResult = {
+                            error: { description: "Invalid script pattern" }
+                        };
+                    }
+
+                    break;
+
                 case "stepInto":
                     this.debuggerResume(BreakResumeAction.StepInto);
                     break;
@@ -695,55 +937,70 @@ module IEDiagnosticsAdapter {
         private onBreak(breakEventInfo: IBreakEventInfo): boolean {
             this._isAtBreakpoint = true;
 
-            var callFrames = [];
-            var frames = this._debugger.getFrames(0);
-            for (var i = 0; i < frames.length; i++) {
-                var scopes = [];
-
-                var localId = this._debugger.getLocals(frames[i].callFrameId);
-                if (localId) {
-                    scopes.push({
-                        object: {
-                            className: "Object",
-                            description: "Object",
-                            objectId: "" + localId,
-                            type: "object"
-                        },
-                        type: "local"
-                    });
+            // The frames, their locations and scope chains are all built natively in one call.
+            // Only the top of a deep callstack is built up front, the front end is told when there are more frames to ask for.
+            var snapshot = this._debugger.getPauseSnapshot(DebuggerProxy.PausedFrameLimit);
+            if (snapshot.callFrames.length >= DebuggerProxy.PausedFrameLimit) {
+                snapshot.data = { hasMoreCallFrames: true };
+            }
 
-                    var locals = this._debugger.getChildProperties(localId, 0, 0);
-                    for (var j = 0; j < locals.propInfos.length; j++) {
-                        var prop = locals.propInfos[j];
-                        if (prop.fake) {
-                            scopes.push({
-                                object: {
-                                    className: "Object",
-                                    description: "Object",
-                                    objectId: "" + prop.propertyId,
-                                    type: "object"
-                                },
-                                type: "closure"
-                            });
-                        }
-                    }
-                }
+            this.postNotification("Debugger.paused", snapshot);
+            return true;
+        }
 
-                callFrames.push({
-                    callFrameId: "" + frames[i].callFrameId,
-                    functionName: frames[i].functionName,
-                    location: this.getLineColumnFromOffset(frames[i].location.docId, frames[i].location.start),
-                    scopeChain: scopes,
-                    this: null
-                });
+        private onEvalBatchComplete(batch: IEvalBatchResult): void {
+            if (!this._pendingEvalRequests.has(batch.batchId)) {
+                return;
+            }
+
+            var id = this._pendingEvalRequests.get(batch.batchId);
+            this._pendingEvalRequests.delete(batch.batchId);
+
+            var processedResult: IWebKitResult = {};
+            var evalResult = batch.results[0];
+            if (evalResult.status === EvalStatus.Completed && evalResult.propertyInfo) {
+                processedResult = {
+                    result: this.getRemoteObjectFromProp(evalResult.propertyInfo)
+                };
+            } else if (evalResult.status === EvalStatus.TimedOut) {
+                processedResult = {
+                    error: { description: "Evaluation timed out" }
+                };
             }
 
-            this.postNotification("Debugger.paused", {
-                callFrames: callFrames,
-                reason: "other",
-                data: null
+            this.postResponse(id, processedResult);
+        }
+
+        private onDocumentsSuppressed(info: IDocumentsSuppressedInfo): void {
+            // The native side only sends a count for the dynamic scripts past the limit, so let the user know they are missing
+            this.postNotification("Console.messageAdded", {
+                message: {
+                    source: "other",
+                    level: "warning",
+                    type: "log",
+                    text: info.count + " dynamic scripts were not listed in the debugger (" + info.totalSuppressed + " in total, the limit is " + info.maxDynamicDocuments + ")"
+                }
             });
-            return true;
+        }
+
+        private onTracepointMessages(messages: ITracepointMessage[]): void {
+            // Tracepoints never pause, the native side evaluates them and hands us the logged text in batches
+            for (var i = 0; i < messages.length; i++) {
+                var message: ITracepointMessage = messages[i];
+                this.postNotification("Console.messageAdded", {
+                    message: {
+                        source: "console-api",
+                        level: (message.isError ? "error" : "log"),
+                        type: "log",
+                        text: message.text,
+                        url: message.url,
+                        line: message.lineNumber + 1,
+                        column: message.columnNumber + 1,
+                        scriptId: "" + message.docId,
+                        timestamp: message.timestamp
+                    }
+                });
+            }
         }
     }
 
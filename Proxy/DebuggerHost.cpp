@@ -105,7 +105,7 @@ JsValueRef DebuggerHost::postMessageToEngine(JsValueRef callee, bool isConstruct
         jec = ::JsStringToPointer(arguments[3], &data, &dataLength);
 
         unique_ptr<MessagePacket> spPacket(new MessagePacket());
-        spPacket->m_engineId = id;
+        spPacket->m_engineHandle = ::InternEngineId(id, idLength);
         spPacket->m_messageType = (isAtBreakpoint ? MessageType::ExecuteAtBreak : MessageType::Execute);
         spPacket->m_message = data;
 
@@ -93,16 +93,21 @@ STDMETHODIMP ProxySite::ThreadCallHandler(_In_ DWORD_PTR dwParam1, _In_ DWORD_PT
         std::for_each(packets.begin(), packets.end(), [this](const shared_ptr<MessagePacket>& spPacket)
         {
             // Debugger (or any non ui thread) messages should not be processed by the UI thread
-            ATLASSERT(::VarBstrCmp(spPacket->m_engineId, CComBSTR(L"debugger"), LOCALE_NEUTRAL, NORM_IGNORECASE) != VARCMP_EQ);
+            const EngineHandle engineHandle = spPacket->m_engineHandle;
+            ATLASSERT(engineHandle != DEBUGGER_ENGINEHANDLE);
 
-            if (m_browserEngines.find(spPacket->m_engineId) == m_browserEngines.end())
+            if (engineHandle >= m_browserEngines.size() || m_browserEngines[engineHandle].p == nullptr)
             {
-                HRESULT hr = this->CreateEngine(spPacket->m_engineId);
-                ATLASSERT(hr == S_OK); hr;
+                HRESULT hr = this->CreateEngine(engineHandle);
+                ATLASSERT(hr == S_OK);
+                if (hr != S_OK)
+                {
+                    return;
+                }
             }
 
             // Process the message in the browser engine
-            m_browserEngines[spPacket->m_engineId]->ProcessMessage(spPacket);
+            m_browserEngines[engineHandle]->ProcessMessage(spPacket);
         });
     }
     else if (dwParam1 == WM_BREAK_OCCURRED)
@@ -122,11 +127,9 @@ LRESULT ProxySite::OnMessageInQueue(UINT nMsg, WPARAM wParam, LPARAM lParam, _In
 
 LRESULT ProxySite::OnCreateEngine(UINT nMsg, WPARAM wParam, LPARAM lParam, _Inout_ BOOL& /*bHandled*/)
 {
-    // Take ownership of the string
-    CComBSTR id;
-    id.Attach(reinterpret_cast<BSTR>(wParam));
+    EngineHandle engineHandle = static_cast<EngineHandle>(wParam);
 
-    HRESULT hr = this->CreateEngine(id);
+    HRESULT hr = this->CreateEngine(engineHandle);
     ATLASSERT(hr == S_OK); hr;
 
     return 0;
@@ -259,11 +262,13 @@ HRESULT ProxySite::IOleCommandTargetExec(_In_ DWORD cmdId, _Inout_ CComPtr<IDisp
     return hr;
 }
 
-HRESULT ProxySite::CreateEngine(_In_ CComBSTR& id)
+HRESULT ProxySite::CreateEngine(_In_ EngineHandle engineHandle)
 {
+    ATLENSURE_RETURN_HR(engineHandle != INVALID_ENGINEHANDLE, E_INVALIDARG);
+
     HWND resultHwnd = NULL;
 
-    if (id.Length() == 8 && wcsncmp(id, L"debugger", 8) == 0)
+    if (engineHandle == DEBUGGER_ENGINEHANDLE)
     {
         ATLENSURE_RETURN_VAL(!m_debuggerThread.m_hwnd, -1);
 
@@ -282,18 +287,18 @@ HRESULT ProxySite::CreateEngine(_In_ CComBSTR& id)
         ::PostMessage(resultHwnd, WM_SET_MESSAGE_HWND, 0, reinterpret_cast<LPARAM>(m_websocketThread.m_hwnd));
 
         // Tell the websocket controller about this new engine
-        BSTR param = id.Detach();
-        BOOL succeeded = ::PostMessage(m_websocketThread.m_hwnd, WM_SET_MESSAGE_HWND, reinterpret_cast<WPARAM>(param), reinterpret_cast<LPARAM>(resultHwnd));
-        if (!succeeded)
-        {
-            id.Attach(param);
-            ATLASSERT(false);
-        }
+        BOOL succeeded = ::PostMessage(m_websocketThread.m_hwnd, WM_SET_MESSAGE_HWND, static_cast<WPARAM>(engineHandle), reinterpret_cast<LPARAM>(resultHwnd));
+        ATLASSERT(succeeded); succeeded;
     }
     else
     {
         // Create a new engine on this thread
-        ATLENSURE_RETURN_VAL(m_browserEngines.find(id) == m_browserEngines.end(), -1);
+        if (engineHandle >= m_browserEngines.size())
+        {
+            m_browserEngines.resize(engineHandle + 1);
+        }
+
+        ATLENSURE_RETURN_VAL(m_browserEngines[engineHandle].p == nullptr, -1);
 
         CComObject<BrowserHost>* pBrowserHost;
         HRESULT hr = CComObject<BrowserHost>::CreateInstance(&pBrowserHost);
@@ -303,7 +308,7 @@ HRESULT ProxySite::CreateEngine(_In_ CComBSTR& id)
         hr = spBrowserHost->Initialize(m_hWnd, m_spUnkSite);
         FAIL_IF_NOT_S_OK(hr);
 
-        m_browserEngines[id] = spBrowserHost;
+        m_browserEngines[engineHandle] = spBrowserHost;
 
         resultHwnd = spBrowserHost->m_hWnd;
 
@@ -100,13 +100,13 @@ private:
     HRESULT EnableDynamicDebugging(_Out_ CComPtr<IRemoteDebugApplication>& spRemoteDebugApplication);
     HRESULT LoadPDM(_In_ DWORD attachType, _Out_ CComPtr<IRemoteDebugApplication>& spRemoteDebugApplication);
     HRESULT IOleCommandTargetExec(_In_ DWORD cmdId, _Inout_ CComPtr<IDispatch>& spDispatch, _Inout_ CComVariant& spResult);
-    HRESULT CreateEngine(_In_ CComBSTR& id);
+    HRESULT CreateEngine(_In_ EngineHandle engineHandle);
 
 private:
     ThreadInfo m_websocketThread;
     ThreadInfo m_debuggerThread;
 
-    map<CComBSTR, CComPtr<BrowserHost>> m_browserEngines;
+    vector<CComPtr<BrowserHost>> m_browserEngines; // Indexed by EngineHandle
     CComObjPtr<BrowserMessageQueue> m_spMessageQueue;
 };
 
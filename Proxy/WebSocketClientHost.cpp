@@ -4,20 +4,42 @@
 
 #include "stdafx.h"
 #include "WebSocketClientHost.h"
-#include "Strsafe.h"
 
 using namespace std::placeholders;
 
+const UINT WebSocketClientHost::s_sendMessageTimeout = 30000;
+const UINT WebSocketClientHost::s_shutdownSendMessageTimeout = 1000;
+const size_t WebSocketClientHost::s_maxStagedMessageCount = 4096;
+const size_t WebSocketClientHost::s_maxStagedBytes = 32 * 1024 * 1024;
+
 WebSocketClientHost::WebSocketClientHost() : 
     ScriptEngineHost(),
     m_uiThreadHwnd(0),
-    m_serverHwnd(0)
+    m_serverHwnd(0),
+    m_stagedMessageCount(0),
+    m_rejectedMessageCount(0),
+    m_peakStagedBytes(0),
+    m_maxStagedWait(0),
+    m_totalStagedWait(0),
+    m_queuedMessageCount(0),
+    m_sentMessageCount(0),
+    m_failedMessageCount(0),
+    m_sentTransferCount(0)
 {
     // Allow messages from the server
     ::ChangeWindowMessageFilterEx(m_hWnd, WM_COPYDATA, MSGFLT_ALLOW, 0);
     ::ChangeWindowMessageFilterEx(m_hWnd, Get_WM_SET_CONNECTION_HWND(), MSGFLT_ALLOW, 0);
 }
 
+WebSocketClientHost::~WebSocketClientHost()
+{
+    this->StopSender();
+
+    CString log;
+    log.Format(L"websocketclienthost: staged messages: %lu (peak %Iu bytes, max wait %I64u ms, total wait %I64u ms), rejected: %lu\n", m_stagedMessageCount, m_peakStagedBytes, m_maxStagedWait, m_totalStagedWait, m_rejectedMessageCount);
+    ::OutputDebugString(log);
+}
+
 HRESULT WebSocketClientHost::Initialize(_In_ HWND mainHwnd, _In_ BrowserMessageQueue* pMessageQueue)
 {
     m_uiThreadHwnd = mainHwnd;
@@ -26,6 +48,17 @@ HRESULT WebSocketClientHost::Initialize(_In_ HWND mainHwnd, _In_ BrowserMessageQ
     HRESULT hr = ScriptEngineHost::Initialize(m_hWnd);
     FAIL_IF_NOT_S_OK(hr);
 
+    // Start the thread that sends our messages to the server
+    m_outgoingMessagesEvent.Attach(::CreateEvent(nullptr, FALSE, FALSE, nullptr));
+    ATLENSURE_RETURN_HR(m_outgoingMessagesEvent != nullptr, ::AtlHresultFromLastError());
+
+    m_senderShutdownEvent.Attach(::CreateEvent(nullptr, TRUE, FALSE, nullptr));
+    ATLENSURE_RETURN_HR(m_senderShutdownEvent != nullptr, ::AtlHresultFromLastError());
+
+    HANDLE hThread = ::CreateThread(nullptr, 0, &WebSocketClientHost::SenderThreadProc, this, 0, nullptr);
+    ATLENSURE_RETURN_HR(hThread != nullptr, ::AtlHresultFromLastError());
+    m_senderThread.Attach(hThread);
+
     return hr;
 }
 
@@ -33,6 +66,7 @@ HRESULT WebSocketClientHost::Initialize(_In_ HWND mainHwnd, _In_ BrowserMessageQ
 LRESULT WebSocketClientHost::OnSetConnectionHwnd(UINT nMsg, WPARAM wParam, LPARAM lParam, _Inout_ BOOL& /*bHandled*/)
 {
     // Store the HWND used to connect back to the proxy
+    CComCritSecLock<CComAutoCriticalSection> lock(m_csOutgoingMessages);
     m_serverHwnd = reinterpret_cast<HWND>(wParam);
 
     return 0;
@@ -40,23 +74,33 @@ LRESULT WebSocketClientHost::OnSetConnectionHwnd(UINT nMsg, WPARAM wParam, LPARA
 
 LRESULT WebSocketClientHost::OnSetMessageHwnd(UINT nMsg, WPARAM wParam, LPARAM lParam, _Inout_ BOOL& /*bHandled*/)
 {
-    // Take ownership of the string
-    CComBSTR idBstr;
-    idBstr.Attach(reinterpret_cast<BSTR>(wParam));
+    EngineHandle engineHandle = static_cast<EngineHandle>(wParam);
     HWND hwnd = reinterpret_cast<HWND>(lParam);
 
     // Store the engine hwnd
-    m_threadEngineHosts[idBstr] = hwnd;
+    if (engineHandle >= m_threadEngineHosts.size())
+    {
+        m_threadEngineHosts.resize(engineHandle + 1, NULL);
+    }
+
+    m_threadEngineHosts[engineHandle] = hwnd;
 
-    // Fire any queued messages
-    if (m_threadEngineMessageQueue.find(idBstr) != m_threadEngineMessageQueue.end())
+    // Fire any staged messages
+    if (engineHandle < m_stagedEngineMessages.size())
     {
-        for (auto& i : m_threadEngineMessageQueue[idBstr])
+        EngineStagingBuffer staged(std::move(m_stagedEngineMessages[engineHandle]));
+        m_stagedEngineMessages[engineHandle] = EngineStagingBuffer();
+
+        const ULONGLONG now = ::GetTickCount64();
+        for (auto& i : staged.packets)
         {
-            this->SendMessageToThreadEngine(std::move(i), /*shouldCreateEngine=*/ false);
-        }
+            // Record how long the message waited for the engine to start
+            const ULONGLONG wait = now - i.second;
+            m_totalStagedWait += wait;
+            m_maxStagedWait = max(m_maxStagedWait, wait);
 
-        m_threadEngineMessageQueue[idBstr].clear();
+            this->SendMessageToThreadEngine(std::move(i.first), /*shouldCreateEngine=*/ false);
+        }
     }
 
     return 0;
@@ -68,9 +112,21 @@ LRESULT WebSocketClientHost::OnMessageSend(UINT nMsg, WPARAM wParam, LPARAM lPar
     CComBSTR message;
     message.Attach(reinterpret_cast<BSTR>(wParam));
 
-    // Send the message to the server
-    CString messageData(message);
-    this->SendMessageToWebKit(messageData);
+    vector<CString> messages;
+    messages.push_back(CString(message));
+
+    // Gather any other messages that the engines have already queued for the server,
+    // so that they all go across in a single transfer
+    MSG msg;
+    while (::PeekMessage(&msg, m_hWnd, WM_MESSAGE_SEND, WM_MESSAGE_SEND, PM_REMOVE))
+    {
+        CComBSTR queuedMessage;
+        queuedMessage.Attach(reinterpret_cast<BSTR>(msg.wParam));
+        messages.push_back(CString(queuedMessage));
+    }
+
+    // Hand the messages to the sender thread
+    this->QueueMessagesToWebKit(messages);
 
     return 0;
 }
@@ -91,151 +147,365 @@ LRESULT WebSocketClientHost::OnCopyData(UINT nMsg, WPARAM wParam, LPARAM lParam,
 {
     PCOPYDATASTRUCT pCopyDataStruct = reinterpret_cast<PCOPYDATASTRUCT>(lParam);
 
-    // Copy the data so that we can post message to ourselves and unblock the SendMessage caller
-    unique_ptr<COPYDATASTRUCT, void(*)(COPYDATASTRUCT*)> spParams(::MakeCopyDataStructCopy(pCopyDataStruct), ::FreeCopyDataStructCopy);
-
-    PCOPYDATASTRUCT pParams = spParams.release();
-    BOOL succeeded = this->PostMessageW(WM_PROCESSCOPYDATA, wParam, reinterpret_cast<LPARAM>(pParams));
-    if (!succeeded)
-    {
-        // Take ownership if the post message fails so that we can correctly clean up the memory
-        HRESULT hr = ::AtlHresultFromLastError();
-        spParams.reset(pParams);
+    // Parse each header in place and copy the message bodies straight into their packets,
+    // so that we can post message to ourselves and unblock the SendMessage caller
+    HRESULT hr = ::ForEachCopyDataMessage(pCopyDataStruct, [this](LPCWSTR lpString, size_t length) -> HRESULT {
+        unique_ptr<MessagePacket> spPacket;
+        HRESULT hr = this->CreateMessagePacket(lpString, length, spPacket);
         FAIL_IF_NOT_S_OK(hr);
-    }
+
+        MessagePacket* pPacketParam = spPacket.release();
+        BOOL succeeded = this->PostMessageW(WM_PROCESSCOPYDATA, reinterpret_cast<WPARAM>(pPacketParam), 0);
+        if (!succeeded)
+        {
+            // Take ownership if the post message fails so that we can correctly clean up the memory
+            hr = ::AtlHresultFromLastError();
+            spPacket.reset(pPacketParam);
+            FAIL_IF_NOT_S_OK(hr);
+        }
+
+        return hr;
+    });
+    FAIL_IF_NOT_S_OK(hr);
 
     return 0;
 }
 
 LRESULT WebSocketClientHost::OnMessageFromWebKit(UINT nMsg, WPARAM wParam, LPARAM lParam, _Inout_ BOOL& /*bHandled*/)
 {
-    CString message;
+    // Take ownership of the data
+    unique_ptr<MessagePacket> spPacket(reinterpret_cast<MessagePacket*>(wParam));
 
-    // Scope for the copied data
-    {
-        // Take ownership of the copydata struct memory
-        unique_ptr<COPYDATASTRUCT, void(*)(COPYDATASTRUCT*)> spParams(reinterpret_cast<PCOPYDATASTRUCT>(lParam), ::FreeCopyDataStructCopy);
+    // Send the message to the correct thread, creating the engine if this is an injection
+    bool isInjectionMessage = (spPacket->m_messageType == MessageType::Inject);
+    this->SendMessageToThreadEngine(std::move(spPacket), isInjectionMessage);
 
-        // Get the string message from the structure
-        CopyDataPayload_StringMessage_Data* pMessage = reinterpret_cast<CopyDataPayload_StringMessage_Data*>(spParams->lpData);
-        LPCWSTR lpString = reinterpret_cast<LPCWSTR>(reinterpret_cast<BYTE*>(pMessage) + pMessage->uMessageOffset);
-        message = lpString;
+    return 0;
+}
+
+// Helper functions
+HRESULT WebSocketClientHost::SendMessageToThreadEngine(_In_ unique_ptr<MessagePacket>&& spPacket, _In_ bool shouldCreateEngine)
+{
+    HRESULT hr = S_OK;
+
+    const EngineHandle engineHandle = spPacket->m_engineHandle;
+
+    if (engineHandle < m_threadEngineHosts.size() && m_threadEngineHosts[engineHandle] != NULL)
+    {
+        // Post the message to the specified engine thread since it won't be blocked at a breakpoint
+        MessagePacket* pPacketParam = spPacket.release();
+        BOOL succeeded = ::PostMessage(m_threadEngineHosts[engineHandle], WM_MESSAGE_RECEIVE, reinterpret_cast<WPARAM>(pPacketParam), 0);
+        if (!succeeded)
+        {
+            spPacket.reset(pPacketParam);
+            hr = E_FAIL;
+        }
     }
+    else if (engineHandle == DEBUGGER_ENGINEHANDLE)
+    {
+        // Store this script ready for executing when the thread engine starts
+        hr = this->StageMessageForThreadEngine(engineHandle, std::move(spPacket), shouldCreateEngine);
+    }
+    else
+    {
+        // Use the browser ui message queue in case the thread is stopped at a breakpoint
+        shared_ptr<MessagePacket> spSharedPacket(std::move(spPacket));
+        this->m_spBrowserMessageQueue->Push(spSharedPacket);
+    }
+
+    return hr;
+}
+
+HRESULT WebSocketClientHost::CreateMessagePacket(_In_reads_(length) LPCWSTR lpString, _In_ size_t length, _Out_ unique_ptr<MessagePacket>& spPacket)
+{
+    ATLENSURE_RETURN_HR(lpString != nullptr, E_INVALIDARG);
 
     // We send all messages to the debugger by default, so that it can handle code at a breakpoint
-    CString id(L"debugger");
-    CString scriptName(L"");
+    EngineHandle engineHandle = DEBUGGER_ENGINEHANDLE;
+    LPCWSTR lpScriptName = L"";
+    size_t scriptNameLength = 0;
     bool isInjectionMessage = false;
 
     // Check if this is a script injection message
-    if (message.GetLength() > 7)
+    const size_t headerLength = 7;
+    if (length > headerLength && ::_wcsnicmp(lpString, L"inject:", headerLength) == 0)
     {
-        if (message.Left(7).CompareNoCase(L"inject:") == 0)
+        isInjectionMessage = true;
+
+        const wchar_t* pIdEnd = ::wmemchr(lpString + headerLength, L':', length - headerLength);
+        if (pIdEnd != nullptr && pIdEnd > lpString + headerLength)
         {
-            isInjectionMessage = true;
+            // Intern the id once here, so that routing never needs to compare strings
+            engineHandle = ::InternEngineId(lpString + headerLength, pIdEnd - (lpString + headerLength));
 
-            int idIndex = message.Find(L":", 7);
-            if (idIndex > 7)
+            const wchar_t* pName = pIdEnd + 1; // Skip ':'
+            const wchar_t* pNameEnd = ::wmemchr(pName, L':', length - (pName - lpString));
+            if (pNameEnd != nullptr && pNameEnd > pName)
             {
-                id = message.Mid(7, idIndex - 7);
-                id.MakeLower();
+                lpScriptName = pName;
+                scriptNameLength = pNameEnd - pName;
 
-                idIndex++; // Skip ':'
-
-                int nameIndex = message.Find(L":", idIndex);
-                if (nameIndex > idIndex)
-                {
-                    scriptName = message.Mid(idIndex, nameIndex - idIndex ); 
-                    message = message.Mid(nameIndex + 1);
-                }
+                // The remainder is the script itself
+                length -= (pNameEnd + 1) - lpString;
+                lpString = pNameEnd + 1;
             }
         }
     }
 
-    // Send the message to the correct thread
-    unique_ptr<MessagePacket> spPacket(new MessagePacket());
-    spPacket->m_engineId = id;
-    spPacket->m_scriptName = scriptName;
+    // The body is copied exactly once, into the BSTR that the engine will read from
+    spPacket.reset(new MessagePacket());
     spPacket->m_messageType = (isInjectionMessage ? MessageType::Inject : MessageType::Execute);
-    spPacket->m_message = message;
-
-    this->SendMessageToThreadEngine(std::move(spPacket), isInjectionMessage);
+    spPacket->m_engineHandle = engineHandle;
+    spPacket->m_scriptName.Attach(::SysAllocStringLen(lpScriptName, static_cast<UINT>(scriptNameLength)));
+    spPacket->m_message.Attach(::SysAllocStringLen(lpString, static_cast<UINT>(length)));
+    ATLENSURE_RETURN_HR(spPacket->m_scriptName.m_str != nullptr && spPacket->m_message.m_str != nullptr, E_OUTOFMEMORY);
 
-    return 0;
+    return S_OK;
 }
 
-// Helper functions
-HRESULT WebSocketClientHost::SendMessageToThreadEngine(_In_ unique_ptr<MessagePacket>&& spPacket, _In_ bool shouldCreateEngine)
+HRESULT WebSocketClientHost::StageMessageForThreadEngine(_In_ EngineHandle engineHandle, _In_ unique_ptr<MessagePacket>&& spPacket, _In_ bool shouldCreateEngine)
 {
-    HRESULT hr = S_OK;
+    if (engineHandle >= m_stagedEngineMessages.size())
+    {
+        m_stagedEngineMessages.resize(engineHandle + 1);
+    }
 
-    CComBSTR id(spPacket->m_engineId);
+    EngineStagingBuffer& staged = m_stagedEngineMessages[engineHandle];
 
-    if (m_threadEngineHosts.find(id) != m_threadEngineHosts.end())
+    const size_t packetBytes = spPacket->m_message.ByteLength() + spPacket->m_scriptName.ByteLength();
+    if (staged.packets.size() >= s_maxStagedMessageCount || staged.byteCount + packetBytes > s_maxStagedBytes)
     {
-        // Post the message to the specified engine thread since it won't be blocked at a breakpoint
-        MessagePacket* pPacketParam = spPacket.release();
-        BOOL succeeded = ::PostMessage(m_threadEngineHosts[id], WM_MESSAGE_RECEIVE, reinterpret_cast<WPARAM>(pPacketParam), 0);
-        if (!succeeded)
+        // The engine has not started in time, so reject the message instead of growing without bound
+        m_rejectedMessageCount++;
+        this->RejectMessage(*spPacket, L"Engine is not ready");
+        return E_OUTOFMEMORY;
+    }
+
+    staged.byteCount += packetBytes;
+    staged.packets.push_back(make_pair(std::move(spPacket), ::GetTickCount64()));
+    m_stagedMessageCount++;
+
+    size_t totalBytes = 0;
+    for (const auto& i : m_stagedEngineMessages)
+    {
+        totalBytes += i.byteCount;
+    }
+    m_peakStagedBytes = max(m_peakStagedBytes, totalBytes);
+
+    // Make sure only to create engine on the first injection
+    HRESULT hr = S_OK;
+    if (shouldCreateEngine && !staged.isEngineRequested)
+    {
+        // Create the new host for this id
+        BOOL succeeded = ::PostMessage(m_uiThreadHwnd, WM_CREATE_ENGINE, static_cast<WPARAM>(engineHandle), 0);
+        if (succeeded)
+        {
+            staged.isEngineRequested = true;
+        }
+        else
         {
-            spPacket.reset(pPacketParam);
             hr = E_FAIL;
         }
     }
-    else if (::VarBstrCmp(id, CComBSTR(L"debugger"), LOCALE_NEUTRAL, NORM_IGNORECASE) == VARCMP_EQ)
+
+    return hr;
+}
+
+void WebSocketClientHost::RejectMessage(_In_ const MessagePacket& packet, _In_ LPCWSTR reason)
+{
+    // Injected scripts have no request to respond to
+    if (packet.m_messageType == MessageType::Inject)
+    {
+        CString log;
+        log.Format(L"websocketclienthost: rejected injection of %ls: %ls\n", packet.m_scriptName.m_str, reason);
+        ::OutputDebugString(log);
+        return;
+    }
+
+    // Find the request id so that the client gets an error response for it
+    long id;
+    if (WebSocketClientHost::TryGetRequestId(packet.m_message.m_str, id))
     {
-        // Store this script ready for executing when the thread engine starts
-        m_threadEngineMessageQueue[id].push_back(std::move(spPacket));
+        CString response;
+        response.Format(L"{\"id\":%ld,\"error\":{\"code\":-32000,\"message\":\"%ls\"}}", id, reason);
 
-        // Make sure only to create engine on the first injection
-        if (shouldCreateEngine && m_threadEngineMessageQueue[id].size() == 1)
+        vector<CString> messages;
+        messages.push_back(response);
+        this->QueueMessagesToWebKit(messages);
+    }
+}
+
+bool WebSocketClientHost::TryGetRequestId(_In_opt_z_ LPCWSTR pMessage, _Out_ long& id)
+{
+    id = 0;
+    if (pMessage == nullptr)
+    {
+        return false;
+    }
+
+    // Walk the json so that only the "id" member of the top level object is used,
+    // not one that belongs to the params or appears inside a string value
+    int depth = 0;
+    bool isKey = false;
+    for (LPCWSTR p = pMessage; *p != L'\0'; p++)
+    {
+        if (*p == L'{' || *p == L'[')
+        {
+            depth++;
+            isKey = (*p == L'{');
+        }
+        else if (*p == L'}' || *p == L']')
+        {
+            depth--;
+        }
+        else if (*p == L',')
         {
-            // Create the new host for this id
-            BSTR param = id.Detach();
-            BOOL succeeded = ::PostMessage(m_uiThreadHwnd, WM_CREATE_ENGINE, reinterpret_cast<WPARAM>(param), 0);
-            if (!succeeded)
+            isKey = true;
+        }
+        else if (*p == L'"')
+        {
+            LPCWSTR pStart = p + 1;
+            for (p = pStart; *p != L'\0' && *p != L'"'; p++)
             {
-                id.Attach(param);
-                hr = E_FAIL;
+                if (*p == L'\\' && *(p + 1) != L'\0')
+                {
+                    p++;
+                }
+            }
+
+            if (*p == L'\0')
+            {
+                return false;
+            }
+
+            if (depth == 1 && isKey && (p - pStart) == 2 && ::wcsncmp(pStart, L"id", 2) == 0)
+            {
+                LPCWSTR pValue = p + 1;
+                while (::iswspace(*pValue))
+                {
+                    pValue++;
+                }
+
+                if (*pValue != L':')
+                {
+                    return false;
+                }
+
+                LPWSTR pEnd = nullptr;
+                id = ::wcstol(pValue + 1, &pEnd, 10);
+                return (pEnd != pValue + 1);
             }
+
+            isKey = false;
         }
     }
-    else
-    {
-        // Use the browser ui message queue in case the thread is stopped at a breakpoint
-        shared_ptr<MessagePacket> spSharedPacket(std::move(spPacket));
-        this->m_spBrowserMessageQueue->Push(spSharedPacket);
-    }
 
-    return hr;
+    return false;
 }
-HRESULT WebSocketClientHost::SendMessageToWebKit(_In_ CString& message)
+
+HRESULT WebSocketClientHost::QueueMessagesToWebKit(_Inout_ vector<CString>& messages)
 {
-    const size_t ucbParamsSize = sizeof(CopyDataPayload_StringMessage_Data);
-    const size_t ucbStringSize = sizeof(WCHAR) * (::wcslen(message) + 1);
-    const size_t ucbBufferSize = ucbParamsSize + ucbStringSize;
-    std::unique_ptr<BYTE> pBuffer;
-    try
+    ATLENSURE_RETURN_HR(m_outgoingMessagesEvent != nullptr, E_NOT_VALID_STATE);
+
+    // Scope for the lock
     {
-        pBuffer.reset(new BYTE[ucbBufferSize]);
+        CComCritSecLock<CComAutoCriticalSection> lock(m_csOutgoingMessages);
+        for (auto& message : messages)
+        {
+            m_outgoingMessages.push_back(message);
+        }
     }
-    catch (std::bad_alloc&)
+
+    ::InterlockedExchangeAdd(&m_queuedMessageCount, static_cast<LONG>(messages.size()));
+    messages.clear();
+
+    BOOL succeeded = ::SetEvent(m_outgoingMessagesEvent);
+    ATLENSURE_RETURN_HR(succeeded, ::AtlHresultFromLastError());
+
+    return S_OK;
+}
+
+HRESULT WebSocketClientHost::SendMessageToWebKit(_In_ const vector<CString>& messages)
+{
+    HWND serverHwnd;
+
+    // Scope for the lock
     {
-        return E_OUTOFMEMORY;
+        CComCritSecLock<CComAutoCriticalSection> lock(m_csOutgoingMessages);
+        serverHwnd = m_serverHwnd;
     }
 
+    vector<BYTE> buffer;
     COPYDATASTRUCT copyData;
-    copyData.dwData = CopyDataPayload_ProcSignature::StringMessage_Signature;
-    copyData.cbData = static_cast<DWORD>(ucbBufferSize);
-    copyData.lpData = pBuffer.get();
-
-    CopyDataPayload_StringMessage_Data* pData = reinterpret_cast<CopyDataPayload_StringMessage_Data*>(pBuffer.get());
-    pData->uMessageOffset = static_cast<UINT>(ucbParamsSize);
-
-    HRESULT hr = ::StringCbCopyEx(reinterpret_cast<LPWSTR>(pBuffer.get() + pData->uMessageOffset), ucbStringSize, message, NULL, NULL, STRSAFE_IGNORE_NULLS);
+    HRESULT hr = ::MakeCopyDataPayload(messages, buffer, copyData);
     FAIL_IF_NOT_S_OK(hr);
 
-    ::SendMessage(m_serverHwnd, WM_COPYDATA, reinterpret_cast<WPARAM>(m_hWnd), reinterpret_cast<LPARAM>(&copyData));
+    // Once shutdown has been signalled the destructor is waiting for this thread, so a busy server only gets a short time to take the last messages
+    bool isShuttingDown = (::WaitForSingleObject(m_senderShutdownEvent, 0) == WAIT_OBJECT_0);
+    UINT timeout = (isShuttingDown ? s_shutdownSendMessageTimeout : s_sendMessageTimeout);
+
+    DWORD_PTR result;
+    LRESULT succeeded = ::SendMessageTimeout(serverHwnd, WM_COPYDATA, reinterpret_cast<WPARAM>(m_hWnd), reinterpret_cast<LPARAM>(&copyData), SMTO_NORMAL | SMTO_ABORTIFHUNG, timeout, &result);
+    ATLENSURE_RETURN_HR(succeeded != 0, E_FAIL);
 
     return hr;
 }
+
+// Outgoing message thread
+DWORD WINAPI WebSocketClientHost::SenderThreadProc(_In_ LPVOID pThreadParam)
+{
+    WebSocketClientHost* pHost = reinterpret_cast<WebSocketClientHost*>(pThreadParam);
+    pHost->RunSender();
+
+    return 0;
+}
+
+void WebSocketClientHost::RunSender()
+{
+    HANDLE handles[] = { m_senderShutdownEvent, m_outgoingMessagesEvent };
+
+    bool isShuttingDown = false;
+    while (!isShuttingDown)
+    {
+        DWORD waitResult = ::WaitForMultipleObjects(_countof(handles), handles, FALSE, INFINITE);
+        isShuttingDown = (waitResult != WAIT_OBJECT_0 + 1);
+
+        // Take everything that has been queued so far, and send it as a single transfer.
+        // Anything still queued when we are shutting down is flushed before the thread exits.
+        vector<CString> messages;
+
+        // Scope for the lock
+        {
+            CComCritSecLock<CComAutoCriticalSection> lock(m_csOutgoingMessages);
+            messages.swap(m_outgoingMessages);
+        }
+
+        if (!messages.empty())
+        {
+            HRESULT hr = this->SendMessageToWebKit(messages);
+            if (hr == S_OK)
+            {
+                ::InterlockedExchangeAdd(&m_sentMessageCount, static_cast<LONG>(messages.size()));
+                ::InterlockedIncrement(&m_sentTransferCount);
+            }
+            else
+            {
+                ::InterlockedExchangeAdd(&m_failedMessageCount, static_cast<LONG>(messages.size()));
+            }
+        }
+    }
+}
+
+void WebSocketClientHost::StopSender()
+{
+    if (m_senderThread != nullptr)
+    {
+        ::SetEvent(m_senderShutdownEvent);
+        ::WaitForSingleObject(m_senderThread, INFINITE);
+        m_senderThread.Close();
+
+        CString log;
+        log.Format(L"websocketclienthost: outgoing messages queued: %ld, sent: %ld in %ld transfers, failed: %ld\n", m_queuedMessageCount, m_sentMessageCount, m_sentTransferCount, m_failedMessageCount);
+        ::OutputDebugString(log);
+    }
+}
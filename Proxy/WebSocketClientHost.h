@@ -13,6 +13,7 @@ class WebSocketClientHost :
 {
 public:
     WebSocketClientHost();
+    ~WebSocketClientHost();
 
     BEGIN_MSG_MAP(WebSocketClientHost)
         MESSAGE_HANDLER(WM_SET_MESSAGE_HWND, OnSetMessageHwnd)
@@ -36,14 +37,59 @@ public:
 
 private:
     // Helper functions
+    HRESULT CreateMessagePacket(_In_reads_(length) LPCWSTR lpString, _In_ size_t length, _Out_ unique_ptr<MessagePacket>& spPacket);
     HRESULT SendMessageToThreadEngine(_In_ unique_ptr<MessagePacket>&& spPacket, _In_ bool shouldCreateEngine);
-    HRESULT SendMessageToWebKit(_In_ CString& message);
+    HRESULT StageMessageForThreadEngine(_In_ EngineHandle engineHandle, _In_ unique_ptr<MessagePacket>&& spPacket, _In_ bool shouldCreateEngine);
+    void RejectMessage(_In_ const MessagePacket& packet, _In_ LPCWSTR reason);
+    static bool TryGetRequestId(_In_opt_z_ LPCWSTR pMessage, _Out_ long& id);
+    HRESULT QueueMessagesToWebKit(_Inout_ vector<CString>& messages);
+    HRESULT SendMessageToWebKit(_In_ const vector<CString>& messages);
+
+    // Outgoing message thread
+    static DWORD WINAPI SenderThreadProc(_In_ LPVOID pThreadParam);
+    void RunSender();
+    void StopSender();
+
+    static const UINT s_sendMessageTimeout;
+    static const UINT s_shutdownSendMessageTimeout;
+    static const size_t s_maxStagedMessageCount;
+    static const size_t s_maxStagedBytes;
+
+    // Messages held for an engine whose thread has not reported its HWND yet
+    struct EngineStagingBuffer
+    {
+        vector<pair<unique_ptr<MessagePacket>, ULONGLONG>> packets; // Packet and the tick count when it was staged
+        size_t byteCount;
+        bool isEngineRequested;
+
+        EngineStagingBuffer() : byteCount(0), isEngineRequested(false) { }
+    };
 
 private:
     HWND m_uiThreadHwnd;
     HWND m_serverHwnd;
     CComObjPtr<BrowserMessageQueue> m_spBrowserMessageQueue;
-    map<CComBSTR, HWND> m_threadEngineHosts;
-    map<CComBSTR, vector<unique_ptr<MessagePacket>>> m_threadEngineMessageQueue;
+    vector<HWND> m_threadEngineHosts; // Indexed by EngineHandle
+    vector<EngineStagingBuffer> m_stagedEngineMessages; // Indexed by EngineHandle
+
+    // Staging metrics
+    ULONG m_stagedMessageCount;
+    ULONG m_rejectedMessageCount;
+    size_t m_peakStagedBytes;
+    ULONGLONG m_maxStagedWait;
+    ULONGLONG m_totalStagedWait;
+
+    // Outgoing messages, drained by the sender thread so that the engines never wait on the server
+    CComAutoCriticalSection m_csOutgoingMessages;
+    vector<CString> m_outgoingMessages;
+    CHandle m_outgoingMessagesEvent;
+    CHandle m_senderShutdownEvent;
+    CHandle m_senderThread;
+
+    // Completion accounting for the outgoing messages
+    volatile LONG m_queuedMessageCount;
+    volatile LONG m_sentMessageCount;
+    volatile LONG m_failedMessageCount;
+    volatile LONG m_sentTransferCount;
 };
 